@@ -0,0 +1,345 @@
+///
+/// Microbenchmark for the bridge, this links the real bridge.c, client.c and origen.c against the
+/// mock VPI runtime and plays the role of the Origen process by feeding a message stream to it
+/// over the usual socket.
+///
+///   ./origen_bench parser              - Drive only vectors, exercises the message parser
+///   ./origen_bench wave                - Drive vectors using a return-to-zero wave, exercises the
+///                                        wave scheduler
+///   ./origen_bench compare             - Compare vectors, exercises the compare path
+///   ./origen_bench clock               - Drive vectors with pin0 running as a free-running clock at
+///                                        4x the vector rate, exercises the clock generator
+///   ./origen_bench replay <file>       - Replays the messages from the given file, this can be a
+///                                        plain list of messages or a recording from a real
+///                                        simulation (optionally gzipped), in which case only the
+///                                        lines starting with '>' (sent to the simulator) are used
+///
+/// Options (must be given before the workload):
+///
+///   -n <vectors>                       - Number of vectors to generate, default 100000
+///   -p <pins>                          - Number of pins to define, default 32
+///   -f <n>                             - Make every nth vector of the compare workload fail, default 0 (never)
+///   -v                                 - Echo the simulator's output to stdout
+///   -r                                 - Echo the bridge's replies to stdout
+///   -t                                 - Connect the bridge over TCP via the loopback interface rather
+///                                        than a UNIX domain socket
+///
+/// The bridge receives and decodes messages on a separate thread when more than one core is available,
+/// set ORIGEN_SIM_READER_THREAD to 0 or 1 to force this off or on.
+///
+/// origen_bench_dpi runs the same workloads with the bridge built for a testbench which runs the
+/// per-cycle loop via DPI (ORIGEN_DPI).
+///
+#define _POSIX_C_SOURCE 200809L
+#include "mock_vpi.h"
+#include <pthread.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <time.h>
+#include <unistd.h>
+
+// Period and wave timing in simtime units (ps)
+#define PERIOD "100000"
+#define DRIVE_WAVE "0_D"
+#define RTZ_DRIVE_WAVE "0_0_25000_D_75000_0"
+#define COMPARE_WAVE "50000_C_50001_X"
+#define CLOCK "G^0^25000^12500^0"
+
+typedef struct Feeder {
+  int server;
+  int fd;
+  char *workload;
+  char *file;
+  long vectors;
+  int pins;
+  long fail_every;
+  uint64_t messages;
+  uint64_t cycles;
+  uint64_t replies;
+  bool echo_replies;
+  bool tcp;
+} Feeder;
+
+static double now() {
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void write_all(int fd, const char * buf, size_t len) {
+  size_t done = 0;
+
+  while (done < len) {
+    ssize_t n = write(fd, &buf[done], len - done);
+    if (n <= 0) {
+      perror("ERROR: Failed to write to the bridge");
+      exit(1);
+    }
+    done += n;
+  }
+}
+
+static char send_buf[65536];
+static size_t send_len = 0;
+
+/// Sends the given message to the bridge, messages are buffered until flush_msgs is called or
+/// the buffer is full
+static void send_msg(Feeder * f, const char * msg) {
+  size_t n = strlen(msg);
+
+  if (send_len + n + 1 > sizeof(send_buf)) {
+    write_all((*f).fd, send_buf, send_len);
+    send_len = 0;
+  }
+  memcpy(&send_buf[send_len], msg, n);
+  send_buf[send_len + n] = '\n';
+  send_len += n + 1;
+  (*f).messages++;
+  if (msg[0] == '3' && msg[1] == '^') {
+    (*f).cycles += strtoul(&msg[2], NULL, 10);
+  }
+}
+
+static void flush_msgs(Feeder * f) {
+  write_all((*f).fd, send_buf, send_len);
+  send_len = 0;
+}
+
+static void define_pins(Feeder * f, int drive_wave) {
+  char msg[128];
+
+  send_msg(f, "1^" PERIOD);
+  for (int i = 0; i < (*f).pins; i++) {
+    sprintf(msg, "0^pin%d^%d^%d^0", i, i, drive_wave);
+    send_msg(f, msg);
+  }
+  send_msg(f, "6^0^0^" DRIVE_WAVE);
+  send_msg(f, "6^1^0^" RTZ_DRIVE_WAVE);
+  send_msg(f, "6^0^1^" COMPARE_WAVE);
+}
+
+static void synthetic(Feeder * f) {
+  char msg[128];
+  bool compare = strcmp((*f).workload, "compare") == 0;
+  bool clock = strcmp((*f).workload, "clock") == 0;
+
+  send_msg(f, "m^2000000000");
+  define_pins(f, strcmp((*f).workload, "wave") == 0 ? 1 : 0);
+  if (clock) {
+    send_msg(f, CLOCK);
+  }
+
+  for (long v = 0; v < (*f).vectors; v++) {
+    for (int i = clock ? 1 : 0; i < (*f).pins; i++) {
+      if (compare) {
+        int data = (*f).fail_every && i == 0 && (v % (*f).fail_every) == 0;
+        sprintf(msg, "4^%d^%d", i, data);
+      } else {
+        sprintf(msg, "2^%d^%d", i, (int)((v + i) & 1));
+      }
+      send_msg(f, msg);
+    }
+    send_msg(f, "3^1");
+  }
+}
+
+static void replay(Feeder * f) {
+  char cmd[1024];
+  char *line = NULL;
+  size_t cap = 0;
+  ssize_t len;
+  FILE *in;
+  size_t flen = strlen((*f).file);
+  bool gzipped = flen > 3 && strcmp((*f).file + flen - 3, ".gz") == 0;
+
+  if (gzipped) {
+    snprintf(cmd, sizeof(cmd), "gzip -dc '%s'", (*f).file);
+    in = popen(cmd, "r");
+  } else {
+    in = fopen((*f).file, "r");
+  }
+  if (!in) {
+    perror("ERROR: Could not open the replay file");
+    exit(1);
+  }
+
+  while ((len = getline(&line, &cap, in)) > 0) {
+    char *msg = line;
+
+    if (line[len - 1] == '\n') {
+      line[--len] = '\0';
+    }
+    if (line[0] == '<' || len == 0) {
+      continue;
+    }
+    if (line[0] == '>') {
+      msg = line[1] == ' ' ? &line[2] : &line[1];
+    }
+    // The recording will include the end of the simulation, this is sent later
+    if (msg[0] == '8' && msg[1] == '^') {
+      continue;
+    }
+    send_msg(f, msg);
+  }
+  free(line);
+  gzipped ? pclose(in) : fclose(in);
+}
+
+static void * feed(void * arg) {
+  Feeder *f = (Feeder *) arg;
+
+  if ((*f).file) {
+    replay(f);
+  } else {
+    synthetic(f);
+  }
+  send_msg(f, "8^");
+  flush_msgs(f);
+  return NULL;
+}
+
+/// Consumes everything the bridge sends back, counting the replies
+static void * drain(void * arg) {
+  Feeder *f = (Feeder *) arg;
+  char buf[65536];
+  ssize_t n;
+
+  while ((n = read((*f).fd, buf, sizeof(buf))) > 0) {
+    if ((*f).echo_replies) {
+      fwrite(buf, 1, n, stdout);
+    }
+    for (ssize_t i = 0; i < n; i++) {
+      if (buf[i] == '\n') {
+        (*f).replies++;
+      }
+    }
+  }
+  return NULL;
+}
+
+/// Waits for the bridge to connect and then starts feeding it
+static void * serve(void * arg) {
+  Feeder *f = (Feeder *) arg;
+  pthread_t feeder, drainer;
+
+  (*f).fd = accept((*f).server, NULL, NULL);
+  if ((*f).fd < 0) {
+    perror("ERROR: Failed to accept the bridge connection");
+    exit(1);
+  }
+  // Over TCP the bridge first sends the token it was given, this is not a reply
+  if ((*f).tcp) {
+    char c = 0;
+    while (c != '\n' && read((*f).fd, &c, 1) == 1) {
+    }
+  }
+  pthread_create(&drainer, NULL, drain, f);
+  pthread_create(&feeder, NULL, feed, f);
+  pthread_join(feeder, NULL);
+  pthread_join(drainer, NULL);
+  return NULL;
+}
+
+static void usage() {
+  fprintf(stderr, "Usage: origen_bench [-n vectors] [-p pins] [-f fail_every] [-v] [-r] [-t] parser|wave|compare|clock|replay <file>\n");
+  exit(1);
+}
+
+int main(int argc, char ** argv) {
+  Feeder f = {0};
+  struct sockaddr_un addr;
+  struct sockaddr_in tcp_addr;
+  socklen_t tcp_addr_len = sizeof(tcp_addr);
+  bool tcp = false;
+  char sock_path[108];
+  char sock_arg[128];
+  char *sim_argv[2];
+  pthread_t server_thread;
+  int opt;
+  double start, elapsed;
+
+  f.vectors = 100000;
+  f.pins = 32;
+
+  while ((opt = getopt(argc, argv, "n:p:f:vrt")) != -1) {
+    switch (opt) {
+      case 'n' : f.vectors = atol(optarg); break;
+      case 'p' : f.pins = atoi(optarg); break;
+      case 'f' : f.fail_every = atol(optarg); break;
+      case 'v' : mock_vpi_set_output(stdout); break;
+      case 'r' : f.echo_replies = true; break;
+      case 't' : tcp = true; f.tcp = true; break;
+      default  : usage();
+    }
+  }
+  if (optind >= argc) {
+    usage();
+  }
+  f.workload = argv[optind];
+  if (strcmp(f.workload, "replay") == 0) {
+    if (optind + 1 >= argc) {
+      usage();
+    }
+    f.file = argv[optind + 1];
+  } else if (strcmp(f.workload, "parser") && strcmp(f.workload, "wave") && strcmp(f.workload, "compare") &&
+             strcmp(f.workload, "clock")) {
+    usage();
+  }
+
+  snprintf(sock_path, sizeof(sock_path), "/tmp/origen_bench_%d.sock", (int)getpid());
+  if (tcp) {
+    // Listen on an ephemeral port on the loopback interface
+    f.server = socket(AF_INET, SOCK_STREAM, 0);
+    memset(&tcp_addr, 0, sizeof(tcp_addr));
+    tcp_addr.sin_family = AF_INET;
+    tcp_addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (bind(f.server, (struct sockaddr *)&tcp_addr, sizeof(tcp_addr)) < 0 || listen(f.server, 1) < 0 ||
+        getsockname(f.server, (struct sockaddr *)&tcp_addr, &tcp_addr_len) < 0) {
+      perror("ERROR: Failed to create the bench socket");
+      return 1;
+    }
+    snprintf(sock_arg, sizeof(sock_arg), "+socket+tcp://127.0.0.1:%d/bench", ntohs(tcp_addr.sin_port));
+  } else {
+    unlink(sock_path);
+    f.server = socket(AF_UNIX, SOCK_STREAM, 0);
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, sock_path);
+    if (bind(f.server, (struct sockaddr *)&addr, sizeof(addr)) < 0 || listen(f.server, 1) < 0) {
+      perror("ERROR: Failed to create the bench socket");
+      return 1;
+    }
+    snprintf(sock_arg, sizeof(sock_arg), "+socket+%s", sock_path);
+  }
+  pthread_create(&server_thread, NULL, serve, &f);
+
+  sim_argv[0] = "origen_bench";
+  sim_argv[1] = sock_arg;
+
+  mock_vpi_set_dpi_pins(f.pins);
+
+  start = now();
+  mock_vpi_run(2, sim_argv);
+  elapsed = now() - start;
+
+  // The bridge never closes its end, so unblock the drain thread
+  shutdown(f.fd, SHUT_RDWR);
+  pthread_join(server_thread, NULL);
+  close(f.server);
+  if (!tcp) {
+    unlink(sock_path);
+  }
+
+  printf("Workload:     %s\n", f.file ? f.file : f.workload);
+  printf("Elapsed:      %.3f s\n", elapsed);
+  printf("Messages:     %llu (%.0f msgs/s)\n", (unsigned long long)f.messages, f.messages / elapsed);
+  printf("Cycles:       %llu (%.0f cycles/s)\n", (unsigned long long)f.cycles, f.cycles / elapsed);
+  printf("Callbacks:    %llu\n", (unsigned long long)mock_vpi_callbacks());
+  printf("Miscompares:  %llu\n", (unsigned long long)mock_vpi_miscompares());
+  printf("Replies:      %llu\n", (unsigned long long)f.replies);
+  return 0;
+}
@@ -0,0 +1,21 @@
+#ifndef DEFINES_H
+#define DEFINES_H
+
+// Static equivalent of ext/defines.h.erb for the benchmark, which is normally rendered by
+// the sim:build command
+
+#define ORIGEN_FINISH_SIG_NAME "finish"
+#define ORIGEN_SIM_VERSION "bench"
+#define ORIGEN_SIM_TESTBENCH_NAME "origen"
+#define ORIGEN_SIM_DEBUG_MODULE_NAME "debug"
+#define ORIGEN_SIM_TB_NAME_LEN 6
+#define LOG_DEBUG 0
+#define LOG_INFO 1
+#define LOG_WARN 2
+#define LOG_WARNING 2
+#define LOG_SUCCESS 3
+#define LOG_ERROR 4
+#define LOG_DEPRECATE 5
+#define LOG_DEPRECATED 5
+
+#endif
@@ -0,0 +1,594 @@
+///
+/// A minimal mock of the VPI entry points used by the bridge, this allows bridge.c, client.c and
+/// origen.c to be linked into a standalone executable and exercised without a simulator.
+///
+/// Nets are created on demand the first time they are looked up by name and simply store the
+/// last value that was put to them. Time is advanced by an event wheel which processes the
+/// cbAfterDelay callbacks in time order, cbValueChange callbacks are fired immediately whenever
+/// a new value is put to a net.
+///
+/// To emulate the testbench pin drivers, enabling the compare on a pin will check the expected
+/// data against the DUT's output (always 0) and call the $bridge_on_miscompare system task
+/// if they differ.
+///
+/// When built with ORIGEN_DPI the event wheel is replaced by an emulation of the testbench's DPI
+/// loop, whose pin drivers are named pin0, pin1, etc.
+///
+#define _POSIX_C_SOURCE 200809L  // For strdup/strndup
+#include "mock_vpi.h"
+#include "defines.h"
+#include "bridge.h"
+#include <stdarg.h>
+#include <string.h>
+
+#define NET_TABLE_SIZE 4096
+#define MAX_SYSTFS 16
+
+enum ObjectKind { KIND_NET = 1, KIND_SYSTF_CALL, KIND_ITERATOR, KIND_ARG, KIND_WATCHER };
+
+struct Watcher;
+
+typedef struct Net {
+  int kind;                // Must be first, all mock objects start with this
+  char *name;
+  uint64_t value;
+  double real;
+  char *str;
+  struct Net *data;        // For a pin's compare net, this is the pin's data net
+  char *pin_name;          // For a pin's compare net, this is the pin's name
+  struct Net *next;        // Next net in the same hash bucket
+  struct Watcher *watchers;
+} Net;
+
+// A cbValueChange callback
+typedef struct Watcher {
+  int kind;
+  bool removed;
+  s_cb_data data;
+  s_vpi_value value;
+  struct Watcher *next;
+} Watcher;
+
+typedef struct Arg {
+  int kind;
+  int format;
+  char *str;
+  int integer;
+} Arg;
+
+typedef struct Iterator {
+  int kind;
+  int pos;
+} Iterator;
+
+typedef struct Callback {
+  uint64_t time;
+  uint64_t seq;            // Used to make callbacks registered for the same time fire in order
+  PLI_INT32 (*cb_rtn)(struct t_cb_data *);
+  PLI_BYTE8 *user_data;
+} Callback;
+
+static Net *nets[NET_TABLE_SIZE];
+static Callback *wheel = NULL;
+static int wheel_size = 0;
+static int wheel_capacity = 0;
+static uint64_t next_seq = 0;
+static uint64_t now = 0;
+static uint64_t callbacks_fired = 0;
+static uint64_t miscompares_reported = 0;
+static bool finished = false;
+static FILE *output = NULL;
+static int mock_argc = 0;
+static int dpi_pins = 32;
+static char **mock_argv = NULL;
+
+static s_cb_data start_of_sim[4];
+static int start_of_sim_count = 0;
+static s_cb_data end_of_sim[4];
+static int end_of_sim_count = 0;
+static s_vpi_systf_data systfs[MAX_SYSTFS];
+static int systf_count = 0;
+
+static int systf_call = KIND_SYSTF_CALL;
+static Iterator arg_iterator = {KIND_ITERATOR, 0};
+static Arg args[3];
+
+static Net * find_net(const char *);
+static void schedule(uint64_t, PLI_INT32 (*)(struct t_cb_data *), PLI_BYTE8 *);
+static void compare(Net *);
+static void notify_watchers(Net *);
+static char * value_to_str(uint64_t, int);
+
+static uint32_t hash(const char * str) {
+  uint32_t h = 2166136261u;
+
+  while (*str) {
+    h = (h ^ (unsigned char)*str++) * 16777619u;
+  }
+  return h % NET_TABLE_SIZE;
+}
+
+static bool ends_with(const char * str, const char * suffix) {
+  size_t len = strlen(str);
+  size_t slen = strlen(suffix);
+
+  return len >= slen && strcmp(str + len - slen, suffix) == 0;
+}
+
+/// Returns the net with the given name, creating it if it does not exist yet
+static Net * find_net(const char * name) {
+  uint32_t h = hash(name);
+  Net *net;
+  const char *pins = ORIGEN_SIM_TESTBENCH_CAT("pins.");
+
+  for (net = nets[h]; net; net = (*net).next) {
+    if (strcmp((*net).name, name) == 0) {
+      return net;
+    }
+  }
+
+  net = (Net *) calloc(1, sizeof(Net));
+  (*net).kind = KIND_NET;
+  (*net).name = strdup(name);
+  (*net).next = nets[h];
+  nets[h] = net;
+
+  // Link a pin's compare net to its data net so that compares can be emulated
+  if (strncmp(name, pins, strlen(pins)) == 0 && ends_with(name, ".compare")) {
+    size_t len = strlen(name) - strlen(".compare");
+    char *data = (char *) malloc(len + 6);
+
+    memcpy(data, name, len);
+    strcpy(data + len, ".data");
+    (*net).data = find_net(data);
+    free(data);
+    (*net).pin_name = strndup(name + strlen(pins), len - strlen(pins));
+  }
+  return net;
+}
+
+static void schedule(uint64_t time, PLI_INT32 (*cb_rtn)(struct t_cb_data *), PLI_BYTE8 * user_data) {
+  Callback cb = {time, next_seq++, cb_rtn, user_data};
+  int i;
+
+  if (wheel_size == wheel_capacity) {
+    wheel_capacity = wheel_capacity ? wheel_capacity * 2 : 256;
+    wheel = (Callback *) realloc(wheel, wheel_capacity * sizeof(Callback));
+  }
+
+  // Sift up
+  i = wheel_size++;
+  while (i > 0) {
+    Callback *parent = &wheel[(i - 1) / 2];
+    if ((*parent).time < cb.time || ((*parent).time == cb.time && (*parent).seq < cb.seq)) {
+      break;
+    }
+    wheel[i] = *parent;
+    i = (i - 1) / 2;
+  }
+  wheel[i] = cb;
+}
+
+#ifndef ORIGEN_DPI
+static Callback unschedule() {
+  Callback top = wheel[0];
+  Callback last = wheel[--wheel_size];
+  int i = 0;
+
+  // Sift down
+  while (1) {
+    int child = i * 2 + 1;
+    if (child >= wheel_size) {
+      break;
+    }
+    if (child + 1 < wheel_size && (wheel[child + 1].time < wheel[child].time ||
+        (wheel[child + 1].time == wheel[child].time && wheel[child + 1].seq < wheel[child].seq))) {
+      child++;
+    }
+    if (last.time < wheel[child].time || (last.time == wheel[child].time && last.seq < wheel[child].seq)) {
+      break;
+    }
+    wheel[i] = wheel[child];
+    i = child;
+  }
+  wheel[i] = last;
+  return top;
+}
+#endif
+
+static void notify_watchers(Net * net) {
+  for (Watcher *w = (*net).watchers; w; w = (*w).next) {
+    if (!(*w).removed) {
+      if ((*w).value.format == vpiRealVal) {
+        (*w).value.value.real = (*net).real;
+      } else if ((*w).value.format == vpiBinStrVal) {
+        (*w).value.value.str = value_to_str((*net).value, 2);
+      } else {
+        (*w).value.value.integer = (PLI_INT32)(*net).value;
+      }
+      (*w).data.value = &(*w).value;
+      callbacks_fired++;
+      (*w).data.cb_rtn(&(*w).data);
+    }
+  }
+}
+
+/// Emulates the testbench pin driver's compare against the DUT's output, which is always 0
+static void compare(Net * net) {
+  int expected = (int)(*(*net).data).value;
+  int received = 0;
+
+  if (expected != received) {
+    for (int i = 0; i < systf_count; i++) {
+      if (strcmp(systfs[i].tfname, "$bridge_on_miscompare") == 0) {
+        args[0] = (Arg){KIND_ARG, vpiStringVal, (*net).pin_name, 0};
+        args[1] = (Arg){KIND_ARG, vpiIntVal, NULL, expected};
+        args[2] = (Arg){KIND_ARG, vpiIntVal, NULL, received};
+        arg_iterator.pos = 0;
+        miscompares_reported++;
+        systfs[i].calltf(systfs[i].user_data);
+      }
+    }
+  }
+}
+
+static char * value_to_str(uint64_t value, int base) {
+  static char buf[80];
+
+  if (base == 2) {
+    for (int i = 0; i < 32; i++) {
+      buf[i] = (value >> (31 - i)) & 1 ? '1' : '0';
+    }
+    buf[32] = '\0';
+  } else if (base == 16) {
+    sprintf(buf, "%llx", (unsigned long long)value);
+  } else {
+    sprintf(buf, "%llu", (unsigned long long)value);
+  }
+  return buf;
+}
+
+#ifdef ORIGEN_DPI
+/// Gets the pin driver state from the bridge, emulating the compare of any pins whose compare has
+/// just been enabled
+static void dpi_sync(uint32_t ** state, char ** names) {
+  bridge_dpi_pin_state(state[0], state[1], state[2], state[3], state[4], state[5], state[6]);
+  for (int i = 0; i < dpi_pins; i++) {
+    uint32_t bit = 1u << (i % 32);
+    int w = i / 32;
+
+    if ((state[6][w] & bit) && (state[4][w] & bit) && (state[0][w] & bit)) {
+      miscompares_reported++;
+      bridge_on_miscompare_dpi(names[i], 1, 0);
+    }
+  }
+}
+
+/// Emulates the testbench's DPI loop (origen_dpi_loop in origen.sv)
+static void run_dpi_loop() {
+  int words = (dpi_pins + 31) / 32;
+  uint32_t *state[7];
+  char **names = (char **) malloc(sizeof(char *) * dpi_pins);
+  int64_t period, t, elapsed;
+
+  for (int i = 0; i < 7; i++) {
+    state[i] = (uint32_t *) calloc(words ? words : 1, sizeof(uint32_t));
+  }
+  bridge_dpi_init(dpi_pins);
+  for (int i = 0; i < dpi_pins; i++) {
+    names[i] = (char *) malloc(16);
+    sprintf(names[i], "pin%d", i);
+    bridge_dpi_define_pin(names[i], i, 2);
+  }
+
+  while (!finished) {
+    bridge_dpi_start_cycle(&period);
+    dpi_sync(state, names);
+    elapsed = 0;
+    while (!finished && bridge_dpi_next_event(&t)) {
+      now += t - elapsed;
+      elapsed = t;
+      bridge_dpi_apply_events();
+      dpi_sync(state, names);
+    }
+    now += period - elapsed;
+  }
+}
+#endif
+
+int mock_vpi_run(int argc, char ** argv) {
+  s_cb_data data;
+  s_vpi_time time;
+
+  mock_argc = argc;
+  mock_argv = argv;
+
+  for (int i = 0; vlog_startup_routines[i]; i++) {
+    vlog_startup_routines[i]();
+  }
+  for (int i = 0; i < start_of_sim_count && !finished; i++) {
+    start_of_sim[i].cb_rtn(&start_of_sim[i]);
+  }
+
+#ifdef ORIGEN_DPI
+  UNUSED(data);
+  UNUSED(time);
+  run_dpi_loop();
+#else
+  time.type = vpiSimTime;
+  while (!finished && wheel_size) {
+    Callback cb = unschedule();
+
+    now = cb.time;
+    time.high = (uint32_t)(now >> 32);
+    time.low = (uint32_t)now;
+    data.reason = cbAfterDelay;
+    data.cb_rtn = cb.cb_rtn;
+    data.obj = 0;
+    data.time = &time;
+    data.value = 0;
+    data.user_data = cb.user_data;
+    callbacks_fired++;
+    cb.cb_rtn(&data);
+  }
+#endif
+
+  for (int i = 0; i < end_of_sim_count; i++) {
+    end_of_sim[i].cb_rtn(&end_of_sim[i]);
+  }
+  return 0;
+}
+
+void mock_vpi_set_dpi_pins(int n) {
+  dpi_pins = n;
+}
+
+void mock_vpi_set_output(FILE * f) {
+  output = f;
+}
+
+uint64_t mock_vpi_callbacks() {
+  return callbacks_fired;
+}
+
+uint64_t mock_vpi_miscompares() {
+  return miscompares_reported;
+}
+
+vpiHandle vpi_register_cb(p_cb_data cb_data_p) {
+  switch ((*cb_data_p).reason) {
+    case cbStartOfSimulation :
+      start_of_sim[start_of_sim_count++] = *cb_data_p;
+      break;
+    case cbEndOfSimulation :
+      end_of_sim[end_of_sim_count++] = *cb_data_p;
+      break;
+    case cbAfterDelay :
+      schedule(now + (((uint64_t)(*(*cb_data_p).time).high << 32) | (*(*cb_data_p).time).low),
+               (*cb_data_p).cb_rtn, (*cb_data_p).user_data);
+      break;
+    case cbValueChange :
+      {
+        Net *net = (Net *)(*cb_data_p).obj;
+        Watcher *w = (Watcher *) calloc(1, sizeof(Watcher));
+
+        (*w).kind = KIND_WATCHER;
+        (*w).data = *cb_data_p;
+        (*w).value.format = (*cb_data_p).value ? (*(*cb_data_p).value).format : vpiIntVal;
+        (*w).next = (*net).watchers;
+        (*net).watchers = w;
+        return (vpiHandle) w;
+      }
+    default :
+      fprintf(stderr, "MOCK VPI: Unsupported callback reason %d\n", (*cb_data_p).reason);
+      exit(1);
+  }
+  return NULL;
+}
+
+PLI_INT32 vpi_remove_cb(vpiHandle cb_obj) {
+  // Watchers are never freed since the bridge could be in the middle of being notified by one
+  ((Watcher *) cb_obj)->removed = true;
+  return 1;
+}
+
+vpiHandle vpi_register_systf(p_vpi_systf_data systf_data_p) {
+  systfs[systf_count++] = *systf_data_p;
+  return NULL;
+}
+
+vpiHandle vpi_handle_by_name(PLI_BYTE8 * name, vpiHandle scope) {
+  UNUSED(scope);
+  return (vpiHandle) find_net(name);
+}
+
+/// Memories are 64 words of 64 bits, each word is a net named <memory>[<index>]
+vpiHandle vpi_handle_by_index(vpiHandle object, PLI_INT32 indx) {
+  Net *net = (Net *) object;
+  char *name = malloc(strlen((*net).name) + 16);
+  Net *word;
+
+  if (indx < 0 || indx >= 64) {
+    free(name);
+    return NULL;
+  }
+  sprintf(name, "%s[%d]", (*net).name, indx);
+  word = find_net(name);
+  free(name);
+  return (vpiHandle) word;
+}
+
+vpiHandle vpi_handle(PLI_INT32 type, vpiHandle refHandle) {
+  UNUSED(refHandle);
+  return type == vpiSysTfCall ? (vpiHandle) &systf_call : NULL;
+}
+
+vpiHandle vpi_iterate(PLI_INT32 type, vpiHandle refHandle) {
+  UNUSED(refHandle);
+  if (type == vpiArgument) {
+    arg_iterator.pos = 0;
+    return (vpiHandle) &arg_iterator;
+  }
+  return NULL;
+}
+
+vpiHandle vpi_scan(vpiHandle iterator) {
+  Iterator *it = (Iterator *) iterator;
+
+  if ((*it).pos < 3) {
+    return (vpiHandle) &args[(*it).pos++];
+  }
+  return NULL;
+}
+
+PLI_INT32 vpi_get(PLI_INT32 property, vpiHandle object) {
+  switch (property) {
+    // Report a timescale of ps
+    case vpiTimeUnit :
+      return -12;
+    // All nets are 64-bit regs, or reals once a real value has been put to them
+    case vpiType :
+      return (*(Net *)object).real != 0.0 ? vpiRealVar : vpiReg;
+    case vpiSize :
+      return 64;
+    default :
+      return 0;
+  }
+}
+
+void vpi_get_value(vpiHandle expr, p_vpi_value value_p) {
+  if (*(int *)expr == KIND_ARG) {
+    Arg *arg = (Arg *) expr;
+
+    if ((*value_p).format == vpiStringVal) {
+      (*value_p).value.str = (*arg).str;
+    } else {
+      (*value_p).value.integer = (*arg).integer;
+    }
+    return;
+  }
+
+  Net *net = (Net *) expr;
+  switch ((*value_p).format) {
+    case vpiIntVal :
+      (*value_p).value.integer = (PLI_INT32)(*net).value;
+      break;
+    case vpiRealVal :
+      (*value_p).value.real = (*net).real;
+      break;
+    case vpiBinStrVal :
+      (*value_p).value.str = value_to_str((*net).value, 2);
+      break;
+    case vpiHexStrVal :
+      (*value_p).value.str = value_to_str((*net).value, 16);
+      break;
+    case vpiDecStrVal :
+      (*value_p).value.str = value_to_str((*net).value, 10);
+      break;
+    case vpiStringVal :
+      (*value_p).value.str = (*net).str ? (*net).str : "";
+      break;
+    case vpiVectorVal :
+      {
+        static s_vpi_vecval vector[2];
+
+        vector[0].aval = (PLI_INT32)(uint32_t)(*net).value;
+        vector[0].bval = 0;
+        vector[1].aval = (PLI_INT32)(uint32_t)((*net).value >> 32);
+        vector[1].bval = 0;
+        (*value_p).value.vector = vector;
+      }
+      break;
+    default :
+      fprintf(stderr, "MOCK VPI: Unsupported value format %d\n", (*value_p).format);
+      exit(1);
+  }
+}
+
+vpiHandle vpi_put_value(vpiHandle object, p_vpi_value value_p, p_vpi_time time_p, PLI_INT32 flags) {
+  Net *net = (Net *) object;
+  UNUSED(time_p);
+
+  if (net == NULL || flags == vpiReleaseFlag) {
+    return NULL;
+  }
+
+  switch ((*value_p).format) {
+    case vpiIntVal :
+      (*net).value = (uint64_t)(*value_p).value.integer;
+      break;
+    case vpiRealVal :
+      (*net).real = (*value_p).value.real;
+      break;
+    case vpiDecStrVal :
+      (*net).value = strtoull((*value_p).value.str, NULL, 10);
+      break;
+    case vpiBinStrVal :
+      (*net).value = strtoull((*value_p).value.str, NULL, 2);
+      break;
+    case vpiHexStrVal :
+      (*net).value = strtoull((*value_p).value.str, NULL, 16);
+      break;
+    case vpiVectorVal :
+      (*net).value = (uint64_t)(uint32_t)(*value_p).value.vector[0].aval |
+                     ((uint64_t)(uint32_t)(*value_p).value.vector[1].aval << 32);
+      break;
+    case vpiStringVal :
+      free((*net).str);
+      (*net).str = strdup((*value_p).value.str ? (*value_p).value.str : "");
+      break;
+    default :
+      fprintf(stderr, "MOCK VPI: Unsupported value format %d\n", (*value_p).format);
+      exit(1);
+  }
+
+  if ((*net).watchers) {
+    notify_watchers(net);
+  }
+  if ((*net).data && (*net).value) {
+    compare(net);
+  }
+  if ((*net).value && strcmp((*net).name, ORIGEN_SIM_TESTBENCH_CAT(ORIGEN_FINISH_SIG_NAME)) == 0) {
+    finished = true;
+  }
+  return NULL;
+}
+
+void vpi_get_time(vpiHandle object, p_vpi_time time_p) {
+  UNUSED(object);
+  (*time_p).high = (uint32_t)(now >> 32);
+  (*time_p).low = (uint32_t)now;
+  (*time_p).real = (double)now;
+}
+
+PLI_INT32 vpi_free_object(vpiHandle object) {
+  UNUSED(object);
+  return 1;
+}
+
+PLI_INT32 vpi_get_vlog_info(p_vpi_vlog_info vlog_info_p) {
+  (*vlog_info_p).argc = mock_argc;
+  (*vlog_info_p).argv = mock_argv;
+  (*vlog_info_p).product = "OrigenSim Mock VPI";
+  (*vlog_info_p).version = ORIGEN_SIM_VERSION;
+  return 1;
+}
+
+PLI_INT32 vpi_printf(PLI_BYTE8 * format, ...) {
+  va_list aptr;
+  int len = 0;
+
+  if (output) {
+    va_start(aptr, format);
+    len = vfprintf(output, format, aptr);
+    va_end(aptr);
+  }
+  return len;
+}
+
+PLI_INT32 vpi_flush() {
+  if (output) {
+    fflush(output);
+  }
+  return 0;
+}
@@ -0,0 +1,23 @@
+#ifndef MOCK_VPI_H
+#define MOCK_VPI_H
+
+#include "common.h"
+
+/// Runs a mock simulation, this will call the vlog_startup_routines and then process the
+/// event wheel until the testbench's finish signal is set or there is nothing left to do.
+/// The given args are made available to the bridge via vpi_get_vlog_info.
+int mock_vpi_run(int, char**);
+
+/// Sets the number of pin drivers in the emulated testbench when built with ORIGEN_DPI
+void mock_vpi_set_dpi_pins(int);
+
+/// Sets where vpi_printf output goes, pass NULL to discard it
+void mock_vpi_set_output(FILE*);
+
+/// Returns the number of callbacks which have been fired by the event wheel
+uint64_t mock_vpi_callbacks(void);
+
+/// Returns the number of miscompares which have been reported to the bridge
+uint64_t mock_vpi_miscompares(void);
+
+#endif
@@ -29,6 +29,8 @@ when "sim:build_example"
       cmd += ' --define ORIGEN_SIM_SYNOPSIS'
     elsif ['icarus'].include?(Origen.environment.name)
       cmd += ' --define ORIGEN_SIM_ICARUS'
+    elsif ['verilator'].include?(Origen.environment.name)
+      cmd += ' --vendor verilator'
     end
 
     clean = false
@@ -46,6 +48,7 @@ when "sim:build_example"
     output = `#{cmd}`
     puts output
     Origen.load_target
+    require 'origen_sim/build_cache'
     dir = "simulation/default/#{tester.simulator.config[:vendor]}"
     
     if clean
@@ -54,8 +57,16 @@ when "sim:build_example"
     end
     
     FileUtils.mkdir_p(dir)
+
+    # Re-use a previously compiled snapshot if one exists for the same testbench and vendor
+    key_file = "#{Origen.config.output_directory}/#{OrigenSim::BuildCache::KEY_FILE}"
+    if File.exist?(key_file)
+      snapshot_key = OrigenSim::BuildCache.snapshot_key(File.read(key_file).strip, "#{tester.simulator.config[:vendor]} #{tester.simulator.config[:verdi]}")
+      cached = OrigenSim::BuildCache.fetch(:snapshot, snapshot_key, dir)
+    end
+
     Dir.chdir dir do
-      case tester.simulator.config[:vendor]
+      case cached ? nil : tester.simulator.config[:vendor]
       when :icarus
         output =~ /  (cd .*)\n/
         system $1.gsub('stub', 'dut1')
@@ -63,6 +74,13 @@ when "sim:build_example"
         output =~ /\n(.*iverilog .*)\n/
         system $1.gsub('stub', 'dut1')
 
+      when :verilator
+        output =~ /  (cd .*origen_vpi\.a.*)\n/
+        system $1.gsub('stub', 'dut1')
+        output =~ /\n(.*verilator .*)\n/
+        system $1.gsub('stub', 'dut1')
+        FileUtils.mv 'obj_dir/Vorigen', '.'
+
       when :cadence
         output =~ /\n(.*irun .*)\n/
         compile_cmd = $1.gsub('stub', 'dut1')
@@ -81,6 +99,10 @@ when "sim:build_example"
       end
     end
 
+    if snapshot_key && !cached
+      OrigenSim::BuildCache.store(:snapshot, snapshot_key, Dir.glob("#{dir}/*"))
+    end
+
     puts
     puts "Done, run this command to run a test simulation using #{tester.simulator.config[:vendor]}:"
     puts
@@ -27,6 +27,22 @@ when 'generate', 'program'
     OrigenSim.max_errors = value
   }]
 
+  @application_options << ["--fail_waves [CYCLES]", Integer, "Only dump waves within CYCLES (default 100) of the failures seen by the previous simulation of the pattern", ->(options, cycles) {
+    OrigenSim.fail_waves = cycles || 100
+  }]
+
+  @application_options << ["--rerun", "Simulate all patterns, even those which have passed previously and not changed since then", ->(options) {
+    OrigenSim.rerun = true
+  }]
+
+  @application_options << ["--profile", "Measure where the time goes in the simulation and report it by pattern region and source location", ->(options) {
+    OrigenSim.profile = true
+  }]
+
+  @application_options << ["--record", "Record the messages sent to the simulator so that the simulation can be re-run later via the sim:replay command", ->(options) {
+    OrigenSim.record = true
+  }]
+
 when "sim:ci", "origen_sim:ci"
   require "#{Origen.root!}/lib/origen_sim/commands/ci"
   exit 0
@@ -45,10 +61,22 @@ when "sim:unpack"
   OrigenSim::Commands::Pack.unpack
   exit 0
 
+when "sim:cache"
+  require "#{Origen.root!}/lib/origen_sim/commands/cache"
+  exit 0
+
 when "sim:run"
   OrigenSim.run_source(ARGV[0])
   exit 0
 
+when "sim:replay"
+  unless ARGV[0] && File.exist?(ARGV[0])
+    puts 'Usage: origen sim:replay RECORDING'
+    exit 1
+  end
+  OrigenSim.replay(ARGV[0])
+  exit 0
+
 #when "sim:list"
 #  require "#{Origen.root!}/lib/origen_sim/commands/pack"
 #  OrigenSim::Commands::Pack.list
@@ -60,6 +88,8 @@ else
  sim:co       Checkout a simulation snapshot
  sim:pack     Packs the snapshot into a compressed directory
  sim:unpack   Unpacks a snapshot
+ sim:replay   Re-runs a simulation from a recording made by running with --record
+ sim:cache    Manage the cache of sim:build outputs and compiled snapshots
   EOT
  # sim:list     List the available snapshot packs
   
@@ -0,0 +1,2 @@
+OrigenSim::Tester.new vendor: :verilator,
+                      gtkwave: ENV["ORIGEN_SIM_GTKWAVE"]
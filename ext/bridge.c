@@ -2,6 +2,7 @@
 /// This implements the bridge between Origen and the simulation, it implements a
 /// simple string-based message protocol for communicating between the two domains
 ///
+#define _POSIX_C_SOURCE 200809L  // For clock_gettime
 #include "bridge.h"
 #include "client.h"
 #include "defines.h"
@@ -11,10 +12,55 @@
 #include <stdbool.h>
 #include <string.h>
 #include <stdarg.h>
+#include <time.h>
+#include <ctype.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
 #define MAX_NUMBER_PINS 2000
 #define MAX_WAVE_EVENTS 50
 #define MAX_TRANSACTION_ERRORS 128
+#define FLUSH_MARKER "!FLUSH!"
+#define HISTOGRAM_BUCKETS 40
+#define MAX_DUMP_WINDOWS 1024
+#define MAX_ANALOG_WAVES 64
+#define PI 3.14159265358979323846
+#define MAX_ANALOG_MEASUREMENTS 64
+#define MAX_CAPTURE_NETS 256
+#define MAX_NET_GROUPS 256
+#define MAX_SUBSCRIPTIONS 256
+#define MAX_SUBSCRIPTION_EVENTS 4096
+#define MAX_PENDING_MISCOMPARES 1024
+#define MAX_DPI_PINS MAX_NUMBER_PINS
+
+// The pin driver registers which are set by the bridge, see set_pin_reg
+#define PIN_DATA 0
+#define PIN_DRIVE 1
+#define PIN_FORCE_DATA 2
+#define PIN_COMPARE 3
+#define PIN_CAPTURE 4
+
+// The optional protocol features supported by this bridge, these are reported to Origen in the hello
+// message so that it can tell what it is able to use without relying on the version alone
+#define BRIDGE_FEATURES_BASE "trailers,flush_markers,stats,fail_waves,dump_control,analog_waves," \
+                             "analog_measurements,bulk_capture,bulk_peek,load_memory,dump_memory," \
+                             "subscriptions,profile,clocks"
+#ifdef ORIGEN_DPI
+#define BRIDGE_FEATURES_DPI ",dpi"
+#else
+#define BRIDGE_FEATURES_DPI ""
+#endif
+#ifdef ORIGEN_VERILATOR
+#define BRIDGE_FEATURES_VERILATOR ",verilator"
+#else
+#define BRIDGE_FEATURES_VERILATOR ""
+#endif
+#define BRIDGE_FEATURES BRIDGE_FEATURES_BASE BRIDGE_FEATURES_DPI BRIDGE_FEATURES_VERILATOR
+#ifndef vpiStringVar
+#define vpiStringVar 616  // From sv_vpi_user.h, a SystemVerilog string variable
+#endif
 
 typedef struct Pin {
   char *name;
@@ -32,6 +78,7 @@ typedef struct Pin {
   int drive_data;        // Used to hold the new drive data for this pin until needed by the drive wave
   bool capture_en;       // Used to indicated when compare data should be captured instead of compared
   bool present;          // Set to true if the pin is present in the testbench
+  int dpi_index;         // The pin driver's position in the testbench's DPI pin state vectors
 } Pin;
 
 typedef struct Event {
@@ -54,6 +101,170 @@ typedef struct Miscompare {
   int received;
 } Miscompare;
 
+// A range of cycles during which wave dumping should be enabled
+typedef struct DumpWindow {
+  unsigned long long start;
+  unsigned long long end;
+} DumpWindow;
+
+// A real-valued waveform which is being applied to an analog pin driver by the bridge, either
+// a piecewise-linear ('p') or a sine ('s') wave
+typedef struct AnalogWave {
+  char *net;             // The name of the pin driver, e.g. origen.pins.vdd
+  vpiHandle drive;       // A handle to the driver's real drive value
+  char type;
+  bool active;
+  int generation;        // Incremented whenever the wave is stopped, so that any pending callbacks can be ignored
+  uint64_t start;        // Sim time at which the waveform started
+  uint64_t step;         // Sim time between updates of the drive value
+  uint64_t duration;     // Length of the waveform in sim time, 0 means forever (sine only)
+  int number_of_points;  // Piecewise-linear points, times are relative to the start
+  int points_capacity;
+  uint64_t *point_times;
+  double *point_values;
+  double offset;         // Sine parameters, the period is in sim time
+  double amplitude;
+  uint64_t period;
+} AnalogWave;
+
+// A measurement of a real-valued net which is sampled by the bridge, either on every value change
+// or at a fixed interval, until it is stopped by Origen
+typedef struct AnalogMeasurement {
+  char *net;
+  vpiHandle handle;
+  vpiHandle value_change_cb;
+  bool active;
+  int generation;       // Incremented whenever the measurement is stopped, so that any pending callbacks can be ignored
+  uint64_t interval;    // Sim time between samples, 0 means sample on every value change
+  bool has_min;
+  bool has_max;
+  double min_limit;
+  double max_limit;
+  bool failed;          // Only the first out-of-limit sample will be reported as an error
+  uint64_t count;
+  double min;
+  double max;
+  double sum;
+} AnalogMeasurement;
+
+// A free-running clock which is being generated on a pin by the bridge, see 'G'. Once started its edges
+// are applied by callbacks without any further messages from Origen.
+typedef struct Clock {
+  bool active;
+  int generation;        // Incremented whenever the clock is stopped or restarted, so that any pending callbacks can be ignored
+  int level;
+  uint64_t high;         // Sim time for which the clock is high in each period
+  uint64_t low;          // Sim time for which the clock is low in each period
+  uint64_t next_high;    // A new high/low time to be applied from the next rising edge, 0 when there is none
+  uint64_t next_low;
+  vpiHandle force_data;  // A handle to the pin driver's force_data register, only used when built with ORIGEN_DPI
+} Clock;
+
+// A run of consecutive cycles during which all of the nets being captured had the same values
+typedef struct CaptureRun {
+  char *values;                // The binary string values of the captured nets, comma separated
+  unsigned long long cycles;
+} CaptureRun;
+
+// A group of nets which have been registered by Origen so that they can all be peeked by ID
+typedef struct NetGroup {
+  vpiHandle *nets;
+  int number_of_nets;
+  int capacity;
+} NetGroup;
+
+// A memory (an array of regs) within the DUT which is being accessed directly by the bridge
+typedef struct Memory {
+  vpiHandle handle;
+  int base;              // The lowest index of the array
+  int size;              // The number of words in the array
+  int width;             // The number of bits in each word
+  int vector_words;      // The number of s_vpi_vecval elements needed to hold a word
+} Memory;
+
+// Reads the words from a memory image file which has been mapped into memory, the format is
+// either 'b' for raw binary (each word is the minimum number of bytes, little endian) or 'h'
+// for $readmemh style hex
+typedef struct ImageReader {
+  char *data;
+  size_t len;
+  size_t pos;
+  char format;
+  int index;             // The array index of the next word
+} ImageReader;
+
+// A net whose value changes are being sent to Origen
+typedef struct Subscription {
+  vpiHandle handle;
+  vpiHandle value_change_cb;
+  bool active;
+  bool changed;          // Set when the value has changed since the event buffer overflowed
+} Subscription;
+
+// A value change of a subscribed net which is waiting to be sent to Origen
+typedef struct SubscriptionEvent {
+  int id;
+  uint64_t time;
+  unsigned long long cycle;
+  char *value;
+} SubscriptionEvent;
+
+// The time spent in the bridge and in the simulator for the cycle blocks attributed to a particular
+// profile key by Origen, see 'F'
+typedef struct ProfileEntry {
+  uint64_t bridge_ns;
+  uint64_t simulator_ns;
+  unsigned long long blocks;
+} ProfileEntry;
+
+// A miscompare reported by the Verilator testbench which is still to be processed, see bridge_on_miscompare_dpi
+typedef struct PendingMiscompare {
+  char *pin_name;
+  int expected;
+  int received;
+} PendingMiscompare;
+
+// A wave event which is to be applied during the current cycle by the testbench's DPI loop, this
+// is the equivalent of a callback registered by register_wave_event
+typedef struct DpiEvent {
+  uint64_t time;
+  int wave_ix;
+  int event_ix;
+  int compare;
+} DpiEvent;
+
+// A log-scale histogram of durations, bucket n counts the samples which took between
+// 2^n and 2^(n+1) ns, with the last bucket also catching anything longer
+typedef struct Histogram {
+  char *name;
+  unsigned long long count;
+  unsigned long long total_ns;
+  unsigned long long buckets[HISTOGRAM_BUCKETS];
+} Histogram;
+
+// Instrumentation counters which are always maintained by the bridge, these are returned
+// to Origen via the 'u' opcode and also dumped to the debug log at the end of the simulation
+typedef struct Stats {
+  unsigned long long messages[128];    // Messages received, indexed by opcode
+  unsigned long long cycles;           // Cycles advanced, unlike cycle_count this is never reset by Origen
+  unsigned long long wave_callbacks;   // Wave event callbacks fired
+  unsigned long long clock_edges;      // Edges applied by free-running clocks, see 'G'
+  unsigned long long put_value_calls;
+  unsigned long long handle_by_name_calls;
+  Histogram client_get;                // Time blocked waiting for the next message from Origen
+  Histogram bridge;                    // Time spent processing each message
+  Histogram wave_callback;             // Time spent within each wave event callback
+  Histogram simulator;                 // Time between handing control back to the simulator and it calling
+                                       // back to the bridge, this includes the time spent in wave callbacks
+  uint64_t simulator_resumed_at;
+} Stats;
+
+static Stats stats = {
+  .client_get    = {.name = "client_get"},
+  .bridge        = {.name = "bridge"},
+  .wave_callback = {.name = "wave_callback"},
+  .simulator     = {.name = "simulator"}
+};
 static Miscompare miscompares[MAX_TRANSACTION_ERRORS];
 static int transaction_error_count = 0;
 static bool transaction_open = false;
@@ -75,6 +286,59 @@ static int max_errors = 100;
 static unsigned long long cycle_count = 0;
 static bool max_errors_exceeded = false;
 static bool max_errors_exceeded_during_transaction = false;
+static bool reply_trailers = false;
+static vpiHandle errors_handle = NULL;
+static vpiHandle match_errors_handle = NULL;
+static vpiHandle dump_enable_handle = NULL;
+static DumpWindow dump_windows[MAX_DUMP_WINDOWS];
+static int number_of_dump_windows = 0;
+static int current_dump_window = 0;
+static int dump_enabled = -1;
+static AnalogWave analog_waves[MAX_ANALOG_WAVES];
+static int number_of_analog_waves = 0;
+static AnalogMeasurement analog_measurements[MAX_ANALOG_MEASUREMENTS];
+static int number_of_analog_measurements = 0;
+static Clock clocks[MAX_NUMBER_PINS];     // Indexed by pin index
+static vpiHandle capture_nets[MAX_CAPTURE_NETS];
+static int number_of_capture_nets = 0;
+static bool capture_active = false;
+static bool capture_pending = false;  // Set when a cycle has been started whose values are still to be captured
+static CaptureRun * capture_runs = NULL;
+static int number_of_capture_runs = 0;
+static int capture_runs_capacity = 0;
+static NetGroup net_groups[MAX_NET_GROUPS];
+static Subscription subscriptions[MAX_SUBSCRIPTIONS];
+static SubscriptionEvent subscription_events[MAX_SUBSCRIPTION_EVENTS];
+static int number_of_subscription_events = 0;
+static bool subscription_events_overflowed = false;
+static bool profiling = false;
+static int profile_key = 0;
+static ProfileEntry * profile_entries = NULL;
+static int profile_entries_capacity = 0;
+static PendingMiscompare pending_miscompares[MAX_PENDING_MISCOMPARES];
+static int number_of_pending_miscompares = 0;
+static int dropped_miscompares = 0;
+#ifdef ORIGEN_DPI
+static char * dpi_pin_names[MAX_DPI_PINS];
+static int number_of_dpi_pins = 0;
+static int dpi_pin_state_words = 0;
+static uint32_t * dpi_data = NULL;
+static uint32_t * dpi_drive = NULL;
+static uint32_t * dpi_force0 = NULL;
+static uint32_t * dpi_force1 = NULL;
+static uint32_t * dpi_compare = NULL;
+static uint32_t * dpi_capture = NULL;
+static uint32_t * dpi_changed = NULL;   // The pins whose state has changed since it was last given to the testbench
+static DpiEvent * dpi_events = NULL;
+static int number_of_dpi_events = 0;
+static int dpi_events_capacity = 0;
+static int next_dpi_event = 0;
+static bool dpi_started = false;
+#endif
+static Message * current_message = NULL;  // The message being processed by bridge_wait_for_msg
+static unsigned long long * fail_cycles = NULL;
+static int number_of_fail_cycles = 0;
+static int fail_cycles_capacity = 0;
 
 static void set_period(char*);
 static void define_pin(char*, char*, char*, char*);
@@ -94,8 +358,74 @@ static void disable_compare_wave(Pin*);
 static void clear_waves_and_pins(void);
 static bool is_drive_whole_cycle(Pin*);
 static void origen_log(int, const char*, ...);
+static void reply(const char*, ...);
+static int get_debug_int(vpiHandle*, char*);
 static void end_simulation(void);
 static void on_max_errors_exceeded(void);
+static vpiHandle put_value(vpiHandle, p_vpi_value, p_vpi_time, PLI_INT32);
+static vpiHandle handle_by_name(PLI_BYTE8*, vpiHandle);
+static uint64_t now_ns(void);
+static void record_duration(Histogram*, uint64_t);
+static void simulator_resumed(void);
+static int stats_report(char**);
+static void log_stats(void);
+static void set_dump_enable(bool);
+static void update_dump_enable(void);
+static void record_fail_cycle(void);
+static uint64_t sim_time(void);
+static double sine(double);
+static AnalogWave * find_analog_wave(char*, bool);
+static void start_analog_wave(AnalogWave*, char, char*, char*);
+static void add_analog_wave_points(AnalogWave*, char*);
+static void stop_analog_wave(AnalogWave*);
+static double analog_wave_value(AnalogWave*, uint64_t);
+static void register_analog_wave_event(AnalogWave*, uint64_t);
+PLI_INT32 apply_analog_wave_cb(p_cb_data);
+static AnalogMeasurement * find_analog_measurement(char*, bool);
+static void start_analog_measurement(AnalogMeasurement*, char*, char*, char*);
+static void stop_analog_measurement(AnalogMeasurement*);
+static void sample_analog_measurement(AnalogMeasurement*, double);
+static void register_analog_measurement_event(AnalogMeasurement*);
+PLI_INT32 analog_measurement_interval_cb(p_cb_data);
+PLI_INT32 analog_measurement_value_change_cb(p_cb_data);
+static void count_error(void);
+static void add_capture_net(char*);
+static void sample_capture(void);
+static void send_capture(void);
+static NetGroup * find_net_group(char*);
+static void add_net_group_net(NetGroup*, char*);
+static void send_net_values(vpiHandle*, int);
+static bool find_memory(char*, Memory*);
+static char * map_file(char*, size_t*);
+static int hex_digit(char);
+static bool next_image_word(ImageReader*, Memory*, p_vpi_vecval, int*);
+static void load_memory(char*, char*, char*, char*);
+static void write_image_word(FILE*, Memory*, p_vpi_vecval, char);
+static void dump_memory(char*, char*, char*, char*, char*);
+static void compare_memory(char*, char*, char*, char*);
+static void subscribe(char*, char*);
+static void unsubscribe(int);
+static void record_subscription_event(int, char*);
+PLI_INT32 subscription_value_change_cb(p_cb_data);
+static char * subscription_events_trailer(void);
+static ProfileEntry * current_profile_entry(void);
+static void send_profile(void);
+static void on_miscompare(char*, int, int);
+static void process_pending_miscompares(void);
+static void set_pin_reg(Pin*, int, int);
+static int apply_wave_event(int, int, int);
+static void send_hello(void);
+static char * get_string(char*);
+static void append_details(char**, int*, int*, char*);
+static void start_clock(char*, char*, char*, char*);
+static void stop_clock(char*);
+static void set_clock_level(Pin*, int);
+static void register_clock_edge(int, int*, uint64_t);
+PLI_INT32 clock_edge_cb(p_cb_data);
+static char * next_arg(void);
+#ifdef ORIGEN_DPI
+static void set_dpi_bit(uint32_t*, int, int);
+#endif
 
 static void define_pin(char * name, char * pin_ix, char * drive_wave_ix, char * compare_wave_ix) {
   int index = atoi(pin_ix);
@@ -112,6 +442,20 @@ static void define_pin(char * name, char * pin_ix, char * drive_wave_ix, char *
   (*pin).drive_data = 0;
 
 
+#ifdef ORIGEN_DPI
+  // The pin driver registers are not accessed via VPI, they are set by the testbench's DPI loop
+  (*pin).present = false;
+  for (int i = 0; i < number_of_dpi_pins; i++) {
+    if (strcmp(dpi_pin_names[i], name) == 0) {
+      (*pin).dpi_index = i;
+      (*pin).present = true;
+      break;
+    }
+  }
+  if (!(*pin).present) {
+    origen_log(LOG_WARNING, "Your DUT defines pin '%s', however it is not present in the testbench and will be ignored", (*pin).name);
+  }
+#else
   char * driver = (char *) malloc(strlen(name) + ORIGEN_SIM_TB_NAME_LEN + 7); // testbench name + . + 'pins.' + '\0'
   strcpy(driver, ORIGEN_SIM_TESTBENCH_CAT("pins."));
   strcat(driver, name);
@@ -119,7 +463,7 @@ static void define_pin(char * name, char * pin_ix, char * drive_wave_ix, char *
   char * data = (char *) malloc(strlen(driver) + 6);
   strcpy(data, driver);
   strcat(data, ".data");
-  (*pin).data = vpi_handle_by_name(data, NULL);
+  (*pin).data = handle_by_name(data, NULL);
   free(data);
 
   if (!(*pin).data) {
@@ -132,28 +476,29 @@ static void define_pin(char * name, char * pin_ix, char * drive_wave_ix, char *
   char * drive = (char *) malloc(strlen(driver) + 7);
   strcpy(drive, driver);
   strcat(drive, ".drive");
-  (*pin).drive = vpi_handle_by_name(drive, NULL);
+  (*pin).drive = handle_by_name(drive, NULL);
   free(drive);
 
   char * force = (char *) malloc(strlen(driver) + 12);
   strcpy(force, driver);
   strcat(force, ".force_data");
-  (*pin).force_data = vpi_handle_by_name(force, NULL);
+  (*pin).force_data = handle_by_name(force, NULL);
   free(force);
 
   char * compare = (char *) malloc(strlen(driver) + 9);
   strcpy(compare, driver);
   strcat(compare, ".compare");
-  (*pin).compare = vpi_handle_by_name(compare, NULL);
+  (*pin).compare = handle_by_name(compare, NULL);
   free(compare);
 
   char * capture = (char *) malloc(strlen(driver) + 9);
   strcpy(capture, driver);
   strcat(capture, ".capture");
-  (*pin).capture = vpi_handle_by_name(capture, NULL);
+  (*pin).capture = handle_by_name(capture, NULL);
   free(capture);
 
   free(driver);
+#endif
 }
 
 
@@ -325,7 +670,6 @@ static bool is_drive_whole_cycle(Pin * pin) {
 /// Immediately drives the given pin to the given value
 static void drive_pin(char * index, char * val) {
   Pin *pin = &pins[atoi(index)];
-  s_vpi_value v = {vpiIntVal, {0}};
 
   if ((*pin).present) {
     // Store the pin drive data to be applied at the data edge
@@ -333,13 +677,11 @@ static void drive_pin(char * index, char * val) {
     
     // Apply the data value to the pin's driver
     if (is_drive_whole_cycle(pin)) {
-      v.value.integer = (*pin).drive_data;
-      vpi_put_value((*pin).data, &v, NULL, vpiNoDelay);
+      set_pin_reg(pin, PIN_DATA, (*pin).drive_data);
     }
     
     // Make sure not comparing
-    v.value.integer = 0;
-    vpi_put_value((*pin).compare, &v, NULL, vpiNoDelay);
+    set_pin_reg(pin, PIN_COMPARE, 0);
 
     // Register it as actively driving with it's wave
     
@@ -348,8 +690,7 @@ static void drive_pin(char * index, char * val) {
       // If the drive is for the whole cycle, then we can enable it here
       // and don't need a callback
       if (is_drive_whole_cycle(pin)) {
-        v.value.integer = 1;
-        vpi_put_value((*pin).drive, &v, NULL, vpiNoDelay);
+        set_pin_reg(pin, PIN_DRIVE, 1);
       } else {
         enable_drive_wave(pin);
       }
@@ -366,16 +707,13 @@ static void drive_pin(char * index, char * val) {
 /// Immediately sets the given pin to compare against the given value
 static void compare_pin(char * index, char * val) {
   Pin *pin = &pins[atoi(index)];
-  s_vpi_value v = {vpiIntVal, {0}};
 
   if ((*pin).present) {
     // Apply the data value to the pin's driver, don't enable compare yet,
     // the wave will do that later
-    v.value.integer = (val[0] - '0');
-    vpi_put_value((*pin).data, &v, NULL, vpiNoDelay);
+    set_pin_reg(pin, PIN_DATA, val[0] - '0');
     // Make sure not driving
-    v.value.integer = 0;
-    vpi_put_value((*pin).drive, &v, NULL, vpiNoDelay);
+    set_pin_reg(pin, PIN_DRIVE, 0);
 
     // Register it as actively comparing with it's wave
     
@@ -412,13 +750,11 @@ static void stop_capture_pin(char * index) {
 /// Immediately sets the given pin to don't compare
 static void dont_care_pin(char * index) {
   Pin *pin = &pins[atoi(index)];
-  s_vpi_value v = {vpiIntVal, {0}};
 
   if ((*pin).present) {
     // Disable drive and compare on the pin's driver
-    v.value.integer = 0;
-    vpi_put_value((*pin).drive, &v, NULL, vpiNoDelay);
-    vpi_put_value((*pin).compare, &v, NULL, vpiNoDelay);
+    set_pin_reg(pin, PIN_DRIVE, 0);
+    set_pin_reg(pin, PIN_COMPARE, 0);
 
     if ((*pin).previous_state != 0) {
       if ((*pin).previous_state == 1) {
@@ -435,23 +771,69 @@ static void dont_care_pin(char * index) {
 }
 
 
-/// Callback handler to implement the events registered by register_wave_event
-PLI_INT32 apply_wave_event_cb(p_cb_data data) {
+/// Sets the given register (PIN_DATA, PIN_DRIVE, etc.) of the given pin's driver. This is done via VPI
+/// unless the testbench is running the per-cycle loop via DPI, in which case the pin's bit in the
+/// corresponding state vector is updated and the testbench will apply it.
+static void set_pin_reg(Pin * pin, int reg, int value) {
+#ifdef ORIGEN_DPI
+  int ix = (*pin).dpi_index;
+
+  switch (reg) {
+    case PIN_DATA :
+      set_dpi_bit(dpi_data, ix, value);
+      break;
+    case PIN_DRIVE :
+      set_dpi_bit(dpi_drive, ix, value);
+      break;
+    case PIN_FORCE_DATA :
+      set_dpi_bit(dpi_force0, ix, value & 1);
+      set_dpi_bit(dpi_force1, ix, (value >> 1) & 1);
+      break;
+    case PIN_COMPARE :
+      set_dpi_bit(dpi_compare, ix, value);
+      break;
+    case PIN_CAPTURE :
+      set_dpi_bit(dpi_capture, ix, value);
+      break;
+  }
+  set_dpi_bit(dpi_changed, ix, 1);
+#else
   s_vpi_value v = {vpiIntVal, {0}};
-  s_vpi_value v2 = {vpiIntVal, {0}};
-  s_vpi_value v3 = {vpiIntVal, {0}};
+  vpiHandle handle;
 
-  int * wave_ix  = (int*)(&(data->user_data[0]));
-  int * event_ix = (int*)(&(data->user_data[sizeof(int)]));
-  int * compare  = (int*)(&(data->user_data[sizeof(int) * 2]));
+  switch (reg) {
+    case PIN_DATA :
+      handle = (*pin).data;
+      break;
+    case PIN_DRIVE :
+      handle = (*pin).drive;
+      break;
+    case PIN_FORCE_DATA :
+      handle = (*pin).force_data;
+      break;
+    case PIN_COMPARE :
+      handle = (*pin).compare;
+      break;
+    default :
+      handle = (*pin).capture;
+      break;
+  }
+  v.value.integer = value;
+  put_value(handle, &v, NULL, vpiNoDelay);
+#endif
+}
 
+
+/// Applies the given event of the given wave to all of its active pins, returns non-zero if the event
+/// is not valid
+static int apply_wave_event(int wave_ix, int event_ix, int compare) {
   Wave * wave;
 
-  if (*compare) {
-    wave = &compare_waves[*wave_ix];
+  if (compare) {
+    wave = &compare_waves[wave_ix];
 
     int d;
-    switch((*wave).events[*event_ix].data) {
+    switch((*wave).events[event_ix].data) {
       case 'C' :
         d = 1;
         break;
@@ -459,31 +841,30 @@ PLI_INT32 apply_wave_event_cb(p_cb_data data) {
         d = 0;
         break;
       default :
-        origen_log(LOG_ERROR, "Unknown compare event: %c", (*wave).events[*event_ix].data);
+        origen_log(LOG_ERROR, "Unknown compare event: %c", (*wave).events[event_ix].data);
         runtime_errors += 1;
         end_simulation();
         return 1;
     }
 
-    v.value.integer = d;
     for (int i = 0; i < (*wave).active_pin_count; i++) {
       if ((*(*wave).active_pins[i]).capture_en) {
-        vpi_put_value((*(*wave).active_pins[i]).capture, &v, NULL, vpiNoDelay);
+        set_pin_reg((*wave).active_pins[i], PIN_CAPTURE, d);
       } else {
-        vpi_put_value((*(*wave).active_pins[i]).compare, &v, NULL, vpiNoDelay);
+        set_pin_reg((*wave).active_pins[i], PIN_COMPARE, d);
       }
     }
 
 
   } else {
 
-    wave = &drive_waves[*wave_ix];
+    wave = &drive_waves[wave_ix];
 
-    //vpi_printf("[DEBUG] Apply drive wave %i, event %i, data %c\n", *wave_ix, *event_ix, (*wave).events[*event_ix].data);
+    //vpi_printf("[DEBUG] Apply drive wave %i, event %i, data %c\n", wave_ix, event_ix, (*wave).events[event_ix].data);
 
     int d;
     int on;
-    switch((*wave).events[*event_ix].data) {
+    switch((*wave).events[event_ix].data) {
       case '0' :
         d = 1;
         on = 1;
@@ -496,44 +877,76 @@ PLI_INT32 apply_wave_event_cb(p_cb_data data) {
         d = 0;
         on = 1;
         // Apply the data value to the pin's driver
-	for (int i = 0; i < (*wave).active_pin_count; i++) {
-          v3.value.integer = (*(*wave).active_pins[i]).drive_data;
-          vpi_put_value((*(*wave).active_pins[i]).data, &v3, NULL, vpiNoDelay);
-	}
+        for (int i = 0; i < (*wave).active_pin_count; i++) {
+          set_pin_reg((*wave).active_pins[i], PIN_DATA, (*(*wave).active_pins[i]).drive_data);
+        }
         break;
       case 'X' :
         d = 0;
         on = 0;
         break;
       default :
-        origen_log(LOG_ERROR, "Unknown drive event: %c\n", (*wave).events[*event_ix].data);
+        origen_log(LOG_ERROR, "Unknown drive event: %c\n", (*wave).events[event_ix].data);
         runtime_errors += 1;
         end_simulation();
         return 1;
     }
 
-    v.value.integer = d;
-    v2.value.integer = on;
     if (on) {
       for (int i = 0; i < (*wave).active_pin_count; i++) {
-        vpi_put_value((*(*wave).active_pins[i]).force_data, &v, NULL, vpiNoDelay);
-        vpi_put_value((*(*wave).active_pins[i]).drive, &v2, NULL, vpiNoDelay);
+        set_pin_reg((*wave).active_pins[i], PIN_FORCE_DATA, d);
+        set_pin_reg((*wave).active_pins[i], PIN_DRIVE, on);
       }
     } else {
       for (int i = 0; i < (*wave).active_pin_count; i++) {
-        vpi_put_value((*(*wave).active_pins[i]).drive, &v2, NULL, vpiNoDelay);
+        set_pin_reg((*wave).active_pins[i], PIN_DRIVE, on);
       }
     }
   }
+  return 0;
+}
+
+
+/// Callback handler to implement the events registered by register_wave_event
+PLI_INT32 apply_wave_event_cb(p_cb_data data) {
+  uint64_t t = now_ns();
+
+  int * wave_ix  = (int*)(&(data->user_data[0]));
+  int * event_ix = (int*)(&(data->user_data[sizeof(int)]));
+  int * compare  = (int*)(&(data->user_data[sizeof(int) * 2]));
+
+  if (apply_wave_event(*wave_ix, *event_ix, *compare)) {
+    return 1;
+  }
 
   free(data->user_data);
 
+  stats.wave_callbacks++;
+  record_duration(&stats.wave_callback, now_ns() - t);
   return 0;
 }
 
 
 /// Registers a callback to apply the given wave during this cycle
 static void register_wave_event(int wave_ix, int event_ix, int compare, uint64_t delay_in_simtime_units) {
+#ifdef ORIGEN_DPI
+  // Keep the events in time order, the order of events at the same time is the order in which they
+  // were registered, the same as for the equivalent callbacks
+  if (number_of_dpi_events == dpi_events_capacity) {
+    dpi_events_capacity = dpi_events_capacity ? dpi_events_capacity * 2 : 64;
+    dpi_events = (DpiEvent *) realloc(dpi_events, sizeof(DpiEvent) * dpi_events_capacity);
+  }
+  int i = number_of_dpi_events;
+  while (i > 0 && dpi_events[i - 1].time > delay_in_simtime_units) {
+    dpi_events[i] = dpi_events[i - 1];
+    i--;
+  }
+  dpi_events[i].time = delay_in_simtime_units;
+  dpi_events[i].wave_ix = wave_ix;
+  dpi_events[i].event_ix = event_ix;
+  dpi_events[i].compare = compare;
+  number_of_dpi_events++;
+#else
   s_cb_data call;
   s_vpi_time time;
 
@@ -561,16 +974,278 @@ static void register_wave_event(int wave_ix, int event_ix, int compare, uint64_t
   call.user_data = user_data;
 
   vpi_free_object(vpi_register_cb(&call));
+#endif
+}
+
+
+/// Starts a free-running clock on the given pin, all times are in simtime units. The pin stops following
+/// its waves and Origen's pin states until the clock is stopped.
+///
+/// If the phase is 'x' and the clock is already running, then its high and low times are changed
+/// from its next rising edge so that no short pulse is generated, otherwise the clock is (re)started
+/// low with its first rising edge after the given phase.
+static void start_clock(char * index, char * period, char * high, char * phase) {
+  int ix = atoi(index);
+  Pin * pin = &pins[ix];
+  Clock * clock = &clocks[ix];
+  uint64_t p = strtoull(period, NULL, 10);
+  uint64_t h = high ? strtoull(high, NULL, 10) : p / 2;
+
+  if (!(*pin).present) {
+    return;
+  }
+  if (p < 2) {
+    origen_log(LOG_ERROR, "The period of the clock on pin %s must be at least 2 simtime units, got %s", (*pin).name, period);
+    return;
+  }
+  if (h == 0) {
+    h = 1;
+  } else if (h >= p) {
+    h = p - 1;
+  }
+
+  if ((*clock).active && phase && *phase == 'x') {
+    (*clock).next_high = h;
+    (*clock).next_low = p - h;
+    return;
+  }
+
+#ifdef ORIGEN_DPI
+  if (!(*clock).force_data) {
+    char * net = (char *) malloc(strlen((*pin).name) + ORIGEN_SIM_TB_NAME_LEN + 18);
+    strcpy(net, ORIGEN_SIM_TESTBENCH_CAT("pins."));
+    strcat(net, (*pin).name);
+    strcat(net, ".force_data");
+    (*clock).force_data = handle_by_name(net, NULL);
+    free(net);
+    if (!(*clock).force_data) {
+      origen_log(LOG_ERROR, "Could not find the force_data register of pin %s to generate a clock on it", (*pin).name);
+      return;
+    }
+  }
+#endif
+
+  // Take the pin out of its waves and then drive it from the force_data register, this leaves the
+  // drive data alone and the forced level can't be disturbed by anything else
+  dont_care_pin(index);
+  set_pin_reg(pin, PIN_DRIVE, 1);
+  (*clock).generation++;
+  (*clock).active = true;
+  (*clock).high = h;
+  (*clock).low = p - h;
+  (*clock).next_high = 0;
+  (*clock).level = 0;
+  set_clock_level(pin, 0);
+
+  // This is passed on from edge to edge, it will get freed by the first callback after the clock
+  // is stopped or restarted
+  int * user_data = (int *) malloc(sizeof(int) * 2);
+  user_data[0] = ix;
+  register_clock_edge((*clock).generation, user_data, phase && *phase != 'x' ? strtoull(phase, NULL, 10) : 0);
+}
+
+
+/// Stops the clock on the given pin, the pin will continue to drive its current level until Origen
+/// next updates it
+static void stop_clock(char * index) {
+  int ix = atoi(index);
+  Pin * pin = &pins[ix];
+  Clock * clock = &clocks[ix];
+
+  if ((*clock).active) {
+    (*clock).active = false;
+    (*clock).generation++;
+    (*pin).drive_data = (*clock).level;
+    set_pin_reg(pin, PIN_DATA, (*clock).level);
+    set_pin_reg(pin, PIN_FORCE_DATA, 0);
+  }
+}
+
+
+/// Drives the given level on a pin which is generating a clock
+static void set_clock_level(Pin * pin, int level) {
+#ifdef ORIGEN_DPI
+  s_vpi_value v = {vpiIntVal, {0}};
+  int ix = (*pin).dpi_index;
+
+  // The DPI loop only applies the pin states at the start of each cycle and at its wave events, so
+  // the edges are applied directly via VPI. The loop's copy of the state is kept up to date without
+  // marking it as changed, so that the loop will not undo an edge if it does update the pin.
+  set_dpi_bit(dpi_force0, ix, !level);
+  set_dpi_bit(dpi_force1, ix, level);
+  v.value.integer = level ? 2 : 1;
+  put_value(clocks[(*pin).index].force_data, &v, NULL, vpiNoDelay);
+#else
+  set_pin_reg(pin, PIN_FORCE_DATA, level ? 2 : 1);
+#endif
+}
+
+
+/// Registers a callback to apply the next edge of a clock after the given delay, the user data holds
+/// the pin index and is passed on from edge to edge
+static void register_clock_edge(int generation, int * user_data, uint64_t delay_in_simtime_units) {
+  s_cb_data call;
+  s_vpi_time time;
+
+  user_data[1] = generation;
+
+  time.type = vpiSimTime;
+  time.high = (uint32_t)(delay_in_simtime_units >> 32);
+  time.low  = (uint32_t)(delay_in_simtime_units);
+
+  call.reason    = cbAfterDelay;
+  call.cb_rtn    = clock_edge_cb;
+  call.obj       = 0;
+  call.time      = &time;
+  call.value     = 0;
+  call.user_data = (char *) user_data;
+
+  vpi_free_object(vpi_register_cb(&call));
+}
+
+
+/// Callback handler to apply the next edge of a clock and schedule the one after it
+PLI_INT32 clock_edge_cb(p_cb_data data) {
+  int * user_data = (int *)(data->user_data);
+  Clock * clock = &clocks[user_data[0]];
+
+  // Ignore if the clock has been stopped or restarted since this was scheduled
+  if (!(*clock).active || (*clock).generation != user_data[1]) {
+    free(user_data);
+    return 0;
+  }
+
+  (*clock).level = !(*clock).level;
+  if ((*clock).level && (*clock).next_high) {
+    (*clock).high = (*clock).next_high;
+    (*clock).low = (*clock).next_low;
+    (*clock).next_high = 0;
+  }
+  set_clock_level(&pins[user_data[0]], (*clock).level);
+  stats.clock_edges++;
+  register_clock_edge((*clock).generation, user_data, (*clock).level ? (*clock).high : (*clock).low);
+  return 0;
 }
 
 
 /// Entry point to the bridge_wait_for_msg loop
 PLI_INT32 bridge_init() {
-  client_put("READY!\n");
+  send_hello();
   return bridge_wait_for_msg(NULL);
 }
 
 
+/// Sends the hello message which tells Origen that the bridge is ready, it also describes the snapshot
+/// and the bridge so that Origen does not have to query these details one at a time at the start of
+/// every simulation:
+///
+///   READY!^version^timescale^real_enabled^real_type^pin_count^features^snapshot_details^user_details
+///
+///   READY!^0.21.0^-15^0^^32^trailers,bulk_peek,...^ORIGEN_SIM_VERSION=0.21.0,...^
+///
+/// The pin count is -1 if the snapshot does not provide it, the features are the optional protocol
+/// features which are supported by this bridge, and the details are comma-separated NAME=VALUE pairs.
+static void send_hello() {
+  s_vpi_value v = {vpiIntVal, {0}};
+  vpiHandle handle;
+  int real_enabled = 0;
+  int pin_count = -1;
+  char * real_type;
+  char * buf;
+  int pos = 0;
+  int size = 16384;
+
+  handle = handle_by_name(ORIGEN_SIM_TESTBENCH_CAT(ORIGEN_SIM_DEBUG_MODULE_CAT("real_enabled")), NULL);
+  if (handle) {
+    vpi_get_value(handle, &v);
+    real_enabled = v.value.integer;
+  }
+  handle = handle_by_name(ORIGEN_SIM_TESTBENCH_CAT(ORIGEN_SIM_DEBUG_MODULE_CAT("pin_count")), NULL);
+  if (handle) {
+    vpi_get_value(handle, &v);
+    pin_count = v.value.integer;
+  }
+  real_type = real_enabled ? get_string(ORIGEN_SIM_TESTBENCH_CAT(ORIGEN_SIM_DEBUG_MODULE_CAT("real_type"))) : NULL;
+
+  buf = (char *) malloc(size);
+  pos += snprintf(&buf[pos], size - pos, "READY!^%s^%d^%d^%s^%d^%s^", ORIGEN_SIM_VERSION,
+                  vpi_get(vpiTimeUnit, 0), real_enabled, real_type ? real_type : "", pin_count, BRIDGE_FEATURES);
+  free(real_type);
+  append_details(&buf, &pos, &size, ORIGEN_SIM_TESTBENCH_CAT(ORIGEN_SIM_DEBUG_MODULE_CAT("snapshot_details")));
+  buf[pos++] = '^';
+  append_details(&buf, &pos, &size, ORIGEN_SIM_TESTBENCH_CAT(ORIGEN_SIM_DEBUG_MODULE_CAT("snapshot_details.user_details")));
+  buf[pos++] = '\n';
+  buf[pos] = '\0';
+  client_put(buf);
+  free(buf);
+}
+
+
+/// Returns a copy of the string value of the given net or parameter, or NULL if it does not exist.
+/// The caller is responsible for freeing it.
+static char * get_string(char * name) {
+  s_vpi_value v = {vpiStringVal, {0}};
+  vpiHandle handle = handle_by_name(name, NULL);
+
+  if (handle == NULL) {
+    return NULL;
+  }
+  vpi_get_value(handle, &v);
+  // Verilog strings are right-aligned within their reg, so skip any leading padding
+  return strdup(v.value.str ? v.value.str + strspn(v.value.str, " ") : "");
+}
+
+
+/// Appends the details held by the given snapshot details module to the hello message in buf as a
+/// comma-separated list of NAME=VALUE pairs, the names of the available details are given by the
+/// module's _AVAILABLE_DETAILS_ parameter. Any characters within the values which would break the
+/// message format are percent-encoded.
+static void append_details(char ** buf, int * pos, int * size, char * module) {
+  char name[1024];
+  char * names;
+  char * detail;
+  char * value;
+  char * saveptr;
+  bool first = true;
+
+  snprintf(name, sizeof(name), "%s._AVAILABLE_DETAILS_", module);
+  names = get_string(name);
+  if (names == NULL) {
+    return;
+  }
+
+  detail = strtok_r(names, ",", &saveptr);
+  while (detail != NULL) {
+    snprintf(name, sizeof(name), "%s.%s", module, detail);
+    value = get_string(name);
+    if (value) {
+      // Worst case every character of the value is encoded, plus some room for the separators
+      int needed = strlen(detail) + (strlen(value) * 3) + 8;
+
+      if (*pos + needed > *size) {
+        *size = (*pos + needed) * 2;
+        *buf = (char *) realloc(*buf, *size);
+      }
+      if (!first) {
+        (*buf)[(*pos)++] = ',';
+      }
+      *pos += sprintf(&(*buf)[*pos], "%s=", detail);
+      for (char * c = value; *c; c++) {
+        if (strchr("^,=%\r\n", *c)) {
+          *pos += sprintf(&(*buf)[*pos], "%%%02X", (unsigned char) *c);
+        } else {
+          (*buf)[(*pos)++] = *c;
+        }
+      }
+      first = false;
+      free(value);
+    }
+    detail = strtok_r(NULL, ",", &saveptr);
+  }
+  free(names);
+}
+
+
 /// Send output to the Origen log, this will be automatically timestamped to the simulation and
 /// sprintf type arguments can be supplied when calling:
 ///
@@ -593,143 +1268,1491 @@ static void origen_log(int type, const char * fmt, ...) {
 };
 
 
-/// Waits and responds to instructions from Origen (to set pin states).
-/// When Origen requests a cycle, time will be advanced and this func will be called again.
-PLI_INT32 bridge_wait_for_msg(p_cb_data data) {
-  UNUSED(data);
-  int max_msg_len = 1024;
-  char msg[max_msg_len];
-  char comment[128];
-  int err;
-  int timescale;
-  int type;
-  char *opcode, *arg1, *arg2, *arg3, *arg4;
-  vpiHandle handle;
-  s_vpi_value v;
+/// Returns the current integer value of the given net within the debug module, the handle
+/// will be looked up the first time and then cached in the given handle pointer
+static int get_debug_int(vpiHandle * handle, char * name) {
+  s_vpi_value v = {vpiIntVal, {0}};
 
-  while(1) {
+  if (*handle == NULL) {
+    *handle = handle_by_name(name, NULL);
+    if (*handle == NULL) {
+      return 0;
+    }
+  }
+  vpi_get_value(*handle, &v);
+  return v.value.integer;
+}
 
-    err = client_get(max_msg_len, msg);
-    if (err) {
-      // Don't send to the Origen log since Origen may not be there
-      vpi_printf("ERROR: Failed to receive from Origen!\n");
-      end_simulation();
-      return 1;
+
+/// Wrapper for vpi_put_value which keeps count of the number of calls
+static vpiHandle put_value(vpiHandle object, p_vpi_value value, p_vpi_time time, PLI_INT32 flags) {
+  stats.put_value_calls++;
+  return vpi_put_value(object, value, time, flags);
+}
+
+
+/// Wrapper for vpi_handle_by_name which keeps count of the number of calls
+static vpiHandle handle_by_name(PLI_BYTE8 * name, vpiHandle scope) {
+  stats.handle_by_name_calls++;
+  return vpi_handle_by_name(name, scope);
+}
+
+
+/// Returns the next argument of the message currently being processed, or NULL if there are no more
+static char * next_arg() {
+  return client_next_arg(current_message);
+}
+
+
+/// Returns a monotonic wall clock timestamp in ns, used to time the bridge
+static uint64_t now_ns() {
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+
+/// Adds the given duration to the given histogram
+static void record_duration(Histogram * histogram, uint64_t duration_ns) {
+  int bucket = 0;
+
+  if (duration_ns) {
+    bucket = 63 - __builtin_clzll(duration_ns);
+    if (bucket >= HISTOGRAM_BUCKETS) {
+      bucket = HISTOGRAM_BUCKETS - 1;
     }
-    if (runtime_errors) {
-      end_simulation();
-      return 1;
+  }
+  (*histogram).count++;
+  (*histogram).total_ns += duration_ns;
+  (*histogram).buckets[bucket]++;
+}
+
+
+/// Should be called whenever the bridge is about to hand control back to the simulator,
+/// the time until the simulator next calls the bridge will then be recorded
+static void simulator_resumed() {
+  stats.simulator_resumed_at = now_ns();
+}
+
+
+/// Generates a report of the bridge's instrumentation counters, returning the number of lines
+/// in it. The lines are written to a newly allocated buffer, each terminated by a newline, and
+/// it is the caller's responsibility to free it:
+///
+///    messages,2,10534                 - Messages received, by opcode
+///    counter,cycles,20012             - Other counters, by name
+///    histogram,bridge,20544,10230442,0_0_0_0_0_0_12_1049_...
+///                                     - Timing histograms, by name: the number of samples, the
+///                                       total time in ns, then the bucket counts where bucket n
+///                                       holds the samples that took 2^n to 2^(n+1) ns
+static int stats_report(char ** report) {
+  Histogram * histograms[] = { &stats.client_get, &stats.bridge, &stats.wave_callback, &stats.simulator };
+  char * buf = (char *) malloc(16384);
+  int pos = 0;
+  int lines = 0;
+
+  for (int i = 0; i < 128; i++) {
+    if (stats.messages[i]) {
+      pos += sprintf(&buf[pos], "messages,%c,%llu\n", i, stats.messages[i]);
+      lines++;
     }
+  }
 
-    if (log_messages) {
-      vpi_printf("[MESSAGE] %s\n", msg);
+  pos += sprintf(&buf[pos], "counter,cycles,%llu\n", stats.cycles);
+  pos += sprintf(&buf[pos], "counter,wave_callbacks,%llu\n", stats.wave_callbacks);
+  pos += sprintf(&buf[pos], "counter,clock_edges,%llu\n", stats.clock_edges);
+  pos += sprintf(&buf[pos], "counter,put_value,%llu\n", stats.put_value_calls);
+  pos += sprintf(&buf[pos], "counter,handle_by_name,%llu\n", stats.handle_by_name_calls);
+  lines += 5;
+
+  for (int i = 0; i < 4; i++) {
+    Histogram * h = histograms[i];
+    int last = 0;
+
+    for (int j = 0; j < HISTOGRAM_BUCKETS; j++) {
+      if ((*h).buckets[j]) {
+        last = j;
+      }
+    }
+    pos += sprintf(&buf[pos], "histogram,%s,%llu,%llu,", (*h).name, (*h).count, (*h).total_ns);
+    for (int j = 0; j <= last; j++) {
+      pos += sprintf(&buf[pos], j ? "_%llu" : "%llu", (*h).buckets[j]);
     }
+    pos += sprintf(&buf[pos], "\n");
+    lines++;
+  }
 
-    // Keep a copy of the original message, helpful for debugging
-    char* orig_msg = calloc(strlen(msg)+1, sizeof(char));
-    strcpy(orig_msg, msg);
+  *report = buf;
+  return lines;
+}
 
-    opcode = strtok(msg, "^");
 
-    if (!max_errors_exceeded || (max_errors_exceeded && (
-      // When max_errors_exceeded, only continue to process the following opcodes.
-      // These are the ones required to enable a controlled shutdown driven by the main Origen process
-      // and also any that return data to Origen so that the main process does not get blocked:
-      //     Sync-up           End Simulation    Peek              Flush               Log
-            *opcode == '7' || *opcode == '8' || *opcode == '9' || *opcode == 'j' || *opcode == 'k' ||
-      //     Get version      Get timescale     Read reg trans   Get cycle count
-            *opcode == 'i' || *opcode == 'l' || *opcode == 'n' || *opcode == 'o'
-      ))) {
-      switch(*opcode) {
-        // Define pin
-        //   0^pin_name^pin_index^drive_wave_ix^capture_wave_ix
-        //
-        //   0 for the wave indexes means the default, custom waves
-        //   must therefore start from index 1
-        //
-        //   The pin index must be uniquely assigned to the pin by the caller
-        //   and must be less than MAX_NUMBER_PINS
-        //
-        //   0^tdi^12^0^0  
-        case '0' :
-          arg1 = strtok(NULL, "^");
-          arg2 = strtok(NULL, "^");
-          arg3 = strtok(NULL, "^");
-          arg4 = strtok(NULL, "^");
-          //DEBUG("Define Pin: %s, %s, %s, %s\n", arg1, arg2, arg3, arg4);
-          define_pin(arg1, arg2, arg3, arg4);
-          break;
-        // Set Period
-        //   1^100000
-        case '1' :
-          arg1 = strtok(NULL, "^");
-          set_period(arg1);
-          break;
-        // Drive Pin
-        //   2^pin_index^data
-        //
-        //   2^12^0
-        //   2^12^1
-        case '2' :
-          arg1 = strtok(NULL, "^");
-          arg2 = strtok(NULL, "^");
-          //DEBUG("Drive Pin: %s, %s\n", arg1, arg2);
-          drive_pin(arg1, arg2);
-          break;
-        // Cycle
-        //   3^number_of_cycles
-        //
-        //   3^1
-        //   3^65535
-        case '3' :
-          arg1 = strtok(NULL, "^");
-          repeat = strtol(arg1, NULL, 10);
-          if (repeat) {
-            repeat = repeat - 1;
-          }
-          cycle();
-          return 0;
-        // Compare Pin
-        //   4^pin_index^data
-        //
-        //   4^14^0
-        //   4^14^1
-        case '4' :
-          arg1 = strtok(NULL, "^");
-          arg2 = strtok(NULL, "^");
-          compare_pin(arg1, arg2);
-          break;
-        // Don't Care Pin
-        //   5^pin_index
-        //
-        //   5^14
-        case '5' :
-          arg1 = strtok(NULL, "^");
-          dont_care_pin(arg1);
-          break;
-        // Define wave
-        //   6^wave_index^compare^events
-        //
-        //   0 for the wave indexes means the default, custom waves
-        //   must therefore start from index 1
-        //
-        //   0 for the compare parameter means it is a drive wave, 1 means it is
-        //   for when the pin is in compare mode
-        //
-        //   Some example events are shown below:
-        //
-        //   6^1^0^0_D_25_0_50_D_75_0  // Drive at 0ns, off at 25ns, drive at 50ns, off at 75ns
-        case '6' :
-          arg1 = strtok(NULL, "^");
-          arg2 = strtok(NULL, "^");
-          arg3 = strtok(NULL, "^");
-          //DEBUG("Define Wave: %s, %s, %s\n", arg1, arg2, arg3);
-          define_wave(arg1, arg2, arg3);
-          break;
-        // Sync-up
-        //   7^
-        case '7' :
-          client_put("OK!\n");
+/// Dumps the bridge's instrumentation counters to the Origen debug log
+static void log_stats() {
+  char * report;
+  char * line;
+  char * eol;
+
+  stats_report(&report);
+  line = report;
+  while ((eol = strchr(line, '\n')) != NULL) {
+    *eol = '\0';
+    origen_log(LOG_DEBUG, "[BRIDGE STATS] %s", line);
+    line = eol + 1;
+  }
+  free(report);
+}
+
+
+/// Switches wave dumping on or off by setting the testbench's dump_enable reg, does nothing
+/// if it is already in the requested state or if the testbench does not support it
+static void set_dump_enable(bool enable) {
+  s_vpi_value v = {vpiIntVal, {0}};
+
+  if (dump_enabled == enable) {
+    return;
+  }
+  if (dump_enable_handle == NULL) {
+    dump_enable_handle = handle_by_name(ORIGEN_SIM_TESTBENCH_CAT(ORIGEN_SIM_DEBUG_MODULE_CAT("dump_enable")), NULL);
+    if (dump_enable_handle == NULL) {
+      return;
+    }
+  }
+  v.value.integer = enable;
+  put_value(dump_enable_handle, &v, NULL, vpiNoDelay);
+  dump_enabled = enable;
+}
+
+
+/// Called every cycle when dump windows have been defined, enables dumping only when the current
+/// cycle is within a window. The windows are given in order by Origen so only the current one
+/// needs to be checked.
+static void update_dump_enable() {
+  while (current_dump_window < number_of_dump_windows &&
+         cycle_count > dump_windows[current_dump_window].end) {
+    current_dump_window++;
+  }
+  set_dump_enable(current_dump_window < number_of_dump_windows &&
+                  cycle_count >= dump_windows[current_dump_window].start);
+}
+
+
+/// Records the current cycle as having failed, consecutive fails in the same cycle are only
+/// recorded once
+static void record_fail_cycle() {
+  if (number_of_fail_cycles && fail_cycles[number_of_fail_cycles - 1] == cycle_count) {
+    return;
+  }
+  if (number_of_fail_cycles == fail_cycles_capacity) {
+    fail_cycles_capacity = fail_cycles_capacity ? fail_cycles_capacity * 2 : 64;
+    fail_cycles = (unsigned long long *) realloc(fail_cycles, fail_cycles_capacity * sizeof(unsigned long long));
+  }
+  fail_cycles[number_of_fail_cycles++] = cycle_count;
+}
+
+
+/// Returns the current simulation time
+static uint64_t sim_time() {
+  s_vpi_time now;
+
+  now.type = vpiSimTime;
+  vpi_get_time(0, &now);
+  return ((uint64_t)now.high << 32) | now.low;
+}
+
+
+/// Returns sin(x), implemented here rather than linking to libm since the VPI extension is
+/// built in many different ways by the various simulators
+static double sine(double x) {
+  double x2, term, sum;
+
+  // Reduce to -PI..PI
+  x = x - (2 * PI) * (long long)(x / (2 * PI));
+  if (x > PI) {
+    x -= 2 * PI;
+  } else if (x < -PI) {
+    x += 2 * PI;
+  }
+  // Then to -PI/2..PI/2 using sin(x) = sin(PI - x)
+  if (x > PI / 2) {
+    x = PI - x;
+  } else if (x < -PI / 2) {
+    x = -PI - x;
+  }
+  x2 = x * x;
+  term = x;
+  sum = x;
+  for (int i = 1; i < 8; i++) {
+    term = -term * x2 / ((2 * i) * (2 * i + 1));
+    sum += term;
+  }
+  return sum;
+}
+
+
+/// Returns the analog wave for the given pin driver, creating a new one if create is true
+static AnalogWave * find_analog_wave(char * net, bool create) {
+  AnalogWave * wave;
+  char * drive;
+
+  for (int i = 0; i < number_of_analog_waves; i++) {
+    if (strcmp(analog_waves[i].net, net) == 0) {
+      return &analog_waves[i];
+    }
+  }
+  if (!create) {
+    return NULL;
+  }
+  if (number_of_analog_waves == MAX_ANALOG_WAVES) {
+    origen_log(LOG_ERROR, "The maximum number of analog waveforms (%d) has been exceeded", MAX_ANALOG_WAVES);
+    return NULL;
+  }
+
+  drive = (char *) malloc(strlen(net) + 7);
+  strcpy(drive, net);
+  strcat(drive, ".drive");
+
+  wave = &analog_waves[number_of_analog_waves];
+  (*wave).drive = handle_by_name(drive, NULL);
+  free(drive);
+  if (!(*wave).drive) {
+    origen_log(LOG_ERROR, "Could not find an analog pin driver named '%s'", net);
+    return NULL;
+  }
+  (*wave).net = malloc(strlen(net) + 1);
+  strcpy((*wave).net, net);
+  (*wave).active = false;
+  (*wave).generation = 0;
+  (*wave).number_of_points = 0;
+  (*wave).points_capacity = 0;
+  (*wave).point_times = NULL;
+  (*wave).point_values = NULL;
+  number_of_analog_waves++;
+  return wave;
+}
+
+
+/// Starts applying the given waveform, replacing any existing one on the same pin driver.
+/// For a piecewise-linear wave, params is a list of time/value points: 0_0.0_10000_1.8
+/// For a sine wave, params is offset_amplitude_period_duration: 0.9_0.9_10000_0
+static void start_analog_wave(AnalogWave * wave, char type, char * step, char * params) {
+  s_vpi_value v = {vpiIntVal, {0}};
+  char * en;
+  char * saveptr;
+  char * fields[4];
+  const char * field_names[4] = {"offset", "amplitude", "period", "duration"};
+  vpiHandle handle;
+
+  if (!step || !params) {
+    origen_log(LOG_ERROR, "The analog waveform for %s is missing its %s", (*wave).net, step ? "parameters" : "step");
+    return;
+  }
+  // Check that a sine wave has all of its parameters before replacing the existing wave
+  if (type == 's') {
+    fields[0] = strtok_r(params, "_", &saveptr);
+    for (int i = 0; i < 4; i++) {
+      if (i > 0) {
+        fields[i] = strtok_r(NULL, "_", &saveptr);
+      }
+      if (!fields[i]) {
+        origen_log(LOG_ERROR, "The sine wave for %s is missing its %s", (*wave).net, field_names[i]);
+        return;
+      }
+    }
+  }
+
+  stop_analog_wave(wave);
+  (*wave).type = type;
+  (*wave).step = strtoull(step, NULL, 10);
+  if ((*wave).step == 0) {
+    (*wave).step = 1;
+  }
+  (*wave).start = sim_time();
+  (*wave).number_of_points = 0;
+  (*wave).duration = 0;
+
+  if (type == 'p') {
+    add_analog_wave_points(wave, params);
+  } else {
+    (*wave).offset = strtod(fields[0], NULL);
+    (*wave).amplitude = strtod(fields[1], NULL);
+    (*wave).period = strtoull(fields[2], NULL, 10);
+    (*wave).duration = strtoull(fields[3], NULL, 10);
+  }
+
+  // Enable the pin driver
+  en = (char *) malloc(strlen((*wave).net) + 10);
+  strcpy(en, (*wave).net);
+  strcat(en, ".drive_en");
+  handle = handle_by_name(en, NULL);
+  free(en);
+  if (handle) {
+    v.value.integer = 1;
+    put_value(handle, &v, NULL, vpiNoDelay);
+  }
+
+  (*wave).active = true;
+  register_analog_wave_event(wave, 0);
+}
+
+
+/// Appends the given time/value points to a piecewise-linear wave, this allows waveforms
+/// with more points than will fit in a single message to be given
+static void add_analog_wave_points(AnalogWave * wave, char * points) {
+  char * token;
+  char * saveptr;
+
+  token = strtok_r(points, "_", &saveptr);
+  while (token != NULL) {
+    if ((*wave).number_of_points == (*wave).points_capacity) {
+      (*wave).points_capacity = (*wave).points_capacity ? (*wave).points_capacity * 2 : 16;
+      (*wave).point_times = (uint64_t *) realloc((*wave).point_times, (*wave).points_capacity * sizeof(uint64_t));
+      (*wave).point_values = (double *) realloc((*wave).point_values, (*wave).points_capacity * sizeof(double));
+    }
+    (*wave).point_times[(*wave).number_of_points] = strtoull(token, NULL, 10);
+    token = strtok_r(NULL, "_", &saveptr);
+    (*wave).point_values[(*wave).number_of_points] = token ? strtod(token, NULL) : 0.0;
+    (*wave).number_of_points++;
+    token = strtok_r(NULL, "_", &saveptr);
+  }
+  if ((*wave).number_of_points) {
+    (*wave).duration = (*wave).point_times[(*wave).number_of_points - 1];
+  }
+}
+
+
+/// Stops the given wave, the pin driver will hold its last value
+static void stop_analog_wave(AnalogWave * wave) {
+  if ((*wave).active) {
+    (*wave).active = false;
+    (*wave).generation++;
+  }
+}
+
+
+/// Returns the value of the given wave at the given time relative to its start
+static double analog_wave_value(AnalogWave * wave, uint64_t t) {
+  if ((*wave).type == 's') {
+    if ((*wave).period == 0) {
+      return (*wave).offset;
+    }
+    return (*wave).offset + (*wave).amplitude * sine(2 * PI * (double)(t % (*wave).period) / (*wave).period);
+  } else {
+    int n = (*wave).number_of_points;
+
+    if (n == 0) {
+      return 0.0;
+    }
+    if (t <= (*wave).point_times[0]) {
+      return (*wave).point_values[0];
+    }
+    for (int i = 1; i < n; i++) {
+      if (t <= (*wave).point_times[i]) {
+        uint64_t t0 = (*wave).point_times[i - 1];
+        uint64_t t1 = (*wave).point_times[i];
+        double v0 = (*wave).point_values[i - 1];
+        double v1 = (*wave).point_values[i];
+        return v0 + (v1 - v0) * (double)(t - t0) / (double)(t1 - t0);
+      }
+    }
+    return (*wave).point_values[n - 1];
+  }
+}
+
+
+/// Registers a callback to update the given analog wave after the given delay
+static void register_analog_wave_event(AnalogWave * wave, uint64_t delay_in_simtime_units) {
+  s_cb_data call;
+  s_vpi_time time;
+
+  // This will get freed by the callback
+  int * user_data = (int *) malloc(sizeof(int) * 2);
+  user_data[0] = (int)(wave - analog_waves);
+  user_data[1] = (*wave).generation;
+
+  time.type = vpiSimTime;
+  time.high = (uint32_t)(delay_in_simtime_units >> 32);
+  time.low  = (uint32_t)(delay_in_simtime_units);
+
+  call.reason    = cbAfterDelay;
+  call.cb_rtn    = apply_analog_wave_cb;
+  call.obj       = 0;
+  call.time      = &time;
+  call.value     = 0;
+  call.user_data = (char *) user_data;
+
+  vpi_free_object(vpi_register_cb(&call));
+}
+
+
+/// Callback handler to update the drive value of an analog wave and schedule the next update
+PLI_INT32 apply_analog_wave_cb(p_cb_data data) {
+  int * user_data = (int *)(data->user_data);
+  AnalogWave * wave = &analog_waves[user_data[0]];
+  s_vpi_value v = {vpiRealVal, {0}};
+  uint64_t t;
+
+  // Ignore if the wave has been stopped or replaced since this was scheduled
+  if ((*wave).active && (*wave).generation == user_data[1]) {
+    t = sim_time() - (*wave).start;
+    if ((*wave).duration && t >= (*wave).duration) {
+      t = (*wave).duration;
+    }
+    v.value.real = analog_wave_value(wave, t);
+    put_value((*wave).drive, &v, NULL, vpiNoDelay);
+
+    if ((*wave).duration && t >= (*wave).duration) {
+      (*wave).active = false;
+    } else if ((*wave).duration && t + (*wave).step > (*wave).duration) {
+      // Make sure that the final value is hit exactly
+      register_analog_wave_event(wave, (*wave).duration - t);
+    } else {
+      register_analog_wave_event(wave, (*wave).step);
+    }
+  }
+  free(user_data);
+  return 0;
+}
+
+
+/// Returns the analog measurement for the given net, creating a new one if create is true
+static AnalogMeasurement * find_analog_measurement(char * net, bool create) {
+  AnalogMeasurement * m;
+
+  for (int i = 0; i < number_of_analog_measurements; i++) {
+    if (strcmp(analog_measurements[i].net, net) == 0) {
+      return &analog_measurements[i];
+    }
+  }
+  if (!create) {
+    return NULL;
+  }
+  if (number_of_analog_measurements == MAX_ANALOG_MEASUREMENTS) {
+    origen_log(LOG_ERROR, "The maximum number of analog measurements (%d) has been exceeded", MAX_ANALOG_MEASUREMENTS);
+    return NULL;
+  }
+
+  m = &analog_measurements[number_of_analog_measurements];
+  (*m).handle = handle_by_name(net, NULL);
+  if (!(*m).handle) {
+    origen_log(LOG_ERROR, "Could not find a net named '%s' to measure", net);
+    return NULL;
+  }
+  (*m).net = malloc(strlen(net) + 1);
+  strcpy((*m).net, net);
+  (*m).active = false;
+  (*m).generation = 0;
+  (*m).value_change_cb = NULL;
+  number_of_analog_measurements++;
+  return m;
+}
+
+
+/// Starts a new measurement, discarding any previous results for the same net. A sample of
+/// the net's current value is always taken at the start.
+static void start_analog_measurement(AnalogMeasurement * m, char * interval, char * min, char * max) {
+  s_vpi_value v = {vpiRealVal, {0}};
+
+  stop_analog_measurement(m);
+  (*m).interval = strtoull(interval, NULL, 10);
+  (*m).has_min = min && *min != 'x';
+  (*m).has_max = max && *max != 'x';
+  (*m).min_limit = (*m).has_min ? strtod(min, NULL) : 0.0;
+  (*m).max_limit = (*m).has_max ? strtod(max, NULL) : 0.0;
+  (*m).failed = false;
+  (*m).count = 0;
+  (*m).sum = 0.0;
+  (*m).active = true;
+
+  vpi_get_value((*m).handle, &v);
+  sample_analog_measurement(m, v.value.real);
+
+  if ((*m).interval) {
+    register_analog_measurement_event(m);
+  } else {
+    s_cb_data call;
+    s_vpi_time time = {vpiSuppressTime, 0, 0, 0.0};
+    s_vpi_value value = {vpiRealVal, {0}};
+
+    call.reason    = cbValueChange;
+    call.cb_rtn    = analog_measurement_value_change_cb;
+    call.obj       = (*m).handle;
+    call.time      = &time;
+    call.value     = &value;
+    call.user_data = (char *) m;
+
+    (*m).value_change_cb = vpi_register_cb(&call);
+  }
+}
+
+
+static void stop_analog_measurement(AnalogMeasurement * m) {
+  if ((*m).active) {
+    (*m).active = false;
+    (*m).generation++;
+    if ((*m).value_change_cb) {
+      vpi_remove_cb((*m).value_change_cb);
+      (*m).value_change_cb = NULL;
+    }
+  }
+}
+
+
+static void sample_analog_measurement(AnalogMeasurement * m, double value) {
+  if ((*m).count == 0 || value < (*m).min) {
+    (*m).min = value;
+  }
+  if ((*m).count == 0 || value > (*m).max) {
+    (*m).max = value;
+  }
+  (*m).sum += value;
+  (*m).count++;
+
+  if (!(*m).failed && (((*m).has_min && value < (*m).min_limit) || ((*m).has_max && value > (*m).max_limit))) {
+    (*m).failed = true;
+    if ((*m).has_min && (*m).has_max) {
+      origen_log(LOG_ERROR, "Miscompare on %s, expected %g to %g received %g", (*m).net, (*m).min_limit, (*m).max_limit, value);
+    } else if ((*m).has_min) {
+      origen_log(LOG_ERROR, "Miscompare on %s, expected >= %g received %g", (*m).net, (*m).min_limit, value);
+    } else {
+      origen_log(LOG_ERROR, "Miscompare on %s, expected <= %g received %g", (*m).net, (*m).max_limit, value);
+    }
+    count_error();
+  }
+}
+
+
+/// Registers a callback to take the next sample of an interval measurement
+static void register_analog_measurement_event(AnalogMeasurement * m) {
+  s_cb_data call;
+  s_vpi_time time;
+
+  // This will get freed by the callback
+  int * user_data = (int *) malloc(sizeof(int) * 2);
+  user_data[0] = (int)(m - analog_measurements);
+  user_data[1] = (*m).generation;
+
+  time.type = vpiSimTime;
+  time.high = (uint32_t)((*m).interval >> 32);
+  time.low  = (uint32_t)((*m).interval);
+
+  call.reason    = cbAfterDelay;
+  call.cb_rtn    = analog_measurement_interval_cb;
+  call.obj       = 0;
+  call.time      = &time;
+  call.value     = 0;
+  call.user_data = (char *) user_data;
+
+  vpi_free_object(vpi_register_cb(&call));
+}
+
+
+PLI_INT32 analog_measurement_interval_cb(p_cb_data data) {
+  int * user_data = (int *)(data->user_data);
+  AnalogMeasurement * m = &analog_measurements[user_data[0]];
+  s_vpi_value v = {vpiRealVal, {0}};
+
+  // Ignore if the measurement has been stopped or restarted since this was scheduled
+  if ((*m).active && (*m).generation == user_data[1]) {
+    vpi_get_value((*m).handle, &v);
+    sample_analog_measurement(m, v.value.real);
+    register_analog_measurement_event(m);
+  }
+  free(user_data);
+  return 0;
+}
+
+
+PLI_INT32 analog_measurement_value_change_cb(p_cb_data data) {
+  AnalogMeasurement * m = (AnalogMeasurement *)(data->user_data);
+
+  if ((*m).active) {
+    sample_analog_measurement(m, data->value->value.real);
+  }
+  return 0;
+}
+
+
+/// Adds the given net to those which will be captured on every cycle by the next bulk capture,
+/// a net which does not exist will be captured as FAIL
+static void add_capture_net(char * net) {
+  if (number_of_capture_nets == MAX_CAPTURE_NETS) {
+    origen_log(LOG_ERROR, "Too many nets added to the bulk capture, the maximum is %d", MAX_CAPTURE_NETS);
+    return;
+  }
+  capture_nets[number_of_capture_nets++] = handle_by_name(net, NULL);
+}
+
+
+/// Records the current values of the captured nets for the cycle which has just completed,
+/// extending the last run if they are unchanged from the previous cycle
+static void sample_capture() {
+  s_vpi_value v;
+  char * values;
+  char * val;
+  size_t len = 0;
+  size_t capacity = 256;
+
+  capture_pending = false;
+  values = (char *) malloc(capacity);
+  values[0] = '\0';
+
+  for (int i = 0; i < number_of_capture_nets; i++) {
+    if (capture_nets[i]) {
+      v.format = vpiBinStrVal;
+      vpi_get_value(capture_nets[i], &v);
+      val = v.value.str;
+    } else {
+      val = "FAIL";
+    }
+    while (len + strlen(val) + 2 > capacity) {
+      capacity *= 2;
+      values = (char *) realloc(values, capacity);
+    }
+    if (i) {
+      values[len++] = ',';
+    }
+    strcpy(values + len, val);
+    len += strlen(val);
+  }
+
+  if (number_of_capture_runs && strcmp(capture_runs[number_of_capture_runs - 1].values, values) == 0) {
+    capture_runs[number_of_capture_runs - 1].cycles++;
+    free(values);
+  } else {
+    if (number_of_capture_runs == capture_runs_capacity) {
+      capture_runs_capacity = capture_runs_capacity ? capture_runs_capacity * 2 : 64;
+      capture_runs = (CaptureRun *) realloc(capture_runs, capture_runs_capacity * sizeof(CaptureRun));
+    }
+    capture_runs[number_of_capture_runs].values = values;
+    capture_runs[number_of_capture_runs].cycles = 1;
+    number_of_capture_runs++;
+  }
+}
+
+
+/// Sends the runs recorded by the bulk capture to Origen and then clears it, the number of runs
+/// is sent first, followed by one line per run: cycles,value1,value2,...
+static void send_capture() {
+  char * line;
+
+  reply("%d", number_of_capture_runs);
+  for (int i = 0; i < number_of_capture_runs; i++) {
+    line = (char *) malloc(strlen(capture_runs[i].values) + 24);
+    sprintf(line, "%llu,%s\n", capture_runs[i].cycles, capture_runs[i].values);
+    client_put(line);
+    free(line);
+    free(capture_runs[i].values);
+  }
+  number_of_capture_runs = 0;
+  number_of_capture_nets = 0;
+  capture_active = false;
+  capture_pending = false;
+}
+
+
+/// Returns the net group with the given ID, or NULL if the ID is not valid
+static NetGroup * find_net_group(char * id) {
+  int i = strtol(id, NULL, 10);
+
+  if (i < 0 || i >= MAX_NET_GROUPS) {
+    origen_log(LOG_ERROR, "Illegal net group ID %s, the maximum is %d", id, MAX_NET_GROUPS - 1);
+    return NULL;
+  }
+  return &net_groups[i];
+}
+
+
+static void add_net_group_net(NetGroup * group, char * net) {
+  if ((*group).number_of_nets == (*group).capacity) {
+    (*group).capacity = (*group).capacity ? (*group).capacity * 2 : 16;
+    (*group).nets = (vpiHandle *) realloc((*group).nets, (*group).capacity * sizeof(vpiHandle));
+  }
+  (*group).nets[(*group).number_of_nets++] = handle_by_name(net, NULL);
+}
+
+
+/// Sends the current values of the given nets to Origen, the number of nets is sent first followed
+/// by a line for each value in one of these formats:
+///
+///   v,size,aval0,bval0,aval1,bval1...  - A vector, the words are in hex and least significant first
+///   r,1.25                             - A real
+///   s,some text                        - A string
+///   F                                  - The net does not exist
+static void send_net_values(vpiHandle * nets, int number_of_nets) {
+  s_vpi_value v;
+  char * line;
+  int size;
+  int words;
+  int type;
+  int len;
+
+  reply("%d", number_of_nets);
+  for (int i = 0; i < number_of_nets; i++) {
+    if (!nets[i]) {
+      client_put("F\n");
+      continue;
+    }
+    type = vpi_get(vpiType, nets[i]);
+    if (type == vpiStringVar) {
+      v.format = vpiStringVal;
+      vpi_get_value(nets[i], &v);
+      line = (char *) malloc(strlen(v.value.str) + 4);
+      sprintf(line, "s,%s\n", v.value.str);
+    } else if (type == vpiRealVar) {
+      v.format = vpiRealVal;
+      vpi_get_value(nets[i], &v);
+      line = (char *) malloc(32);
+      sprintf(line, "r,%.15g\n", v.value.real);
+    } else {
+      size = vpi_get(vpiSize, nets[i]);
+      words = (size + 31) / 32;
+      v.format = vpiVectorVal;
+      vpi_get_value(nets[i], &v);
+      line = (char *) malloc(16 + (words * 18));
+      len = sprintf(line, "v,%d", size);
+      for (int j = 0; j < words; j++) {
+        len += sprintf(line + len, ",%x,%x", (unsigned int)v.value.vector[j].aval,
+                       (unsigned int)v.value.vector[j].bval);
+      }
+      strcpy(line + len, "\n");
+    }
+    client_put(line);
+    free(line);
+  }
+}
+
+
+/// Looks up the memory with the given name and works out its dimensions, returns false if it is
+/// not found or is not an array
+static bool find_memory(char * name, Memory * mem) {
+  vpiHandle left, right, word;
+  s_vpi_value v;
+
+  (*mem).handle = handle_by_name(name, NULL);
+  if (!(*mem).handle) {
+    origen_log(LOG_ERROR, "Memory %s not found!", name);
+    return false;
+  }
+  (*mem).size = vpi_get(vpiSize, (*mem).handle);
+  (*mem).base = 0;
+  left = vpi_handle(vpiLeftRange, (*mem).handle);
+  right = vpi_handle(vpiRightRange, (*mem).handle);
+  if (left && right) {
+    v.format = vpiIntVal;
+    vpi_get_value(left, &v);
+    (*mem).base = v.value.integer;
+    vpi_get_value(right, &v);
+    if (v.value.integer < (*mem).base) {
+      (*mem).base = v.value.integer;
+    }
+  }
+  word = vpi_handle_by_index((*mem).handle, (*mem).base);
+  if (!word || (*mem).size <= 0) {
+    origen_log(LOG_ERROR, "%s is not a memory!", name);
+    return false;
+  }
+  (*mem).width = vpi_get(vpiSize, word);
+  (*mem).vector_words = ((*mem).width + 31) / 32;
+  vpi_free_object(word);
+  return true;
+}
+
+
+/// Maps the given file into memory, returns NULL if it can't be opened or is empty
+static char * map_file(char * path, size_t * len) {
+  struct stat st;
+  char * data;
+  int fd;
+
+  fd = open(path, O_RDONLY);
+  if (fd < 0) {
+    origen_log(LOG_ERROR, "Could not open %s!", path);
+    return NULL;
+  }
+  if (fstat(fd, &st) || st.st_size == 0) {
+    origen_log(LOG_ERROR, "%s is empty!", path);
+    close(fd);
+    return NULL;
+  }
+  data = (char *) mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (data == MAP_FAILED) {
+    origen_log(LOG_ERROR, "Could not map %s!", path);
+    return NULL;
+  }
+  *len = st.st_size;
+  return data;
+}
+
+
+/// Returns the value of the given hex digit, or -1 if it is not one
+static int hex_digit(char c) {
+  if (c >= '0' && c <= '9') {
+    return c - '0';
+  } else if (c >= 'a' && c <= 'f') {
+    return c - 'a' + 10;
+  } else if (c >= 'A' && c <= 'F') {
+    return c - 'A' + 10;
+  }
+  return -1;
+}
+
+
+/// Reads the next word from the image into the given vector and sets the array index that it is for,
+/// returns false at the end of the image.
+/// In a hex image, X and Z digits are supported and an @<hex address> sets the index of the next word.
+static bool next_image_word(ImageReader * r, Memory * mem, p_vpi_vecval vector, int * index) {
+  int bytes = ((*mem).width + 7) / 8;
+  int bit = 0;
+  int d;
+  uint32_t aval, bval;
+  size_t end;
+  char c;
+
+  for (int i = 0; i < (*mem).vector_words; i++) {
+    vector[i].aval = 0;
+    vector[i].bval = 0;
+  }
+
+  if ((*r).format == 'b') {
+    if ((*r).pos + bytes > (*r).len) {
+      return false;
+    }
+    for (int i = 0; i < bytes; i++) {
+      vector[i / 4].aval |= (PLI_INT32)((uint32_t)(unsigned char)(*r).data[(*r).pos++] << (8 * (i % 4)));
+    }
+    *index = (*r).index++;
+    return true;
+  }
+
+  // Skip any whitespace, comments and addresses to get to the next word
+  while ((*r).pos < (*r).len) {
+    c = (*r).data[(*r).pos];
+    if (isspace((unsigned char)c)) {
+      (*r).pos++;
+    } else if (c == '/' && (*r).pos + 1 < (*r).len && (*r).data[(*r).pos + 1] == '/') {
+      while ((*r).pos < (*r).len && (*r).data[(*r).pos] != '\n') {
+        (*r).pos++;
+      }
+    } else if (c == '@') {
+      (*r).pos++;
+      (*r).index = 0;
+      while ((*r).pos < (*r).len && (d = hex_digit((*r).data[(*r).pos])) >= 0) {
+        (*r).index = ((*r).index << 4) | d;
+        (*r).pos++;
+      }
+    } else {
+      break;
+    }
+  }
+  if ((*r).pos >= (*r).len) {
+    return false;
+  }
+
+  end = (*r).pos;
+  while (end < (*r).len && !isspace((unsigned char)(*r).data[end]) && (*r).data[end] != '/') {
+    end++;
+  }
+  // Fill the word from its least significant digit
+  for (size_t i = end; i > (*r).pos && bit < (*mem).width; i--) {
+    c = (*r).data[i - 1];
+    if (c == '_') {
+      continue;
+    } else if (c == 'x' || c == 'X') {
+      aval = 0xF;
+      bval = 0xF;
+    } else if (c == 'z' || c == 'Z') {
+      aval = 0;
+      bval = 0xF;
+    } else {
+      aval = hex_digit(c) < 0 ? 0 : hex_digit(c);
+      bval = 0;
+    }
+    vector[bit / 32].aval |= (PLI_INT32)(aval << (bit % 32));
+    vector[bit / 32].bval |= (PLI_INT32)(bval << (bit % 32));
+    bit += 4;
+  }
+  (*r).pos = end;
+  *index = (*r).index++;
+  return true;
+}
+
+
+/// Loads the given image file into the given memory, starting from the given offset from the start
+/// of the array. Replies with the number of words loaded and the number per second.
+static void load_memory(char * name, char * path, char * format, char * offset) {
+  Memory mem;
+  ImageReader r;
+  s_vpi_value v;
+  vpiHandle word;
+  p_vpi_vecval vector;
+  int index;
+  int count = 0;
+  uint64_t t = now_ns();
+  double rate;
+
+  if (!find_memory(name, &mem) || !(r.data = map_file(path, &r.len))) {
+    reply("FAIL");
+    return;
+  }
+  r.pos = 0;
+  r.format = *format;
+  r.index = mem.base + (offset ? strtol(offset, NULL, 10) : 0);
+
+  vector = (p_vpi_vecval) malloc(mem.vector_words * sizeof(s_vpi_vecval));
+  v.format = vpiVectorVal;
+  v.value.vector = vector;
+  while (next_image_word(&r, &mem, vector, &index)) {
+    if (index >= mem.base && index < mem.base + mem.size) {
+      word = vpi_handle_by_index(mem.handle, index);
+      if (word) {
+        put_value(word, &v, NULL, vpiNoDelay);
+        vpi_free_object(word);
+        count++;
+      }
+    }
+  }
+  munmap(r.data, r.len);
+  free(vector);
+
+  t = now_ns() - t;
+  rate = t ? (count * 1e9) / t : 0;
+  origen_log(LOG_DEBUG, "Loaded %d words into %s from %s (%.0f words/s)", count, name, path, rate);
+  reply("%d,%.0f", count, rate);
+}
+
+
+/// Writes a word to an image file in the given format, X and Z bits can only be represented in
+/// a hex image, in a binary image they will be written as 0
+static void write_image_word(FILE * f, Memory * mem, p_vpi_vecval vector, char format) {
+  int bytes = ((*mem).width + 7) / 8;
+  int digits = ((*mem).width + 3) / 4;
+  uint32_t aval, bval;
+
+  if (format == 'b') {
+    for (int i = 0; i < bytes; i++) {
+      fputc(((uint32_t)vector[i / 4].aval >> (8 * (i % 4))) & 0xFF, f);
+    }
+  } else {
+    for (int i = digits - 1; i >= 0; i--) {
+      aval = ((uint32_t)vector[i / 8].aval >> (4 * (i % 8))) & 0xF;
+      bval = ((uint32_t)vector[i / 8].bval >> (4 * (i % 8))) & 0xF;
+      if (bval) {
+        fputc((bval == 0xF && aval == 0) ? 'z' : 'x', f);
+      } else {
+        fputc("0123456789abcdef"[aval], f);
+      }
+    }
+    fputc('\n', f);
+  }
+}
+
+
+/// Dumps the given memory to an image file, starting from the given array index (or its first word
+/// if 'x') for the given number of words (or to its end if 'x'). A hex image will start with an
+/// @address line so that it can be loaded back to the same place.
+/// Replies with the number of words dumped, or FAIL.
+static void dump_memory(char * name, char * path, char * format, char * start, char * count) {
+  Memory mem;
+  s_vpi_value v;
+  vpiHandle word;
+  FILE * f;
+  int first, last;
+  int n = 0;
+  uint64_t t = now_ns();
+
+  if (!find_memory(name, &mem)) {
+    reply("FAIL");
+    return;
+  }
+  first = (start && *start != 'x') ? strtol(start, NULL, 10) : mem.base;
+  last = (count && *count != 'x') ? first + strtol(count, NULL, 10) : mem.base + mem.size;
+  if (first < mem.base) {
+    first = mem.base;
+  }
+  if (last > mem.base + mem.size) {
+    last = mem.base + mem.size;
+  }
+  f = fopen(path, *format == 'b' ? "wb" : "w");
+  if (!f) {
+    origen_log(LOG_ERROR, "Could not open %s for writing!", path);
+    reply("FAIL");
+    return;
+  }
+  if (*format != 'b') {
+    fprintf(f, "@%x\n", first);
+  }
+  v.format = vpiVectorVal;
+  for (int i = first; i < last; i++) {
+    word = vpi_handle_by_index(mem.handle, i);
+    if (word) {
+      vpi_get_value(word, &v);
+      write_image_word(f, &mem, v.value.vector, *format);
+      vpi_free_object(word);
+      n++;
+    }
+  }
+  fclose(f);
+
+  t = now_ns() - t;
+  origen_log(LOG_DEBUG, "Dumped %d words from %s to %s (%.0f words/s)", n, name, path, t ? (n * 1e9) / t : 0);
+  reply("%d", n);
+}
+
+
+/// Compares the given memory against the given image file, the offset is applied in the same way as
+/// for load_memory. Replies with the number of mismatches followed by the array index of each, or FAIL.
+static void compare_memory(char * name, char * path, char * format, char * offset) {
+  Memory mem;
+  ImageReader r;
+  s_vpi_value v;
+  vpiHandle word;
+  p_vpi_vecval expected;
+  int index;
+  int * mismatches = NULL;
+  int number_of_mismatches = 0;
+  int capacity = 0;
+  uint32_t mask;
+  char line[16];
+
+  if (!find_memory(name, &mem) || !(r.data = map_file(path, &r.len))) {
+    reply("FAIL");
+    return;
+  }
+  r.pos = 0;
+  r.format = *format;
+  r.index = mem.base + (offset ? strtol(offset, NULL, 10) : 0);
+
+  expected = (p_vpi_vecval) malloc(mem.vector_words * sizeof(s_vpi_vecval));
+  v.format = vpiVectorVal;
+  while (next_image_word(&r, &mem, expected, &index)) {
+    bool mismatch = index < mem.base || index >= mem.base + mem.size;
+
+    if (!mismatch && (word = vpi_handle_by_index(mem.handle, index))) {
+      vpi_get_value(word, &v);
+      for (int i = 0; i < mem.vector_words; i++) {
+        // Ignore any bits beyond the width of the word in the last element
+        mask = (i == mem.vector_words - 1 && mem.width % 32) ? ((1u << (mem.width % 32)) - 1) : 0xFFFFFFFF;
+        if ((((uint32_t)v.value.vector[i].aval ^ (uint32_t)expected[i].aval) |
+             ((uint32_t)v.value.vector[i].bval ^ (uint32_t)expected[i].bval)) & mask) {
+          mismatch = true;
+        }
+      }
+      vpi_free_object(word);
+    }
+    if (mismatch) {
+      if (number_of_mismatches == capacity) {
+        capacity = capacity ? capacity * 2 : 64;
+        mismatches = (int *) realloc(mismatches, capacity * sizeof(int));
+      }
+      mismatches[number_of_mismatches++] = index;
+    }
+  }
+  munmap(r.data, r.len);
+  free(expected);
+
+  reply("%d", number_of_mismatches);
+  for (int i = 0; i < number_of_mismatches; i++) {
+    sprintf(line, "%d\n", mismatches[i]);
+    client_put(line);
+  }
+  free(mismatches);
+}
+
+
+/// Starts sending the value changes of the given net to Origen under the given ID, an event containing
+/// its current value is sent straight away
+static void subscribe(char * id, char * net) {
+  int i = strtol(id, NULL, 10);
+  s_cb_data call;
+  s_vpi_time time = {vpiSuppressTime, 0, 0, 0.0};
+  s_vpi_value value = {vpiBinStrVal, {0}};
+  s_vpi_value v = {vpiBinStrVal, {0}};
+
+  if (i < 0 || i >= MAX_SUBSCRIPTIONS) {
+    origen_log(LOG_ERROR, "Illegal subscription ID %s, the maximum is %d", id, MAX_SUBSCRIPTIONS - 1);
+    return;
+  }
+  unsubscribe(i);
+  subscriptions[i].handle = handle_by_name(net, NULL);
+  if (!subscriptions[i].handle) {
+    origen_log(LOG_WARNING, "Net %s not found, its value changes will not be reported", net);
+    return;
+  }
+  subscriptions[i].active = true;
+
+  vpi_get_value(subscriptions[i].handle, &v);
+  record_subscription_event(i, v.value.str);
+
+  call.reason    = cbValueChange;
+  call.cb_rtn    = subscription_value_change_cb;
+  call.obj       = subscriptions[i].handle;
+  call.time      = &time;
+  call.value     = &value;
+  call.user_data = (char *) &subscriptions[i];
+
+  subscriptions[i].value_change_cb = vpi_register_cb(&call);
+}
+
+
+static void unsubscribe(int i) {
+  if (subscriptions[i].active) {
+    subscriptions[i].active = false;
+    subscriptions[i].changed = false;
+    vpi_remove_cb(subscriptions[i].value_change_cb);
+    subscriptions[i].value_change_cb = NULL;
+  }
+}
+
+
+/// Buffers a value change until the next reply to Origen. If the buffer is full then only the fact that
+/// the net has changed is recorded and its final value will be sent instead.
+static void record_subscription_event(int id, char * value) {
+  SubscriptionEvent * e;
+
+  if (number_of_subscription_events == MAX_SUBSCRIPTION_EVENTS) {
+    subscription_events_overflowed = true;
+    subscriptions[id].changed = true;
+    return;
+  }
+  e = &subscription_events[number_of_subscription_events++];
+  (*e).id = id;
+  (*e).time = sim_time();
+  (*e).cycle = cycle_count;
+  (*e).value = malloc(strlen(value) + 1);
+  strcpy((*e).value, value);
+}
+
+
+PLI_INT32 subscription_value_change_cb(p_cb_data data) {
+  Subscription * s = (Subscription *)(data->user_data);
+
+  if ((*s).active) {
+    record_subscription_event(s - subscriptions, data->value->value.str);
+  }
+  return 0;
+}
+
+
+/// Returns the buffered subscription events to be appended to a reply and clears them, or NULL if there
+/// are none. The format is ~E followed by id,time,cycle,value for each event separated by ';'.
+/// If events were lost because the buffer overflowed then a '!' separates those that were buffered
+/// from the current values of the nets which changed after that.
+static char * subscription_events_trailer() {
+  char * trailer;
+  size_t len = 4;
+  size_t pos;
+  s_vpi_value v;
+
+  if (!number_of_subscription_events && !subscription_events_overflowed) {
+    return NULL;
+  }
+  for (int i = 0; i < number_of_subscription_events; i++) {
+    len += strlen(subscription_events[i].value) + 64;
+  }
+  if (subscription_events_overflowed) {
+    for (int i = 0; i < MAX_SUBSCRIPTIONS; i++) {
+      if (subscriptions[i].changed) {
+        len += vpi_get(vpiSize, subscriptions[i].handle) + 64;
+      }
+    }
+  }
+  trailer = (char *) malloc(len);
+  pos = sprintf(trailer, "~E");
+  for (int i = 0; i < number_of_subscription_events; i++) {
+    pos += sprintf(trailer + pos, "%s%d,%llu,%llu,%s", i ? ";" : "", subscription_events[i].id,
+                   (unsigned long long)subscription_events[i].time, subscription_events[i].cycle,
+                   subscription_events[i].value);
+    free(subscription_events[i].value);
+  }
+  number_of_subscription_events = 0;
+  if (subscription_events_overflowed) {
+    pos += sprintf(trailer + pos, "!");
+    for (int i = 0; i < MAX_SUBSCRIPTIONS; i++) {
+      if (subscriptions[i].changed) {
+        v.format = vpiBinStrVal;
+        vpi_get_value(subscriptions[i].handle, &v);
+        pos += sprintf(trailer + pos, "%s%d,%llu,%llu,%s", trailer[pos - 1] == '!' ? "" : ";", i,
+                       (unsigned long long)sim_time(), cycle_count, v.value.str);
+        subscriptions[i].changed = false;
+      }
+    }
+    subscription_events_overflowed = false;
+  }
+  return trailer;
+}
+
+
+/// Returns the profile entry for the current key, growing the array of entries as required
+static ProfileEntry * current_profile_entry() {
+  if (profile_key >= profile_entries_capacity) {
+    int capacity = profile_entries_capacity ? profile_entries_capacity : 64;
+
+    while (capacity <= profile_key) {
+      capacity *= 2;
+    }
+    profile_entries = (ProfileEntry *) realloc(profile_entries, capacity * sizeof(ProfileEntry));
+    memset(profile_entries + profile_entries_capacity, 0,
+           (capacity - profile_entries_capacity) * sizeof(ProfileEntry));
+    profile_entries_capacity = capacity;
+  }
+  return &profile_entries[profile_key];
+}
+
+
+/// Sends the profile to Origen and then stops profiling, the number of keys is sent first followed
+/// by a line for each: key,bridge_ns,simulator_ns,blocks
+static void send_profile() {
+  char line[96];
+  int n = 0;
+
+  for (int i = 0; i < profile_entries_capacity; i++) {
+    if (profile_entries[i].blocks || profile_entries[i].bridge_ns) {
+      n++;
+    }
+  }
+  reply("%d", n);
+  for (int i = 0; i < profile_entries_capacity; i++) {
+    if (profile_entries[i].blocks || profile_entries[i].bridge_ns) {
+      sprintf(line, "%d,%llu,%llu,%llu\n", i, (unsigned long long)profile_entries[i].bridge_ns,
+              (unsigned long long)profile_entries[i].simulator_ns, profile_entries[i].blocks);
+      client_put(line);
+    }
+  }
+  free(profile_entries);
+  profile_entries = NULL;
+  profile_entries_capacity = 0;
+  profile_key = 0;
+  profiling = false;
+}
+
+
+/// Send a reply to Origen, sprintf type arguments can be supplied and the newline terminator
+/// will be added automatically.
+/// When reply trailers have been enabled by Origen, the current error count, match loop error
+/// count, cycle count and simulation time (in simtime units) will be appended to the message,
+/// allowing Origen to maintain a cached copy of them without having to make separate requests:
+///
+///    OK!~3,0,1200,120000000
+///
+/// Any value changes of subscribed nets since the last reply will then be appended, see
+/// subscription_events_trailer:
+///
+///    OK!~3,0,1200,120000000~E0,5000,12,1;0,8000,15,0
+static void reply(const char * fmt, ...) {
+  va_list aptr;
+  char trailer[96];
+  char * events = NULL;
+  int len;
+
+  trailer[0] = '\0';
+  if (reply_trailers) {
+    sprintf(trailer, "~%d,%d,%llu,%llu",
+      get_debug_int(&errors_handle, ORIGEN_SIM_TESTBENCH_CAT(ORIGEN_SIM_DEBUG_MODULE_CAT("errors"))),
+      get_debug_int(&match_errors_handle, ORIGEN_SIM_TESTBENCH_CAT(ORIGEN_SIM_DEBUG_MODULE_CAT("match_errors"))),
+      cycle_count, (unsigned long long)sim_time());
+    events = subscription_events_trailer();
+  }
+
+  va_start(aptr, fmt);
+  len = vsnprintf(NULL, 0, fmt, aptr);
+  va_end(aptr);
+
+  char * msg = (char *) malloc(len + strlen(trailer) + (events ? strlen(events) : 0) + 2);
+
+  va_start(aptr, fmt);
+  vsprintf(msg, fmt, aptr);
+  va_end(aptr);
+
+  strcat(msg, trailer);
+  if (events) {
+    strcat(msg, events);
+    free(events);
+  }
+  strcat(msg, "\n");
+  client_put(msg);
+  free(msg);
+}
+
+
+/// Waits and responds to instructions from Origen (to set pin states).
+/// When Origen requests a cycle, time will be advanced and this func will be called again.
+PLI_INT32 bridge_wait_for_msg(p_cb_data data) {
+  UNUSED(data);
+  int max_msg_len = MAX_MESSAGE_LENGTH;
+  char msg[max_msg_len];
+  Message * message;
+  char comment[128];
+  int err;
+  int timescale;
+  int type;
+  char *opcode, *arg1, *arg2, *arg3, *arg4;
+  vpiHandle handle;
+  s_vpi_value v;
+  uint64_t t;
+
+  if (stats.simulator_resumed_at) {
+    t = now_ns() - stats.simulator_resumed_at;
+    record_duration(&stats.simulator, t);
+    if (profiling) {
+      ProfileEntry * entry = current_profile_entry();
+
+      (*entry).simulator_ns += t;
+      (*entry).blocks++;
+    }
+    stats.simulator_resumed_at = 0;
+  }
+
+  if (number_of_pending_miscompares || dropped_miscompares) {
+    process_pending_miscompares();
+  }
+
+  if (capture_pending) {
+    sample_capture();
+  }
+
+  while(1) {
+
+    t = now_ns();
+    message = client_get_message();
+    err = message == NULL;
+    record_duration(&stats.client_get, now_ns() - t);
+    t = now_ns();
+    if (err) {
+      // Don't send to the Origen log since Origen may not be there
+      vpi_printf("ERROR: Failed to receive from Origen!\n");
+      end_simulation();
+      return 1;
+    }
+    if (runtime_errors) {
+      end_simulation();
+      return 1;
+    }
+
+    if (log_messages) {
+      vpi_printf("[MESSAGE] %s\n", client_message_text(message, msg));
+    }
+
+    // The message has already been split into its arguments by the client's reader thread
+    current_message = message;
+    opcode = next_arg();
+    if (opcode == NULL) {
+      opcode = "";
+    }
+    if (*opcode > ' ' && *opcode <= '~') {
+      stats.messages[(int)*opcode]++;
+    }
+
+    if (!max_errors_exceeded || (max_errors_exceeded && (
+      // When max_errors_exceeded, only continue to process the following opcodes.
+      // These are the ones required to enable a controlled shutdown driven by the main Origen process
+      // and also any that return data to Origen so that the main process does not get blocked:
+      //     Sync-up           End Simulation    Peek              Flush               Log
+            *opcode == '7' || *opcode == '8' || *opcode == '9' || *opcode == 'j' || *opcode == 'k' ||
+      //     Get version      Get timescale     Read reg trans   Get cycle count   Get stats
+            *opcode == 'i' || *opcode == 'l' || *opcode == 'n' || *opcode == 'o' || *opcode == 'u' ||
+      //     Get fail cycles  Analog measure    Bulk capture      Bulk peek         Load memory
+            *opcode == 'w' || *opcode == 'z' || *opcode == 'A' || *opcode == 'B' || *opcode == 'C' ||
+      //     Dump memory      Subscribe         Profile
+            *opcode == 'D' || *opcode == 'E' || *opcode == 'F'
+      ))) {
+      switch(*opcode) {
+        // Define pin
+        //   0^pin_name^pin_index^drive_wave_ix^capture_wave_ix
+        //
+        //   0 for the wave indexes means the default, custom waves
+        //   must therefore start from index 1
+        //
+        //   The pin index must be uniquely assigned to the pin by the caller
+        //   and must be less than MAX_NUMBER_PINS
+        //
+        //   0^tdi^12^0^0  
+        case '0' :
+          arg1 = next_arg();
+          arg2 = next_arg();
+          arg3 = next_arg();
+          arg4 = next_arg();
+          //DEBUG("Define Pin: %s, %s, %s, %s\n", arg1, arg2, arg3, arg4);
+          define_pin(arg1, arg2, arg3, arg4);
+          break;
+        // Set Period
+        //   1^100000
+        case '1' :
+          arg1 = next_arg();
+          set_period(arg1);
+          break;
+        // Drive Pin
+        //   2^pin_index^data
+        //
+        //   2^12^0
+        //   2^12^1
+        case '2' :
+          arg1 = next_arg();
+          arg2 = next_arg();
+          //DEBUG("Drive Pin: %s, %s\n", arg1, arg2);
+          drive_pin(arg1, arg2);
+          break;
+        // Cycle
+        //   3^number_of_cycles
+        //
+        //   3^1
+        //   3^65535
+        case '3' :
+          arg1 = next_arg();
+          repeat = strtol(arg1, NULL, 10);
+          if (repeat) {
+            repeat = repeat - 1;
+          }
+          cycle();
+          record_duration(&stats.bridge, now_ns() - t);
+          if (profiling) {
+            (*current_profile_entry()).bridge_ns += now_ns() - t;
+          }
+          simulator_resumed();
+          return 0;
+        // Compare Pin
+        //   4^pin_index^data
+        //
+        //   4^14^0
+        //   4^14^1
+        case '4' :
+          arg1 = next_arg();
+          arg2 = next_arg();
+          compare_pin(arg1, arg2);
+          break;
+        // Don't Care Pin
+        //   5^pin_index
+        //
+        //   5^14
+        case '5' :
+          arg1 = next_arg();
+          dont_care_pin(arg1);
+          break;
+        // Define wave
+        //   6^wave_index^compare^events
+        //
+        //   0 for the wave indexes means the default, custom waves
+        //   must therefore start from index 1
+        //
+        //   0 for the compare parameter means it is a drive wave, 1 means it is
+        //   for when the pin is in compare mode
+        //
+        //   Some example events are shown below:
+        //
+        //   6^1^0^0_D_25_0_50_D_75_0  // Drive at 0ns, off at 25ns, drive at 50ns, off at 75ns
+        case '6' :
+          arg1 = next_arg();
+          arg2 = next_arg();
+          arg3 = next_arg();
+          //DEBUG("Define Wave: %s, %s, %s\n", arg1, arg2, arg3);
+          define_wave(arg1, arg2, arg3);
+          break;
+        // Sync-up
+        //   7^
+        case '7' :
+          reply("OK!");
           break;
         // Complete
         //   8^
@@ -743,33 +2766,32 @@ PLI_INT32 bridge_wait_for_msg(p_cb_data data) {
         //   9^origen.debug.errors^i
         //   9^origen.dut.my_real_val^f
         case '9' :
-          arg1 = strtok(NULL, "^");
-          arg2 = strtok(NULL, "^");
-          handle = vpi_handle_by_name(arg1, NULL);
+          arg1 = next_arg();
+          arg2 = next_arg();
+          handle = handle_by_name(arg1, NULL);
           if (handle) {
             if (*arg2 == 'i') {
               v.format = vpiBinStrVal;
               vpi_get_value(handle, &v);
-              sprintf(msg, "%s\n", v.value.str);
+              reply("%s", v.value.str);
             } else {
               v.format = vpiRealVal;
               vpi_get_value(handle, &v);
-              sprintf(msg, "%f\n", v.value.real);
+              reply("%f", v.value.real);
             }
-            client_put(msg);
           } else {
-            client_put("FAIL\n");
+            reply("FAIL");
           }
           break;
         // Set Pattern Name
         //   a^atd_ramp_25mhz
         case 'a' :
-          handle = vpi_handle_by_name(ORIGEN_SIM_TESTBENCH_CAT(ORIGEN_SIM_DEBUG_MODULE_CAT("pattern")), NULL);
-          arg1 = strtok(NULL, "^");
+          handle = handle_by_name(ORIGEN_SIM_TESTBENCH_CAT(ORIGEN_SIM_DEBUG_MODULE_CAT("pattern")), NULL);
+          arg1 = next_arg();
 
           v.format = vpiStringVal;
           v.value.str = arg1;
-          vpi_put_value(handle, &v, NULL, vpiNoDelay);
+          put_value(handle, &v, NULL, vpiNoDelay);
           break;
         // Poke
         //   Sets the given value on the given net, the number should be given
@@ -779,10 +2801,10 @@ PLI_INT32 bridge_wait_for_msg(p_cb_data data) {
         //   b^origen.debug.errors^i^15
         //   b^origen.dut.my_real_val^f^1.12
         case 'b' :
-          arg1 = strtok(NULL, "^");
-          arg2 = strtok(NULL, "^");
-          arg3 = strtok(NULL, "^");
-          handle = vpi_handle_by_name(arg1, NULL);
+          arg1 = next_arg();
+          arg2 = next_arg();
+          arg3 = next_arg();
+          handle = handle_by_name(arg1, NULL);
           if (handle) {
             if (*arg2 == 'i') {
               v.format = vpiDecStrVal;
@@ -791,29 +2813,29 @@ PLI_INT32 bridge_wait_for_msg(p_cb_data data) {
               v.format = vpiRealVal;
               v.value.real = strtof(arg3, NULL);
             }
-            vpi_put_value(handle, &v, NULL, vpiNoDelay);
+            put_value(handle, &v, NULL, vpiNoDelay);
           }
           break;
         // Set Comment
         //   c^0^Some comment about the pattern
         case 'c' :
-          arg1 = strtok(NULL, "^");
-          arg2 = strtok(NULL, "^");
+          arg1 = next_arg();
+          arg2 = next_arg();
 
           strcpy(comment, ORIGEN_SIM_TESTBENCH_CAT(ORIGEN_SIM_DEBUG_MODULE_CAT("comments")));
           strcat(comment, arg1);
 
-          handle = vpi_handle_by_name(comment, NULL);
+          handle = handle_by_name(comment, NULL);
 
           v.format = vpiStringVal;
           v.value.str = arg2;
-          vpi_put_value(handle, &v, NULL, vpiNoDelay);
+          put_value(handle, &v, NULL, vpiNoDelay);
           break;
         // Log all messages
         //   d^1  Turn logging on
         //   d^0  Turn logging off
         case 'd' :
-          arg1 = strtok(NULL, "^");
+          arg1 = next_arg();
           log_messages = atoi(arg1);
           break;
         // Capture Pin
@@ -821,45 +2843,57 @@ PLI_INT32 bridge_wait_for_msg(p_cb_data data) {
         //
         //   e^14
         case 'e' :
-          arg1 = strtok(NULL, "^");
+          arg1 = next_arg();
           capture_pin(arg1);
           break;
         // Sync enable
         case 'f' :
-          handle = vpi_handle_by_name(ORIGEN_SIM_TESTBENCH_CAT("pins.sync"), NULL);
+          handle = handle_by_name(ORIGEN_SIM_TESTBENCH_CAT("pins.sync"), NULL);
           v.format = vpiDecStrVal;
           v.value.str = "1";
-          vpi_put_value(handle, &v, NULL, vpiNoDelay);
+          put_value(handle, &v, NULL, vpiNoDelay);
           break;
         // Sync disable
         case 'g' :
-          handle = vpi_handle_by_name(ORIGEN_SIM_TESTBENCH_CAT("pins.sync"), NULL);
+          handle = handle_by_name(ORIGEN_SIM_TESTBENCH_CAT("pins.sync"), NULL);
           v.format = vpiDecStrVal;
           v.value.str = "0";
-          vpi_put_value(handle, &v, NULL, vpiNoDelay);
+          put_value(handle, &v, NULL, vpiNoDelay);
           break;
         // Stop Capture Pin
         //   h^pin_index
         //
         //   h^14
         case 'h' :
-          arg1 = strtok(NULL, "^");
+          arg1 = next_arg();
           stop_capture_pin(arg1);
           break;
         // Get version, returns the version of OrigenSim the DUT object was compiled with
         //   i^
         case 'i' :
-          client_put(ORIGEN_SIM_VERSION"\n");
+          reply(ORIGEN_SIM_VERSION);
           break;
         // Flush
+        //   j^     - Flush the simulator's output buffers
+        //   j^12   - As above, but first emit an end-of-flush marker containing the given ID on
+        //            both stdout and stderr, Origen uses these to know when it has consumed all
+        //            output generated up to this point
         case 'j' :
+          arg1 = next_arg();
+          if (arg1) {
+            vpi_printf("%s%s\n", FLUSH_MARKER, arg1);
+          }
           vpi_flush();
+          if (arg1) {
+            fprintf(stderr, "%s%s\n", FLUSH_MARKER, arg1);
+            fflush(stderr);
+          }
           break;
         // Log message
         //   k^2^A message to output to the console/log
         case 'k' :
-          arg1 = strtok(NULL, "^");
-          arg2 = strtok(NULL, "^");
+          arg1 = next_arg();
+          arg2 = next_arg();
           type = atoi(arg1);
           origen_log(type, arg2); 
           break;
@@ -885,28 +2919,26 @@ PLI_INT32 bridge_wait_for_msg(p_cb_data data) {
         //   l^
         case 'l' :
           timescale = vpi_get(vpiTimeUnit, 0);
-          sprintf(msg, "%d\n", timescale);
-          client_put(msg);
+          reply("%d", timescale);
           break;
         // Set max_errors
         //   m^10
         case 'm' :
-          arg1 = strtok(NULL, "^");
+          arg1 = next_arg();
           max_errors = atoi(arg1);
           break;
         // Read reg transaction
         //   n^1   - Start transaction
         //   n^0   - Stop transaction
         case 'n' :
-          arg1 = strtok(NULL, "^");
+          arg1 = next_arg();
           
           if (*arg1 == '1') {
             transaction_error_count = 0;
             transaction_open = true;
           } else {
             // Send Origen the error data
-            sprintf(msg, "%d,%d\n", transaction_error_count, MAX_TRANSACTION_ERRORS);
-            client_put(msg);
+            reply("%d,%d", transaction_error_count, MAX_TRANSACTION_ERRORS);
             for (int i = 0; i < transaction_error_count; i++) {
               Miscompare *m = &miscompares[i];
 
@@ -924,20 +2956,19 @@ PLI_INT32 bridge_wait_for_msg(p_cb_data data) {
         // Get cycle count
         //   o^
         case 'o' :
-          sprintf(msg, "%llu\n", cycle_count);
-          client_put(msg);
+          reply("%llu", cycle_count);
           break;
         // Set cycle count
         //   p^100
         case 'p' :
-          arg1 = strtok(NULL, "^");
+          arg1 = next_arg();
           cycle_count = atoll(arg1);
           break;
         // Match loop
         //   q^1    - Start match loop
         //   q^0    - Stop match loop
         case 'q' :
-          arg1 = strtok(NULL, "^");
+          arg1 = next_arg();
           
           if (*arg1 == '1') {
             match_loop_error_count = 0;
@@ -954,10 +2985,10 @@ PLI_INT32 bridge_wait_for_msg(p_cb_data data) {
         //   r^origen.dut.some.net^i^1^
         //   r^origen.dut.some.net^f^1.25
         case 'r' :
-          arg1 = strtok(NULL, "^");
-          arg2 = strtok(NULL, "^");
-          arg3 = strtok(NULL, "^");
-          handle = vpi_handle_by_name(arg1, NULL);
+          arg1 = next_arg();
+          arg2 = next_arg();
+          arg3 = next_arg();
+          handle = handle_by_name(arg1, NULL);
           if (handle) {
             if (*arg2 == 'i') {
               v.format = vpiDecStrVal;
@@ -966,7 +2997,7 @@ PLI_INT32 bridge_wait_for_msg(p_cb_data data) {
               v.format = vpiRealVal;
               v.value.real = strtof(arg3, NULL);
             }
-            vpi_put_value(handle, &v, NULL, vpiForceFlag);
+            put_value(handle, &v, NULL, vpiForceFlag);
           }
           break;
         // Release
@@ -975,14 +3006,319 @@ PLI_INT32 bridge_wait_for_msg(p_cb_data data) {
         //   s^origen.dut.some.net
         //   s^origen.dut.some.net
         case 's' :
-          arg1 = strtok(NULL, "^");
-          handle = vpi_handle_by_name(arg1, NULL);
+          arg1 = next_arg();
+          handle = handle_by_name(arg1, NULL);
           if (handle) {
-            vpi_put_value(handle, &v, NULL, vpiReleaseFlag);
+            put_value(handle, &v, NULL, vpiReleaseFlag);
+          }
+          break;
+        // Enable reply trailers, when enabled all replies will have the current error count, match
+        // loop error count and cycle count appended to them
+        //   t^1   - Enable
+        //   t^0   - Disable
+        case 't' :
+          arg1 = next_arg();
+          reply_trailers = (*arg1 == '1');
+          break;
+        // Get the bridge's instrumentation counters, returns the number of lines in the report
+        // followed by the report itself, see stats_report() for the format
+        //   u^
+        case 'u' :
+          {
+            char * report;
+            int lines = stats_report(&report);
+            reply("%d", lines);
+            client_put(report);
+            free(report);
+          }
+          break;
+        // Define a window of cycles during which wave dumping should be enabled, once any windows
+        // have been defined dumping will be disabled outside of them. Windows must be given in order.
+        //   v^1000^1200   - Enable dumping from cycle 1000 to 1200 (inclusive)
+        //   v^            - Clear all windows and enable dumping
+        case 'v' :
+          arg1 = next_arg();
+          arg2 = next_arg();
+          if (arg1 && arg2) {
+            if (number_of_dump_windows < MAX_DUMP_WINDOWS) {
+              dump_windows[number_of_dump_windows].start = strtoull(arg1, NULL, 10);
+              dump_windows[number_of_dump_windows].end = strtoull(arg2, NULL, 10);
+              number_of_dump_windows++;
+            } else {
+              origen_log(LOG_WARNING, "The maximum number of wave dump windows (%d) has been exceeded, the window from cycle %s will be ignored", MAX_DUMP_WINDOWS, arg1);
+            }
+            update_dump_enable();
+          } else {
+            number_of_dump_windows = 0;
+            current_dump_window = 0;
+            set_dump_enable(true);
+          }
+          break;
+        // Wave dump control
+        //   x^1                      - Switch dumping on
+        //   x^1^origen.dut.core^2    - Switch dumping on and dump the given scope to the given depth
+        //                              (0 for all levels), this is only supported by the testbench
+        //                              for FSDB dumps
+        //   x^0                      - Switch dumping off
+        case 'x' :
+          arg1 = next_arg();
+          arg2 = next_arg();
+          arg3 = next_arg();
+          if (arg1 && *arg1 == '1') {
+            // An FSDB dump only includes the scopes which have been added to it, the testbench adds the
+            // whole testbench when the scope is cleared
+            handle = handle_by_name(ORIGEN_SIM_TESTBENCH_CAT(ORIGEN_SIM_DEBUG_MODULE_CAT("dump_scope")), NULL);
+            if (arg2 && *arg2) {
+              v.format = vpiStringVal;
+              v.value.str = arg2;
+            } else {
+              v.format = vpiIntVal;
+              v.value.integer = 0;
+            }
+            put_value(handle, &v, NULL, vpiNoDelay);
+            if (arg2 && *arg2) {
+              handle = handle_by_name(ORIGEN_SIM_TESTBENCH_CAT(ORIGEN_SIM_DEBUG_MODULE_CAT("dump_all")), NULL);
+              v.format = vpiIntVal;
+              vpi_get_value(handle, &v);
+              if (v.value.integer == 1) {
+                origen_log(LOG_WARNING, "The whole testbench is already being dumped, so it will not be restricted to %s, build the DUT with --dump_off to start without it", arg2);
+              }
+              handle = handle_by_name(ORIGEN_SIM_TESTBENCH_CAT(ORIGEN_SIM_DEBUG_MODULE_CAT("dump_depth")), NULL);
+              v.format = vpiDecStrVal;
+              v.value.str = arg3 ? arg3 : "0";
+              put_value(handle, &v, NULL, vpiNoDelay);
+            }
+            // Changing this will make the testbench apply the new scope
+            handle = handle_by_name(ORIGEN_SIM_TESTBENCH_CAT(ORIGEN_SIM_DEBUG_MODULE_CAT("dump_scope_update")), NULL);
+            v.format = vpiIntVal;
+            vpi_get_value(handle, &v);
+            v.value.integer = !v.value.integer;
+            put_value(handle, &v, NULL, vpiNoDelay);
+            set_dump_enable(true);
+          } else {
+            set_dump_enable(false);
+          }
+          break;
+        // Analog waveform, drives a waveform on the given analog pin driver with the drive value
+        // updated every step simtime units, all times are in simtime units relative to when the message
+        // is received
+        //   y^origen.pins.vdd^p^100^0_0.0_10000_1.8          - Piecewise-linear, a list of time/value points
+        //   y^origen.pins.vdd^a^20000_1.8_30000_0.0          - Append more points to a piecewise-linear wave
+        //   y^origen.pins.vdd^s^100^0.9_0.9_10000_0          - Sine, offset_amplitude_period_duration, a
+        //                                                     duration of 0 means run until stopped
+        //   y^origen.pins.vdd^x                              - Stop, the pin will hold its last value
+        case 'y' :
+          {
+            AnalogWave * wave;
+
+            arg1 = next_arg();
+            arg2 = next_arg();
+            arg3 = next_arg();
+            arg4 = next_arg();
+            if (!arg1 || !arg2) {
+              origen_log(LOG_ERROR, "An analog waveform message must give a pin driver and a waveform type");
+              break;
+            }
+            wave = find_analog_wave(arg1, *arg2 != 'x');
+            if (wave) {
+              if (*arg2 == 'p' || *arg2 == 's') {
+                start_analog_wave(wave, *arg2, arg3, arg4);
+              } else if (*arg2 == 'a') {
+                if (arg3) {
+                  add_analog_wave_points(wave, arg3);
+                } else {
+                  origen_log(LOG_ERROR, "No points were given to append to the analog waveform for %s", arg1);
+                }
+              } else {
+                stop_analog_wave(wave);
+              }
+            }
+          }
+          break;
+        // Analog measurement, samples a real-valued net either on every value change or at a fixed interval
+        // (in simtime units) and optionally checks each sample against the given limits, an 'x' means no limit.
+        // An out-of-limit sample will be reported as a miscompare.
+        //   z^origen.pins.ana.pin^0^0.5^1.2                   - Start sampling on every value change
+        //   z^origen.pins.ana.pin^1000^x^1.2                  - Start sampling every 1000 simtime units
+        //   z^origen.pins.ana.pin                             - Stop, returns the results:
+        //                                                       count,min,max,mean
+        case 'z' :
+          {
+            AnalogMeasurement * m;
+
+            arg1 = next_arg();
+            arg2 = next_arg();
+            arg3 = next_arg();
+            arg4 = next_arg();
+            m = find_analog_measurement(arg1, arg2 != NULL);
+            if (arg2) {
+              if (m) {
+                start_analog_measurement(m, arg2, arg3, arg4);
+              }
+            } else if (m && (*m).count) {
+              stop_analog_measurement(m);
+              reply("%llu,%.15g,%.15g,%.15g", (unsigned long long)(*m).count, (*m).min, (*m).max,
+                    (*m).sum / (*m).count);
+            } else {
+              reply("0,0,0,0");
+            }
+          }
+          break;
+        // Bulk capture, records the values of the given nets at the end of every cycle until it is
+        // stopped, at which point they are returned in one run-length encoded response
+        //   A^a^origen.dut.tdo       - Add a net to be captured
+        //   A^1                      - Start capturing
+        //   A^0                      - Stop, returns the number of runs followed by a line
+        //                              for each: cycles,value1,value2,...
+        case 'A' :
+          arg1 = next_arg();
+          if (*arg1 == 'a') {
+            add_capture_net(next_arg());
+          } else if (*arg1 == '1') {
+            number_of_capture_runs = 0;
+            capture_active = true;
+          } else {
+            send_capture();
+          }
+          break;
+        // Bulk peek, returns the values of many nets in one response, see send_net_values
+        // for the format. The nets can either be given in the message, or registered in advance
+        // as a group which can then be peeked by its ID.
+        //   B^l^origen.dut.a^origen.dut.b    - Peek the given nets
+        //   B^g^3^origen.dut.a               - Add a net to group 3
+        //   B^c^3                            - Clear group 3
+        //   B^p^3                            - Peek the nets in group 3
+        case 'B' :
+          arg1 = next_arg();
+          if (*arg1 == 'l') {
+            vpiHandle nets[max_msg_len / 2];
+            int number_of_nets = 0;
+
+            while ((arg2 = next_arg())) {
+              nets[number_of_nets++] = handle_by_name(arg2, NULL);
+            }
+            send_net_values(nets, number_of_nets);
+          } else {
+            NetGroup * group = find_net_group(next_arg());
+
+            if (*arg1 == 'g') {
+              arg2 = next_arg();
+              if (group) {
+                add_net_group_net(group, arg2);
+              }
+            } else if (*arg1 == 'c') {
+              if (group) {
+                (*group).number_of_nets = 0;
+              }
+            } else if (group) {
+              send_net_values((*group).nets, (*group).number_of_nets);
+            } else {
+              reply("0");
+            }
+          }
+          break;
+        // Load memory, writes an image file into a memory array, the format is 'b' for raw binary
+        // or 'h' for $readmemh style hex. The words are loaded from the given offset from the start
+        // of the array, though an @address within a hex file will override that.
+        // Returns the number of words loaded and the number per second, or FAIL.
+        //   C^origen.dut.flash.mem^/path/to/image.bin^b^0
+        case 'C' :
+          arg1 = next_arg();
+          arg2 = next_arg();
+          arg3 = next_arg();
+          arg4 = next_arg();
+          load_memory(arg1, arg2, arg3, arg4);
+          break;
+        // Dump memory, writes the contents of a memory array (or a range of it) to an image file in
+        // the same formats as for Load memory, or compares it against one
+        //   D^d^origen.dut.flash.mem^/path/to/dump.hex^h^x^x       - Dump the whole array, replies
+        //                                                            with the number of words
+        //   D^d^origen.dut.flash.mem^/path/to/dump.bin^b^256^1024  - Dump 1024 words from index 256
+        //   D^c^origen.dut.flash.mem^/path/to/ref.bin^b^0          - Compare, replies with the number
+        //                                                            of mismatches followed by the
+        //                                                            index of each
+        case 'D' :
+          {
+            char * mode = next_arg();
+
+            arg1 = next_arg();
+            arg2 = next_arg();
+            arg3 = next_arg();
+            arg4 = next_arg();
+            if (*mode == 'd') {
+              dump_memory(arg1, arg2, arg3, arg4, next_arg());
+            } else {
+              compare_memory(arg1, arg2, arg3, arg4);
+            }
+          }
+          break;
+        // Subscribe, the value changes of subscribed nets are appended to the next reply to Origen,
+        // see reply() for the format. Subscription events are only sent when reply trailers are enabled.
+        //   E^s^3^origen.dut.irq     - Subscribe to the given net with ID 3
+        //   E^u^3                    - Unsubscribe ID 3
+        case 'E' :
+          arg1 = next_arg();
+          arg2 = next_arg();
+          if (*arg1 == 's') {
+            subscribe(arg2, next_arg());
+          } else {
+            int i = strtol(arg2, NULL, 10);
+
+            if (i >= 0 && i < MAX_SUBSCRIPTIONS) {
+              unsubscribe(i);
+            }
+          }
+          break;
+        // Profile, records the time spent in the bridge and in the simulator for each cycle block,
+        // attributed to the key given by Origen. The simulator time of a block runs from the cycle
+        // message until control returns to the bridge.
+        //   F^1         - Start profiling, with key 0
+        //   F^k^12      - Attribute the following blocks to key 12
+        //   F^0         - Stop, returns the number of keys followed by a line for
+        //                 each: key,bridge_ns,simulator_ns,blocks
+        case 'F' :
+          arg1 = next_arg();
+          if (*arg1 == '1') {
+            profiling = true;
+            profile_key = 0;
+          } else if (*arg1 == 'k') {
+            profile_key = strtol(next_arg(), NULL, 10);
+            if (profile_key < 0) {
+              profile_key = 0;
+            }
+          } else {
+            send_profile();
+          }
+          break;
+        // Free-running clock, the bridge toggles the given pin without any further messages until the
+        // clock is stopped, see start_clock. All times are in simtime units.
+        //   G^3^10000^5000^2500     - Start a clock on pin 3 with a period of 10000 which is high for 5000,
+        //                             its first rising edge is 2500 after this message
+        //   G^3^20000^10000^x       - Change the period of the clock on pin 3 from its next rising edge
+        //   G^3^x                   - Stop, the pin holds its current level until Origen next updates it
+        case 'G' :
+          arg1 = next_arg();
+          arg2 = next_arg();
+          arg3 = next_arg();
+          arg4 = next_arg();
+          if (!arg2 || *arg2 == 'x') {
+            stop_clock(arg1);
+          } else {
+            start_clock(arg1, arg2, arg3, arg4);
+          }
+          break;
+        // Get fail cycles, returns the number of cycles in which miscompares have occurred, followed
+        // by each cycle number
+        //   w^
+        case 'w' :
+          reply("%d", number_of_fail_cycles);
+          for (int i = 0; i < number_of_fail_cycles; i++) {
+            sprintf(msg, "%llu\n", fail_cycles[i]);
+            client_put(msg);
           }
           break;
         default :
-          origen_log(LOG_ERROR, "Illegal message received from Origen: %s", orig_msg);
+          origen_log(LOG_ERROR, "Illegal message received from Origen: %s", client_message_text(message, msg));
           runtime_errors += 1;
           end_simulation();
           return 1;
@@ -993,7 +3329,10 @@ PLI_INT32 bridge_wait_for_msg(p_cb_data data) {
       set_period("1");
       cycle();
     }
-    free(orig_msg);
+    record_duration(&stats.bridge, now_ns() - t);
+    if (profiling) {
+      (*current_profile_entry()).bridge_ns += now_ns() - t;
+    }
   }
 }
 
@@ -1002,11 +3341,13 @@ static void end_simulation() {
   vpiHandle handle;
   s_vpi_value v;
 
+  log_stats();
+
   // Setting this node will cause the testbench to call $finish
-  handle = vpi_handle_by_name(ORIGEN_SIM_TESTBENCH_CAT(ORIGEN_FINISH_SIG_NAME), NULL);
+  handle = handle_by_name(ORIGEN_SIM_TESTBENCH_CAT(ORIGEN_FINISH_SIG_NAME), NULL);
   v.format = vpiDecStrVal;
   v.value.str = "1";
-  vpi_put_value(handle, &v, NULL, vpiNoDelay);
+  put_value(handle, &v, NULL, vpiNoDelay);
   // Corner case during testing, the timeset may not have been set yet
   set_period("1");
   // Do a cycle so that the simulation sees the edge on origen.finish
@@ -1016,6 +3357,12 @@ static void end_simulation() {
 
 PLI_INT32 cycle_cb(p_cb_data data) {
   UNUSED(data);
+  if (number_of_pending_miscompares || dropped_miscompares) {
+    process_pending_miscompares();
+  }
+  if (capture_pending) {
+    sample_capture();
+  }
   repeat = repeat - 1;
   cycle();
   return 0;
@@ -1033,7 +3380,24 @@ static void cycle() {
   time.low  = (uint32_t)(period_in_simtime_units);
 
   cycle_count++;
+  stats.cycles++;
 
+  if (number_of_dump_windows) {
+    update_dump_enable();
+  }
+
+  if (capture_active) {
+    capture_pending = true;
+  }
+
+#ifdef ORIGEN_DPI
+  // The testbench's DPI loop will wait for the period and then call bridge_dpi_start_cycle, which
+  // takes the place of the callback below
+  UNUSED(call);
+  UNUSED(time);
+  number_of_dpi_events = 0;
+  next_dpi_event = 0;
+#else
   call.reason    = cbAfterDelay;
   call.obj       = 0;
   call.time      = &time;
@@ -1048,6 +3412,7 @@ static void cycle() {
   }
 
   vpi_free_object(vpi_register_cb(&call));
+#endif
 
   register_wave_events();
 }
@@ -1059,24 +3424,80 @@ static void on_max_errors_exceeded() {
   origen_log(LOG_ERROR, "!MAX_ERROR_ABORT!");
 }
 
-/// Called every time a miscompare event occurs, 3 args will be passed in:
-/// the pin name, expected data, actual data
-PLI_INT32 bridge_on_miscompare(PLI_BYTE8 * user_dat) {
-  char *pin_name;
-  int expected;
-  int received;
+/// Increments the error count, this is used for all types of miscompare
+static void count_error() {
+  s_vpi_value val;
+  vpiHandle handle;
+
+  error_count++;
+  record_fail_cycle();
+
+  handle = handle_by_name(ORIGEN_SIM_TESTBENCH_CAT(ORIGEN_SIM_DEBUG_MODULE_CAT("errors")), NULL);
+  val.format = vpiIntVal;
+  val.value.integer = error_count;
+  put_value(handle, &val, NULL, vpiNoDelay);
+
+  if (error_count > max_errors) {
+    // If a transaction is currently open hold off aborting until after that has completed
+    // to enable a proper error message to be generated for it
+    if (transaction_open) {
+      max_errors_exceeded_during_transaction = true;
+    } else {
+      on_max_errors_exceeded();
+    }
+  }
+}
+
+/// Records a miscompare on the given pin, received is -2 for Z and -1 for X
+static void on_miscompare(char * pin_name, int expected, int received) {
   s_vpi_value val;
   vpiHandle handle;
 
   if (match_loop_open) {
     match_loop_error_count++;
 
-    handle = vpi_handle_by_name(ORIGEN_SIM_TESTBENCH_CAT(ORIGEN_SIM_DEBUG_MODULE_CAT("match_errors")), NULL);
+    handle = handle_by_name(ORIGEN_SIM_TESTBENCH_CAT(ORIGEN_SIM_DEBUG_MODULE_CAT("match_errors")), NULL);
     val.format = vpiIntVal;
     val.value.integer = match_loop_error_count;
-    vpi_put_value(handle, &val, NULL, vpiNoDelay);
+    put_value(handle, &val, NULL, vpiNoDelay);
 
   } else {
+    if (received == 1 || received == 0) {
+      origen_log(LOG_ERROR, "Miscompare on pin %s, expected %d received %d", pin_name, expected, received);
+    } else if (received == -2) {
+      origen_log(LOG_ERROR, "Miscompare on pin %s, expected %d received Z", pin_name, expected);
+    } else {
+      origen_log(LOG_ERROR, "Miscompare on pin %s, expected %d received X", pin_name, expected);
+    }
+
+    count_error();
+
+    // Store all errors during a transaction
+    if (transaction_open) {
+      if (transaction_error_count < MAX_TRANSACTION_ERRORS) {
+        Miscompare *miscompare = &miscompares[transaction_error_count];
+
+        (*miscompare).pin_name = malloc(strlen(pin_name) + 1);
+        strcpy((*miscompare).pin_name, pin_name);
+        (*miscompare).cycle = cycle_count;
+        (*miscompare).expected = expected;
+        (*miscompare).received = received;
+      }
+      transaction_error_count++;
+    }
+  }
+}
+
+/// Called every time a miscompare event occurs, 3 args will be passed in:
+/// the pin name, expected data, actual data
+PLI_INT32 bridge_on_miscompare(PLI_BYTE8 * user_dat) {
+  char *pin_name = NULL;
+  int expected = 0;
+  int received = 0;
+  s_vpi_value val;
+
+  // The pin details are not needed to count the errors within a match loop
+  if (!match_loop_open) {
     vpiHandle callh = vpi_handle(vpiSysTfCall, 0);
     vpiHandle argv = vpi_iterate(vpiArgument, callh);
     vpiHandle arg;
@@ -1097,51 +3518,164 @@ PLI_INT32 bridge_on_miscompare(PLI_BYTE8 * user_dat) {
     received = val.value.integer;
 
     vpi_free_object(argv);
+  }
+  on_miscompare(pin_name, expected, received);
+  return 0;
+}
 
-    if (received == 1 || received == 0) {
-      origen_log(LOG_ERROR, "Miscompare on pin %s, expected %d received %d", pin_name, expected, received);
-    } else if (received == -2) {
-      origen_log(LOG_ERROR, "Miscompare on pin %s, expected %d received Z", pin_name, expected);
-    } else {
-      origen_log(LOG_ERROR, "Miscompare on pin %s, expected %d received X", pin_name, expected);
-    }
+/// Called by the Verilator testbench every time a miscompare event occurs, this is a DPI import since
+/// Verilator does not support user-defined system tasks.
+/// The call can come from any of the model's threads while it is being evaluated, so the miscompare is
+/// just buffered here and then processed the next time that the bridge has control. The model must be
+/// built with --threads-dpi none so that the calls are serialized.
+void bridge_on_miscompare_dpi(const char * pin_name, int expected, int received) {
+  if (number_of_pending_miscompares < MAX_PENDING_MISCOMPARES) {
+    PendingMiscompare * m = &pending_miscompares[number_of_pending_miscompares];
+
+    (*m).pin_name = malloc(strlen(pin_name) + 1);
+    strcpy((*m).pin_name, pin_name);
+    (*m).expected = expected;
+    (*m).received = received;
+    number_of_pending_miscompares++;
+  } else {
+    dropped_miscompares++;
+  }
+}
 
-    error_count++;
+/// Processes the miscompares which have been buffered by bridge_on_miscompare_dpi, any which didn't fit
+/// in the buffer are still counted as errors
+static void process_pending_miscompares() {
+  for (int i = 0; i < number_of_pending_miscompares; i++) {
+    on_miscompare(pending_miscompares[i].pin_name, pending_miscompares[i].expected, pending_miscompares[i].received);
+    free(pending_miscompares[i].pin_name);
+  }
+  number_of_pending_miscompares = 0;
 
-    handle = vpi_handle_by_name(ORIGEN_SIM_TESTBENCH_CAT(ORIGEN_SIM_DEBUG_MODULE_CAT("errors")), NULL);
-    val.format = vpiIntVal;
-    val.value.integer = error_count;
-    vpi_put_value(handle, &val, NULL, vpiNoDelay);
-
-    if (error_count > max_errors) {
-      // If a transaction is currently open hold off aborting until after that has completed
-      // to enable a proper error message to be generated for it
-      if (transaction_open) {
-        max_errors_exceeded_during_transaction = true;
+  if (dropped_miscompares) {
+    origen_log(LOG_ERROR, "%d further miscompares occurred before the bridge could process them", dropped_miscompares);
+    for (int i = 0; i < dropped_miscompares; i++) {
+      if (match_loop_open) {
+        on_miscompare(NULL, 0, 0);
       } else {
-        on_max_errors_exceeded();
+        count_error();
       }
     }
+    dropped_miscompares = 0;
+  }
+}
 
-    // Store all errors during a transaction
-    if (transaction_open) {
-      if (transaction_error_count < MAX_TRANSACTION_ERRORS) {
-        Miscompare *miscompare = &miscompares[transaction_error_count];
+#ifdef ORIGEN_DPI
+// When built with ORIGEN_DPI the per-cycle loop is run by the testbench (see origen_dpi_loop in
+// origen.sv) rather than by VPI callbacks. The testbench calls the functions below to wait for the next
+// cycle and to apply its wave events, and the pin driver registers are given to it as bit vectors
+// rather than being set individually via VPI. VPI is still used for peek, poke and force.
 
-        (*miscompare).pin_name = malloc(strlen(pin_name) + 1);
-        strcpy((*miscompare).pin_name, pin_name);
-        (*miscompare).cycle = cycle_count;
-        (*miscompare).expected = expected;
-        (*miscompare).received = received;
-      }
-      transaction_error_count++;
+static void set_dpi_bit(uint32_t * vector, int index, int value) {
+  if (value) {
+    vector[index / 32] |= (1u << (index % 32));
+  } else {
+    vector[index / 32] &= ~(1u << (index % 32));
+  }
+}
+
+/// Called by the testbench before its loop starts with the number of pin drivers that it contains
+void bridge_dpi_init(int number_of_tb_pins) {
+  dpi_pin_state_words = (number_of_tb_pins + 31) / 32;
+  if (dpi_pin_state_words == 0) {
+    dpi_pin_state_words = 1;
+  }
+  dpi_data = (uint32_t *) calloc(dpi_pin_state_words, sizeof(uint32_t));
+  dpi_drive = (uint32_t *) calloc(dpi_pin_state_words, sizeof(uint32_t));
+  dpi_force0 = (uint32_t *) calloc(dpi_pin_state_words, sizeof(uint32_t));
+  dpi_force1 = (uint32_t *) calloc(dpi_pin_state_words, sizeof(uint32_t));
+  dpi_compare = (uint32_t *) calloc(dpi_pin_state_words, sizeof(uint32_t));
+  dpi_capture = (uint32_t *) calloc(dpi_pin_state_words, sizeof(uint32_t));
+  dpi_changed = (uint32_t *) calloc(dpi_pin_state_words, sizeof(uint32_t));
+}
+
+/// Called by the testbench for each of its pin drivers, giving its position in the state vectors and
+/// its init_drive parameter, drivers which are initialized to drive 0 or 1 start with that state
+void bridge_dpi_define_pin(const char * name, int index, int init_drive) {
+  if (index < MAX_DPI_PINS) {
+    dpi_pin_names[index] = malloc(strlen(name) + 1);
+    strcpy(dpi_pin_names[index], name);
+    if (index >= number_of_dpi_pins) {
+      number_of_dpi_pins = index + 1;
     }
+    if (init_drive == 0 || init_drive == 1) {
+      set_dpi_bit(dpi_drive, index, 1);
+      set_dpi_bit(dpi_data, index, init_drive);
+    }
+  }
+}
+
+/// Called by the testbench at the start of every cycle, this processes the messages from Origen until
+/// the next cycle is to be simulated and returns its period in simulation time units. The first call
+/// takes the place of bridge_init.
+void bridge_dpi_start_cycle(int64_t * period) {
+  if (!dpi_started) {
+    dpi_started = true;
+    bridge_init();
+  } else if (repeat) {
+    cycle_cb(NULL);
+  } else {
+    bridge_wait_for_msg(NULL);
+  }
+  *period = (int64_t) period_in_simtime_units;
+}
+
+/// Returns 1 and the time within the current cycle of the next wave event to be applied, or 0 if
+/// there are no more events in this cycle
+int bridge_dpi_next_event(int64_t * time) {
+  if (next_dpi_event < number_of_dpi_events) {
+    *time = (int64_t) dpi_events[next_dpi_event].time;
+    return 1;
   }
   return 0;
 }
 
+/// Called by the testbench at the time returned by bridge_dpi_next_event to apply all of the wave
+/// events at that time
+void bridge_dpi_apply_events() {
+  uint64_t t = now_ns();
+  uint64_t time = dpi_events[next_dpi_event].time;
+
+  if (number_of_pending_miscompares || dropped_miscompares) {
+    process_pending_miscompares();
+  }
+
+  while (next_dpi_event < number_of_dpi_events && dpi_events[next_dpi_event].time == time) {
+    DpiEvent * e = &dpi_events[next_dpi_event];
+
+    next_dpi_event++;
+    if (apply_wave_event((*e).wave_ix, (*e).event_ix, (*e).compare)) {
+      return;
+    }
+    stats.wave_callbacks++;
+  }
+  record_duration(&stats.wave_callback, now_ns() - t);
+}
+
+/// Gives the current pin driver state to the testbench, changed indicates which pins have been updated
+/// since the last call
+void bridge_dpi_pin_state(uint32_t * data, uint32_t * drive, uint32_t * force0, uint32_t * force1,
+                          uint32_t * compare, uint32_t * capture, uint32_t * changed) {
+  size_t bytes = sizeof(uint32_t) * dpi_pin_state_words;
+
+  memcpy(data, dpi_data, bytes);
+  memcpy(drive, dpi_drive, bytes);
+  memcpy(force0, dpi_force0, bytes);
+  memcpy(force1, dpi_force1, bytes);
+  memcpy(compare, dpi_compare, bytes);
+  memcpy(capture, dpi_capture, bytes);
+  memcpy(changed, dpi_changed, bytes);
+  memset(dpi_changed, 0, bytes);
+}
+#endif
+
 /// Defines which functions are callable from Verilog as system tasks
 void bridge_register_system_tasks() {
+#ifndef ORIGEN_VERILATOR
   s_vpi_systf_data tf_data;
 
   tf_data.type = vpiSysTask;
@@ -1149,4 +3683,5 @@ void bridge_register_system_tasks() {
   tf_data.calltf = bridge_on_miscompare;
   tf_data.compiletf = 0;
   vpi_register_systf(&tf_data);
+#endif
 }
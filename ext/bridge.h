@@ -6,6 +6,15 @@
 PLI_INT32 bridge_wait_for_msg(p_cb_data);
 PLI_INT32 bridge_init(void);
 PLI_INT32 bridge_on_miscompare(PLI_BYTE8*);
+void bridge_on_miscompare_dpi(const char*, int, int);
+#ifdef ORIGEN_DPI
+void bridge_dpi_init(int);
+void bridge_dpi_define_pin(const char*, int, int);
+void bridge_dpi_start_cycle(int64_t*);
+int bridge_dpi_next_event(int64_t*);
+void bridge_dpi_apply_events(void);
+void bridge_dpi_pin_state(uint32_t*, uint32_t*, uint32_t*, uint32_t*, uint32_t*, uint32_t*, uint32_t*);
+#endif
 void bridge_register_system_tasks(void);
 
 #endif
@@ -2,36 +2,105 @@
 /// This is responsible for abstracting the socket connection to the master
 /// Origen process
 ///
+#define _POSIX_C_SOURCE 200809L  // For getaddrinfo
 #include "client.h"
 #include <errno.h>
 #include <sys/types.h>
 #include <sys/socket.h>
 #include <sys/un.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <netdb.h>
 #include <unistd.h>
 #include <time.h>
 #include <string.h>
+#include <pthread.h>
+
+#define TCP_PREFIX "tcp://"
+#define RX_BUFFER_SIZE 65536
+#define RING_SIZE 256       // Must be a power of 2
+#define SPIN_ITERATIONS 2000
 
 static int sock;
 static uint64_t msg_count = 0;
 static uint64_t last_msg_count = 0;
 
-/// Connects to the Origen app's socket
-int client_connect(char * socketId) {
-  int len;
-  struct sockaddr_un remote;
+// Messages are read from the socket in blocks and then handed out one at a time from here, this
+// means that a batch of messages sent by Origen in one write costs one read rather than one per
+// message
+static char rx_buffer[RX_BUFFER_SIZE];
+static int rx_start = 0;
+static int rx_end = 0;
+
+// Messages are received and decoded by a reader thread and passed to the simulator thread via this
+// single-producer/single-consumer ring. The head is only written by the reader and the tail only by
+// the simulator, each keeps a cached copy of the other's index so that the shared ones are only touched
+// when the ring appears to be empty or full. They are kept on separate cache lines for the same reason.
+// The simulator only blocks on the condition variable when the ring is empty.
+static Message ring[RING_SIZE];
+static uint32_t ring_head __attribute__((aligned(64))) = 0;
+static uint32_t ring_tail __attribute__((aligned(64))) = 0;
+static int consumer_waiting __attribute__((aligned(64))) = 0;
+static pthread_mutex_t ring_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t ring_cond = PTHREAD_COND_INITIALIZER;
+
+// Reader thread state
+static uint32_t reader_head = 0;           // The next slot to be filled, published to ring_head in batches
+static uint32_t reader_cached_tail = 0;
+static int unpublished = 0;
+
+// Simulator thread state
+static uint32_t consumer_tail = 0;         // The slot currently held by the simulator
+static uint32_t consumer_cached_head = 0;
+static bool consumer_holds_slot = false;
+static bool connection_failed = false;
+static bool threaded = false;
+
+static int connect_unix(char*);
+static int connect_tcp(char*);
+static int start_reader(void);
+static void * reader(void*);
+static int read_message(Message*);
+static void decode_message(Message*, char*, int);
+static void publish(void);
 
+/// Connects to the Origen app's socket, this is either the path to a UNIX domain socket or a
+/// TCP address when the simulator is running on a different host to Origen:
+///
+///   /tmp/12345.sock
+///   tcp://farm0123:40123/<token>
+///
+/// Over TCP the token is sent to Origen as the first line, Origen drops connections which don't present it
+int client_connect(char * socketId) {
   if (socketId == NULL) {
     printf("ERROR: No socket ID given to the simulator\n");
     return 1;
   }
 
+  if (strncmp(socketId, TCP_PREFIX, strlen(TCP_PREFIX)) == 0) {
+    if (connect_tcp(socketId + strlen(TCP_PREFIX))) {
+      return 1;
+    }
+  } else {
+    if (connect_unix(socketId)) {
+      return 1;
+    }
+  }
+  return start_reader();
+}
+
+
+static int connect_unix(char * path) {
+  int len;
+  struct sockaddr_un remote;
+
   if ((sock = socket(AF_UNIX, SOCK_STREAM, 0)) == -1) {
     perror("ERROR: The simulator failed to create a socket!");
     return 1;
   }
 
   remote.sun_family = AF_UNIX;
-  strcpy(remote.sun_path, socketId);
+  strcpy(remote.sun_path, path);
   len = offsetof(struct sockaddr_un, sun_path) + strlen(remote.sun_path) + 1;
 
   if (connect(sock, (struct sockaddr *)&remote, len) == -1) {
@@ -43,6 +112,72 @@ int client_connect(char * socketId) {
 }
 
 
+/// Connects to Origen over TCP given an address in the form host:port/token
+static int connect_tcp(char * address) {
+  struct addrinfo hints;
+  struct addrinfo * results;
+  struct addrinfo * r;
+  char host[256];
+  char port[16];
+  char token[128];
+  char * port_start = strrchr(address, ':');
+  char * token_start = port_start ? strchr(port_start, '/') : NULL;
+  int flag = 1;
+  int err;
+
+  if (port_start == NULL || token_start == NULL || (size_t)(port_start - address) >= sizeof(host) ||
+      (size_t)(token_start - port_start - 1) >= sizeof(port) || strlen(token_start + 1) + 2 > sizeof(token)) {
+    printf("ERROR: Invalid TCP address given to the simulator: %s\n", address);
+    return 1;
+  }
+  strncpy(host, address, port_start - address);
+  host[port_start - address] = '\0';
+  strncpy(port, port_start + 1, token_start - port_start - 1);
+  port[token_start - port_start - 1] = '\0';
+  sprintf(token, "%s\n", token_start + 1);
+
+  memset(&hints, 0, sizeof(hints));
+  hints.ai_family = AF_UNSPEC;
+  hints.ai_socktype = SOCK_STREAM;
+
+  err = getaddrinfo(host, port, &hints, &results);
+  if (err) {
+    printf("ERROR: The simulator failed to resolve %s: %s\n", address, gai_strerror(err));
+    return 1;
+  }
+
+  sock = -1;
+  for (r = results; r != NULL; r = (*r).ai_next) {
+    sock = socket((*r).ai_family, (*r).ai_socktype, (*r).ai_protocol);
+    if (sock == -1) {
+      continue;
+    }
+    if (connect(sock, (*r).ai_addr, (*r).ai_addrlen) == 0) {
+      break;
+    }
+    close(sock);
+    sock = -1;
+  }
+  freeaddrinfo(results);
+
+  if (sock == -1) {
+    perror("ERROR: The simulator failed to connect to Origen's socket!");
+    return 1;
+  }
+
+  // Replies are only sent when Origen is waiting for them, so don't let them sit in the kernel
+  // waiting to be coalesced with data which is not coming
+  setsockopt(sock, IPPROTO_TCP, TCP_NODELAY, &flag, sizeof(flag));
+
+  if (client_put(token)) {
+    perror("ERROR: The simulator failed to send its token to Origen!");
+    return 1;
+  }
+
+  return 0;
+}
+
+
 /// Returns true if the server has sent at least one message since the last time
 /// this was called, it will always return true the very first time it is called.
 /// The caller is responsible for setting the calling interval and therefore
@@ -64,35 +199,243 @@ bool is_server_alive() {
 /// NOTE: THE CALLER IS RESPONSIBLE FOR ADDING A \n TERMINATOR TO
 ///       THE MESSAGE
 int client_put(char* data) {
-  if(send(sock, data , strlen(data), 0) < 0) {
+  size_t len = strlen(data);
+  size_t sent = 0;
+  ssize_t n;
+
+  // A stream socket may accept only part of a large message, e.g. a bulk capture over TCP
+  while (sent < len) {
+    n = send(sock, &data[sent], len - sent, 0);
+    if (n < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return 1;
+    }
+    sent += n;
+  }
+  return 0;
+}
+
+
+/// Starts the thread which receives and decodes the messages from Origen, this makes no VPI calls
+/// so that the simulator is only ever called from its own thread.
+/// The thread can only overlap with the simulation when there is a spare core, so otherwise the
+/// messages are received and decoded by the simulator thread as they are needed. This can be
+/// overridden by setting ORIGEN_SIM_READER_THREAD to 0 or 1.
+static int start_reader() {
+  pthread_t thread;
+  char * setting = getenv("ORIGEN_SIM_READER_THREAD");
+
+  if (setting) {
+    threaded = atoi(setting) != 0;
+  } else {
+    threaded = sysconf(_SC_NPROCESSORS_ONLN) > 1;
+  }
+  if (!threaded) {
+    return 0;
+  }
+
+  if (pthread_create(&thread, NULL, reader, NULL)) {
+    printf("ERROR: The simulator failed to start the client's reader thread!\n");
     return 1;
   }
+  pthread_detach(thread);
   return 0;
 }
 
 
-/// Get the next message from the master Origen application process.
-/// Blocks until a complete message is received and will be returned in the
-/// supplied data array
-int client_get(int max_size, char* data) {
-  int len;
+static void * reader(void * arg) {
+  UNUSED(arg);
+  struct timespec backoff = {0, 20000};
+  bool failed = false;
 
-  while (1) {
-    // Have a look at what is available
-    len = recv(sock, data, max_size, MSG_PEEK);
-    if (len < 0) {
-      return 1;
+  while (!failed) {
+    // Wait for the simulator to free up a slot if it has fallen behind
+    if (reader_head - reader_cached_tail == RING_SIZE) {
+      publish();
+      while ((reader_cached_tail = __atomic_load_n(&ring_tail, __ATOMIC_ACQUIRE)) + RING_SIZE == reader_head) {
+        nanosleep(&backoff, NULL);
+      }
+    }
+
+    Message * m = &ring[reader_head & (RING_SIZE - 1)];
+    failed = read_message(m) != 0;
+    (*m).error = failed;
+    if (failed) {
+      (*m).length = 0;
+      (*m).argc = 0;
+      (*m).text[0] = '\0';
+    }
+    reader_head++;
+    // Publish in small batches, anything outstanding is also published before blocking on the socket
+    if (++unpublished == 16 || failed) {
+      publish();
     }
+  }
+  return NULL;
+}
+
+
+/// Makes the messages decoded so far available to the simulator, waking it up if it is waiting
+static void publish() {
+  if (unpublished) {
+    unpublished = 0;
+    __atomic_store_n(&ring_head, reader_head, __ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&consumer_waiting, __ATOMIC_SEQ_CST)) {
+      pthread_mutex_lock(&ring_lock);
+      pthread_cond_signal(&ring_cond);
+      pthread_mutex_unlock(&ring_lock);
+    }
+  }
+}
 
+
+/// Receives the next message from the socket and decodes it into the given message
+static int read_message(Message * m) {
+  int len;
+
+  while (1) {
     // See if we have a complete msg yet (by looking for a terminator)
-    for (int i = 0; i < len; i++) {
-      if (data[i] == '\n') {
+    for (int i = rx_start; i < rx_end; i++) {
+      if (rx_buffer[i] == '\n') {
+        len = i - rx_start;
+        if (len >= MAX_MESSAGE_LENGTH) {
+          printf("ERROR: Received a message longer than %d characters\n", MAX_MESSAGE_LENGTH - 1);
+          return 1;
+        }
         // If so then pull that message out and return it
-        recv(sock, data, i + 1, 0);
-        data[i] = '\0';
-        msg_count++;
+        decode_message(m, &rx_buffer[rx_start], len);
+        rx_start = i + 1;
         return 0;
-      } 
+      }
+    }
+
+    // Make room for more, keeping any partial message that has been received
+    if (rx_start > 0) {
+      memmove(rx_buffer, &rx_buffer[rx_start], rx_end - rx_start);
+      rx_end -= rx_start;
+      rx_start = 0;
+    }
+    if (rx_end == RX_BUFFER_SIZE) {
+      printf("ERROR: Received a message longer than %d characters\n", MAX_MESSAGE_LENGTH - 1);
+      return 1;
     }
+
+    // Don't hold anything back from the simulator while waiting for more
+    if (threaded) {
+      publish();
+    }
+    len = recv(sock, &rx_buffer[rx_end], RX_BUFFER_SIZE - rx_end, 0);
+    if (len < 0 && errno == EINTR) {
+      continue;
+    }
+    if (len <= 0) {
+      return 1;
+    }
+    rx_end += len;
+  }
+}
+
+
+/// Copies the given message text of the given length into the message, splitting it into its
+/// arguments as it goes
+static void decode_message(Message * m, char * text, int length) {
+  bool in_arg = false;
+
+  (*m).length = length;
+  (*m).argc = 0;
+  (*m).next_arg = 0;
+  for (int i = 0; i < length; i++) {
+    if (text[i] == '^') {
+      (*m).text[i] = '\0';
+      in_arg = false;
+    } else {
+      (*m).text[i] = text[i];
+      if (!in_arg) {
+        (*m).args[(*m).argc++] = i;
+        in_arg = true;
+      }
+    }
+  }
+  (*m).text[length] = '\0';
+}
+
+
+/// Get the next message from the master Origen application process.
+/// Blocks until a complete message is received and returns it, or NULL if the connection has failed.
+/// The message remains valid until the next call.
+Message * client_get_message() {
+  Message * m;
+
+  if (connection_failed) {
+    return NULL;
+  }
+
+  if (!threaded) {
+    m = &ring[0];
+    if (read_message(m)) {
+      connection_failed = true;
+      return NULL;
+    }
+    (*m).next_arg = 0;
+    msg_count++;
+    return m;
+  }
+
+  // Hand the previous message's slot back to the reader
+  if (consumer_holds_slot) {
+    consumer_tail++;
+    __atomic_store_n(&ring_tail, consumer_tail, __ATOMIC_RELEASE);
+    consumer_holds_slot = false;
+  }
+
+  if (consumer_cached_head == consumer_tail) {
+    // Origen usually has more messages queued, so briefly spin before going to sleep
+    for (int i = 0; i < SPIN_ITERATIONS; i++) {
+      consumer_cached_head = __atomic_load_n(&ring_head, __ATOMIC_ACQUIRE);
+      if (consumer_cached_head != consumer_tail) {
+        break;
+      }
+    }
+    if (consumer_cached_head == consumer_tail) {
+      pthread_mutex_lock(&ring_lock);
+      __atomic_store_n(&consumer_waiting, 1, __ATOMIC_SEQ_CST);
+      while ((consumer_cached_head = __atomic_load_n(&ring_head, __ATOMIC_SEQ_CST)) == consumer_tail) {
+        pthread_cond_wait(&ring_cond, &ring_lock);
+      }
+      __atomic_store_n(&consumer_waiting, 0, __ATOMIC_SEQ_CST);
+      pthread_mutex_unlock(&ring_lock);
+    }
+  }
+
+  m = &ring[consumer_tail & (RING_SIZE - 1)];
+  consumer_holds_slot = true;
+  if ((*m).error) {
+    connection_failed = true;
+    return NULL;
+  }
+  (*m).next_arg = 0;
+  msg_count++;
+  return m;
+}
+
+
+/// Returns the next argument of the given message, or NULL if there are no more
+char * client_next_arg(Message * m) {
+  if ((*m).next_arg < (*m).argc) {
+    return &(*m).text[(*m).args[(*m).next_arg++]];
+  }
+  return NULL;
+}
+
+
+/// Writes the original text of the given message to buf, which must be at least MAX_MESSAGE_LENGTH
+/// long, and returns it
+char * client_message_text(Message * m, char * buf) {
+  for (int i = 0; i < (*m).length; i++) {
+    buf[i] = (*m).text[i] ? (*m).text[i] : '^';
   }
+  buf[(*m).length] = '\0';
+  return buf;
 }
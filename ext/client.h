@@ -3,8 +3,25 @@
 
 #include "common.h"
 
+// The maximum length of a message from Origen, including the terminator
+#define MAX_MESSAGE_LENGTH 1024
+#define MAX_MESSAGE_ARGS (MAX_MESSAGE_LENGTH / 2)
+
+/// A message from Origen which has been split into its arguments by the client's reader thread,
+/// the first argument is the opcode. Empty arguments are skipped in the same way as strtok would.
+typedef struct Message {
+  bool error;                        // Set if the connection to Origen failed rather than a message being received
+  int length;                        // The length of the original message
+  int argc;
+  int next_arg;                      // The index of the next argument to be returned by client_next_arg
+  uint16_t args[MAX_MESSAGE_ARGS];   // The offset of each argument within the text
+  char text[MAX_MESSAGE_LENGTH];     // The message with each '^' replaced by a terminator
+} Message;
+
 int client_connect(char *);
-int client_get(int, char*);
+Message * client_get_message(void);
+char * client_next_arg(Message*);
+char * client_message_text(Message*, char*);
 int client_put(char*);
 bool is_server_alive(void);
 
@@ -101,9 +101,14 @@ PLI_INT32 origen_startup(p_cb_data data) {
     return err;
   }
 
+#ifdef ORIGEN_DPI
+  // The server will be started by the testbench's DPI loop
+  return 0;
+#else
   // Start the server to listen for commands from an Origen application and apply them via VPI,
   // this will run until it receives a complete message from the Origen app
   return bridge_init();
+#endif
 }
 
 
@@ -0,0 +1,63 @@
+///
+/// This is the main program for a Verilator build of the testbench, Verilator models have no
+/// simulation kernel of their own so this provides the scheduling of the VPI callbacks that the
+/// bridge relies on.
+///
+/// The model must be built with --vpi --public-flat-rw so that the bridge can access the testbench
+/// and DUT by name. Multi-threaded models (--threads N) are supported since all VPI callbacks are
+/// called from this thread between evaluations of the model.
+///
+#include "verilated.h"
+#include "verilated_vpi.h"
+#include "Vorigen.h"
+#include <memory>
+
+extern "C" {
+  extern void (*vlog_startup_routines[])(void);
+}
+
+// Calls the value change callbacks until the model is stable, the bridge may update the testbench
+// from within them so the model is re-evaluated after each round
+static void settle(Vorigen * top) {
+  top->eval();
+  while (VerilatedVpi::callValueCbs()) {
+    top->eval();
+  }
+}
+
+int main(int argc, char ** argv) {
+  const std::unique_ptr<VerilatedContext> context{new VerilatedContext};
+  context->commandArgs(argc, argv);
+  const std::unique_ptr<Vorigen> top{new Vorigen{context.get()}};
+
+  for (int i = 0; vlog_startup_routines[i]; i++) {
+    vlog_startup_routines[i]();
+  }
+
+  // The bridge connects to Origen and processes the messages up to the first cycle from here
+  VerilatedVpi::callCbs(cbStartOfSimulation);
+  settle(top.get());
+
+  while (!context->gotFinish()) {
+    // Advance to the earliest of the next callback requested by the bridge (e.g. a wave event or the
+    // end of the current cycle) and the next event scheduled within the model
+    uint64_t next = VerilatedVpi::cbNextDeadline();
+    if (top->eventsPending() && top->nextTimeSlot() < next) {
+      next = top->nextTimeSlot();
+    }
+    if (next == ~0ULL) {
+      break;
+    }
+    if (next > context->time()) {
+      context->time(next);
+    }
+    VerilatedVpi::callTimedCbs();
+    settle(top.get());
+    VerilatedVpi::callCbs(cbReadWriteSynch);
+    settle(top.get());
+  }
+
+  VerilatedVpi::callCbs(cbEndOfSimulation);
+  top->final();
+  return 0;
+}
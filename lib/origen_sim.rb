@@ -5,6 +5,7 @@ require 'origen_sim/origen_testers/api'
 require 'origen_sim/origen/pins/pin'
 require 'origen_sim/origen/top_level'
 require 'origen_sim/origen/application/runner'
+require 'origen_sim/origen/generator/job'
 module OrigenSim
   NUMBER_OF_COMMENT_LINES = 10
 
@@ -98,6 +99,10 @@ module OrigenSim
     Tester.new(options.merge(vendor: :icarus), &block)
   end
 
+  def self.verilator(options = {}, &block)
+    Tester.new(options.merge(vendor: :verilator), &block)
+  end
+
   def self.verbose=(val)
     @verbose = val
   end
@@ -209,6 +214,46 @@ module OrigenSim
     simulator.error(message)
   end
 
+  # When set to true, the message stream sent to the simulator will be recorded so that it
+  # can be replayed later via the sim:replay command
+  def self.record=(val)
+    @record = val
+  end
+
+  def self.record
+    @record
+  end
+
+  # When set to a number of cycles, the simulation will only dump waves within a window of that
+  # many cycles either side of each failure recorded by the previous simulation of the same pattern
+  def self.fail_waves=(val)
+    @fail_waves = val
+  end
+
+  def self.fail_waves
+    @fail_waves
+  end
+
+  # When set to true, the time spent generating and simulating each part of the pattern will be
+  # measured and reported at the end of the simulation, see OrigenSim::Profiler
+  def self.profile=(val)
+    @profile = val
+  end
+
+  def self.profile
+    @profile
+  end
+
+  # When set to true, patterns will always be simulated even if they have passed previously, see
+  # OrigenSim::ResultCache
+  def self.rerun=(val)
+    @rerun = val
+  end
+
+  def self.rerun
+    @rerun
+  end
+
   # Change where sim_delay and sim_capture records are stored
   def self.capture_dir=(val)
     @capture_dir = val
@@ -236,6 +281,18 @@ module OrigenSim
     tester.simulator.complete_simulation(name)
   end
 
+  # Replays a recording of a previous simulation into a new simulation, see Simulator#replay
+  def self.replay(file, options = {})
+    Origen.load_application
+    Origen.app.load_target!
+
+    unless tester.simulator?
+      Origen.app!.fail!(message: 'OrigenSim.replay cannot be used when the simulator is not the current tester!')
+    end
+
+    tester.simulator.replay(file)
+  end
+
   def self.run_source(source, options = {})
     OrigenSim.run(source) do
       OrigenTesters::Decompiler.decompile(source).execute
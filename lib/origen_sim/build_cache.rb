@@ -0,0 +1,176 @@
+require 'digest'
+require 'fileutils'
+require 'shellwords'
+require 'yaml'
+module OrigenSim
+  # A content-addressed cache for the outputs of sim:build (the testbench, VPI sources and pin
+  # definitions) and for the compiled simulation snapshots that are built from them.
+  #
+  # Entries are stored under <dir>/<kind>/<key>/, where the key is a SHA256 digest of everything
+  # that can affect the output. For a testbench this is the content of the RTL files, the build
+  # options (defines, pin options, etc.) and the OrigenSim sources and version. For a snapshot it is
+  # the testbench key plus the compile command and the content of the files that it compiles.
+  #
+  # The cache lives in ~/.origen/origen_sim/build_cache by default, this can be changed by
+  # setting ORIGEN_SIM_BUILD_CACHE in the environment.
+  module BuildCache
+    # The name of the file written to the sim:build output directory containing the key of the
+    # testbench, this can be used by build scripts to cache their compiled snapshots
+    KEY_FILE = 'origen_sim_build.key'
+
+    def self.dir
+      ENV['ORIGEN_SIM_BUILD_CACHE'] || "#{Dir.home}/.origen/origen_sim/build_cache"
+    end
+
+    # Returns the key for a sim:build of the given RTL files with the given options
+    def self.testbench_key(files, options)
+      digest = Digest::SHA256.new
+      digest << OrigenSim::VERSION
+      files.sort.each { |f| digest_file(digest, f) }
+      (options[:incl_files] || []).each { |f| digest_file(digest, f) if File.exist?(f) }
+      options.reject { |k, _v| k == :output || k == :debugger }.sort_by { |k, _v| k.to_s }.each do |k, v|
+        digest << "#{k}=#{v.inspect}\n"
+      end
+      Dir.glob("#{Origen.root!}/{ext,templates/rtl_v}/**/*").sort.each do |f|
+        digest_file(digest, f) if File.file?(f)
+      end
+      digest.hexdigest
+    end
+
+    # Returns the key for a snapshot compiled from the testbench with the given key by the given
+    # compile command. The content of the files compiled by the command is included, see compile_inputs,
+    # along with any extra inputs which can't be found from the command, these can be files or directories.
+    def self.snapshot_key(testbench_key, compile_cmd, extra_inputs = [])
+      digest = Digest::SHA256.new
+      digest << "#{testbench_key}\n#{compile_cmd}\n"
+      files = compile_inputs(compile_cmd)
+      extra_inputs.each do |input|
+        files += File.directory?(input) ? Dir.glob("#{input}/**/*").select { |f| File.file?(f) } : [input]
+      end
+      files.map { |f| File.expand_path(f) }.uniq.sort.each do |f|
+        if File.file?(f)
+          digest_file(digest, f)
+        else
+          digest << "#{f} missing\n"
+        end
+      end
+      digest.hexdigest
+    end
+
+    # Returns the files which are read by the given compile command, these are found by resolving its
+    # file lists (-f, -F), library files and directories (-v, -y) and include directories (+incdir+),
+    # plus any of its other arguments which are existing files. Environment variables within the
+    # file lists are expanded.
+    def self.compile_inputs(compile_cmd, base_dir = Dir.pwd, seen = {})
+      files = []
+      args = Shellwords.split(compile_cmd) rescue compile_cmd.split(/\s+/)
+      while (arg = args.shift)
+        case arg
+        when '-f', '-F', '-file'
+          list = resolve_input_path(args.shift, base_dir)
+          next if !list || seen[list]
+          seen[list] = true
+          files << list
+          if File.file?(list)
+            content = File.read(list).gsub(%r{//.*$}, '').gsub(/#.*$/, '')
+            files += compile_inputs(content, arg == '-F' ? File.dirname(list) : base_dir, seen)
+          end
+        when '-v'
+          f = resolve_input_path(args.shift, base_dir)
+          files << f if f
+        when '-y'
+          dir = resolve_input_path(args.shift, base_dir)
+          files += Dir.glob("#{dir}/*").select { |f| File.file?(f) } if dir
+        when /^\+incdir\+(.*)/
+          Regexp.last_match(1).split('+').each do |d|
+            dir = resolve_input_path(d, base_dir)
+            files += Dir.glob("#{dir}/*").select { |f| File.file?(f) } if dir
+          end
+        else
+          f = resolve_input_path(arg, base_dir)
+          files << f if f && File.file?(f)
+        end
+      end
+      files
+    end
+
+    def self.resolve_input_path(path, base_dir)
+      return nil unless path
+      path = path.gsub(/\$\{?(\w+)\}?/) { ENV[Regexp.last_match(1)] || '' }
+      File.expand_path(path, base_dir)
+    end
+
+    # Copies the cached entry of the given kind (:testbench or :snapshot) and key into the given
+    # directory, returns false if there is no such entry
+    def self.fetch(kind, key, dest)
+      entry = entry_dir(kind, key)
+      if File.exist?("#{entry}/.complete")
+        FileUtils.mkdir_p(dest)
+        Dir.glob("#{entry}/*", File::FNM_DOTMATCH).each do |f|
+          next if %w(. .. .complete meta.yml).include?(File.basename(f))
+          FileUtils.cp_r(f, dest, preserve: true)
+        end
+        record(:hits)
+        Origen.log.info "Build cache hit for #{kind} #{key[0..11]}"
+        true
+      else
+        record(:misses)
+        Origen.log.info "Build cache miss for #{kind} #{key[0..11]}"
+        false
+      end
+    end
+
+    # Returns the metadata stored with the given cache entry
+    def self.meta(kind, key)
+      f = "#{entry_dir(kind, key)}/meta.yml"
+      File.exist?(f) ? YAML.load_file(f) : {}
+    end
+
+    # Stores the given files and directories as the entry of the given kind and key, along with
+    # an optional hash of metadata
+    def self.store(kind, key, paths, meta = {})
+      entry = entry_dir(kind, key)
+      tmp = "#{entry}.#{Process.pid}.tmp"
+      FileUtils.rm_rf(tmp)
+      FileUtils.mkdir_p(tmp)
+      paths.each { |p| FileUtils.cp_r(p, tmp, preserve: true) }
+      File.write("#{tmp}/meta.yml", meta.to_yaml)
+      FileUtils.touch("#{tmp}/.complete")
+      # Make the new entry visible atomically so that concurrent builds never see a partial one
+      FileUtils.rm_rf(entry)
+      File.rename(tmp, entry)
+    rescue SystemCallError => e
+      FileUtils.rm_rf(tmp)
+      Origen.log.warning "Failed to store #{kind} #{key[0..11]} in the build cache: #{e.message}"
+    end
+
+    # Returns the cumulative number of cache hits and misses, e.g. { hits: 10, misses: 2 }
+    def self.stats
+      f = "#{dir}/stats.yml"
+      saved = File.exist?(f) ? (YAML.load_file(f) || {}) : {}
+      { hits: saved['hits'].to_i, misses: saved['misses'].to_i }
+    end
+
+    def self.clear
+      FileUtils.rm_rf(dir)
+    end
+
+    def self.entry_dir(kind, key)
+      "#{dir}/#{kind}/#{key}"
+    end
+
+    def self.record(type)
+      s = stats
+      s[type] += 1
+      FileUtils.mkdir_p(dir)
+      File.write("#{dir}/stats.yml", { 'hits' => s[:hits], 'misses' => s[:misses] }.to_yaml)
+    rescue SystemCallError
+      # The stats are only informational, never fail a build because of them
+    end
+
+    def self.digest_file(digest, file)
+      digest << "#{File.basename(file)}\n"
+      digest.file(file)
+    end
+  end
+end
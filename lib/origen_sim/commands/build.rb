@@ -2,6 +2,7 @@ require 'optparse'
 require 'origen_sim'
 require_relative '../../../config/version'
 require 'origen_verilog'
+require 'origen_sim/build_cache'
 
 options = {
   incl_files:              [],
@@ -38,11 +39,18 @@ Usage: origen sim:build TOP_LEVEL_VERILOG_FILE [options]
     options[:source_dirs] << path
   end
   opts.on('--sv', 'Generate a .sv file instead of a .v file.') { |t| options[:sv] = t; options[:file_type] = :sv }
+  opts.on('--dpi', 'Run the per-cycle loop in the testbench via DPI rather than via VPI callbacks (implies --sv, not supported by Icarus)') do |t|
+    options[:dpi] = t
+    options[:sv] = t
+    options[:file_type] = :sv
+  end
   opts.on('--wreal', 'Enable real number modeling support on DUT pins defined as real wires (wreal)') { |t| options[:wreal] = t }
   opts.on('--wrealavg', 'Enable real number modeling support on DUT pins defined as real wires - averaged (wrealavg)') { |t| options[:wrealavg] = t }
   opts.on('--verilog_top_output_name NAME', 'Renames the output filename from origen.v to NAME.v') do |name|
     options[:verilog_top_output_name] = name
   end
+  opts.on('--no_cache', 'Always build the testbench, rather than re-using a cached one built from identical inputs') { options[:no_cache] = true }
+  opts.on('--dump_off', 'Start simulations with wave dumping disabled, it can then be enabled at runtime via tester.dump_on') { |t| options[:dump_off] = t }
   opts.on('--define MACRO', 'Specify a compiler define') do |macro|
     options[:defines] << macro
   end
@@ -72,7 +80,8 @@ Usage: origen sim:build TOP_LEVEL_VERILOG_FILE [options]
     options[:other_pins] << str_or_regex
   end
   opts.on('--include FILE', 'Specify files to include in the top verilog file.') { |f| options[:incl_files] << f }
-  opts.on('--vendor VENDOR', 'Specify the target vendor (Cadence, Synopsis, Icarus') { |v| options[:vendor] = v.downcase.to_sym }
+  opts.on('--vendor VENDOR', 'Specify the target vendor (Cadence, Synopsis, Icarus, Verilator') { |v| options[:vendor] = v.downcase.to_sym }
+  opts.on('--threads N', Integer, 'Number of threads to build a multi-threaded Verilator model with (default 1)') { |n| options[:threads] = n }
   opts.on('--passthrough SWITCHES', 'Raw switches that will be ignored by OrigenSim, but appear in the final build command') { |s| options[:passthrough] << s }
 
   # Specifying snapshot details
@@ -155,92 +164,117 @@ end
 files = ARGV.join(' ')
 rtl_top = files.split(/\s+/).last
 
-ast = OrigenVerilog.parse_file(files, options)
+output_directory = options[:output] || Origen.config.output_directory
+output_name = options[:sv] ? "#{options[:verilog_top_output_name]}.sv" : "#{options[:verilog_top_output_name]}.v"
 
-unless ast
-  puts 'Sorry, but the given top-level RTL file failed to parse'
-  _exit_fail_
+unless options[:no_cache] || $_testing_build_return_dut_
+  cache_key = OrigenSim::BuildCache.testbench_key(files.split(/\s+/), options.reject { |k, _v| k == :no_cache })
+  if OrigenSim::BuildCache.fetch(:testbench, cache_key, output_directory)
+    rtl_top_module = OrigenSim::BuildCache.meta(:testbench, cache_key)['rtl_top_module']
+  end
 end
 
-candidates = ast.top_level_modules
-candidates = ast.modules if candidates.empty?
+unless rtl_top_module
+  ast = OrigenVerilog.parse_file(files, options)
 
-if candidates.size == 0
-  puts "Sorry, couldn't find any Verilog module declarations in that file (this could be due to a parse error)"
-  _exit_fail_
-elsif candidates.size > 1
-  if options[:top_level_name]
-    mod = candidates.find { |c| c.name == options[:top_level_name] }
+  unless ast
+    puts 'Sorry, but the given top-level RTL file failed to parse'
+    _exit_fail_
   end
-  unless mod
-    puts "Sorry, couldn't work out what the top-level module is, please help by running again and specifying it via the --top switch with one of the following names:"
-    candidates.each do |c|
-      puts "  #{c.name}"
-    end
+
+  candidates = ast.top_level_modules
+  candidates = ast.modules if candidates.empty?
+
+  if candidates.size == 0
+    puts "Sorry, couldn't find any Verilog module declarations in that file (this could be due to a parse error)"
     _exit_fail_
+  elsif candidates.size > 1
+    if options[:top_level_name]
+      mod = candidates.find { |c| c.name == options[:top_level_name] }
+    end
+    unless mod
+      puts "Sorry, couldn't work out what the top-level module is, please help by running again and specifying it via the --top switch with one of the following names:"
+      candidates.each do |c|
+        puts "  #{c.name}"
+      end
+      _exit_fail_
+    end
+  else
+    mod = candidates.first
   end
-else
-  mod = candidates.first
-end
 
-rtl_top_module = mod.name
+  rtl_top_module = mod.name
 
-mod.to_top_level(options) # Creates dut
+  mod.to_top_level(options) # Creates dut
 
-# Update the pins with any settings from the command line
-options[:initial_pin_states].each do |pin, state|
-  dut.pins(pin).meta[:origen_sim_init_pin_state] = state
+  # Update the pins with any settings from the command line
+  options[:initial_pin_states].each do |pin, state|
+    dut.pins(pin).meta[:origen_sim_init_pin_state] = state
+  end
+
+  if $_testing_build_return_dut_
+    dut
+  else
+    Origen.app.runner.launch action:            :compile,
+                             files:             "#{Origen.root!}/templates/rtl_v/origen.v.erb",
+                             output_file_name:  output_name,
+                             output:            output_directory,
+                             check_for_changes: false,
+                             quiet:             true,
+                             preserve_target:   true,
+                             options:           {
+                               vendor:            options[:vendor],
+                               top:               dut.name,
+                               testbench_name:    options[:testbench_name],
+                               incl:              options[:incl_files],
+                               device_name:       options[:device_name],
+                               revision:          options[:revision],
+                               revision_note:     options[:revision_note],
+                               parent_tb_version: options[:testbench_version],
+                               user_details:      options[:user_details],
+                               author:            options[:author],
+                               build_cmd:         build_cmd,
+                               file_type:         options[:file_type],
+                               testbench:         options[:testbench_name] || 'origen',
+                               top_level_name:    options[:top_level_name] || 'dut',
+                               finish_signal:     options[:finish_signal] || 'finish',
+                               debug_module_name: options[:debug_module_name] || 'debug',
+                               dump_off:          options[:dump_off],
+                               dpi:               options[:dpi]
+                             }
+
+    Origen.app.runner.launch action:            :compile,
+                             files:             "#{Origen.root!}/ext",
+                             output:            output_directory,
+                             check_for_changes: false,
+                             quiet:             true,
+                             options:           options
+
+    dut.export(rtl_top_module, dir: "#{output_directory}", namespace: nil)
+
+    if cache_key
+      outputs = [output_name, "#{rtl_top_module}.rb"] + Dir.glob("#{Origen.root!}/ext/*").map { |f| File.basename(f, '.erb') }
+      OrigenSim::BuildCache.store(:testbench, cache_key, outputs.map { |f| "#{output_directory}/#{f}" },
+                                  'rtl_top_module' => rtl_top_module)
+    end
+  end
 end
 
-if $_testing_build_return_dut_
-  dut
-
-else
-
-  output_directory = options[:output] || Origen.config.output_directory
-  output_name = options[:sv] ? "#{options[:verilog_top_output_name]}.sv" : "#{options[:verilog_top_output_name]}.v"
-
-  Origen.app.runner.launch action:            :compile,
-                           files:             "#{Origen.root!}/templates/rtl_v/origen.v.erb",
-                           output_file_name:  output_name,
-                           output:            output_directory,
-                           check_for_changes: false,
-                           quiet:             true,
-                           preserve_target:   true,
-                           options:           {
-                             vendor:            options[:vendor],
-                             top:               dut.name,
-                             testbench_name:    options[:testbench_name],
-                             incl:              options[:incl_files],
-                             device_name:       options[:device_name],
-                             revision:          options[:revision],
-                             revision_note:     options[:revision_note],
-                             parent_tb_version: options[:testbench_version],
-                             user_details:      options[:user_details],
-                             author:            options[:author],
-                             build_cmd:         build_cmd,
-                             file_type:         options[:file_type],
-                             testbench:         options[:testbench_name] || 'origen',
-                             top_level_name:    options[:top_level_name] || 'dut',
-                             finish_signal:     options[:finish_signal] || 'finish',
-                             debug_module_name: options[:debug_module_name] || 'debug'
-                           }
-
-  Origen.app.runner.launch action:            :compile,
-                           files:             "#{Origen.root!}/ext",
-                           output:            output_directory,
-                           check_for_changes: false,
-                           quiet:             true,
-                           options:           options
-
-  dut.export(rtl_top_module, dir: "#{output_directory}", namespace: nil)
+unless $_testing_build_return_dut_
+  if cache_key
+    File.write("#{output_directory}/#{OrigenSim::BuildCache::KEY_FILE}", cache_key + "\n")
+  else
+    # Don't leave the key of a previous build behind, sim:cache would then store or fetch a snapshot
+    # under a key that does not match this testbench
+    FileUtils.rm_f("#{output_directory}/#{OrigenSim::BuildCache::KEY_FILE}")
+  end
 
   SYNOPSYS_SWITCHES = %W(
     #{output_directory}/#{output_name}
     #{output_directory}/bridge.c
     #{output_directory}/client.c
     -P\ #{output_directory}/origen_tasks.tab
-    -CFLAGS\ "-std=c99 -DORIGEN_VCS"
+    -CFLAGS\ "-std=c99 -DORIGEN_VCS#{options[:dpi] ? ' -DORIGEN_DPI' : ''}"
     +vpi
     #{output_directory}/origen.c
     +define+ORIGEN_VCS
@@ -283,7 +317,7 @@ else
   CADENCE_SWITCHES = %W(
     #{output_directory}/#{output_name}
     #{output_directory}/*.c
-    -ccargs\ "-std=c99"
+    -ccargs\ "-std=c99#{options[:dpi] ? ' -DORIGEN_DPI' : ''}"
     -top\ origen
     -elaborate
     -snapshot\ origen
@@ -304,8 +338,31 @@ else
     )
   end
 
+  # Verilator builds the testbench into a C++ model which is linked with the VPI extension and with a main
+  # program that schedules the bridge's callbacks. The bridge calls must be serialized since it is not
+  # thread-safe, hence --threads-dpi none
+  VERILATOR_SWITCHES = %W(
+    #{output_directory}/#{output_name}
+    #{output_directory}/origen_vpi.a
+    #{output_directory}/verilator_main.cpp
+    --exe
+    --build
+    --vpi
+    --public-flat-rw
+    --timing
+    --top-module\ #{options[:testbench_name]}
+    --prefix\ Vorigen
+    --threads\ #{options[:threads] || 1}
+    --threads-dpi\ none
+    --trace
+    +define+ORIGEN_SIM_VERILATOR
+    +define+ORIGEN_VCD
+    -Wno-fatal
+    --Mdir\ obj_dir
+  )
+
   puts
-  if options[:vendor].nil? || options[:vendor] == :icarus
+  if (options[:vendor].nil? || options[:vendor] == :icarus) && !options[:dpi]
     puts
     puts '-----------------------------------------------------------'
     puts 'Icarus Verilog'
@@ -313,7 +370,7 @@ else
     puts
     puts 'Compile the VPI extension using the following command:'
     puts
-    puts "  cd #{output_directory} && #{ENV['ORIGEN_SIM_IVERILOG_VPI'] || 'iverilog-vpi'} *.c --name=origen && cd #{Pathname.pwd}"
+    puts "  cd #{output_directory} && #{ENV['ORIGEN_SIM_IVERILOG_VPI'] || 'iverilog-vpi'} *.c -lpthread --name=origen && cd #{Pathname.pwd}"
     puts
     puts 'Add the following to your build script (AND REMOVE ANY OTHER TESTBENCH!):'
     puts
@@ -330,6 +387,30 @@ else
     puts "  #{output_directory}/origen.vpi"
     puts '  origen.vvp'
   end
+  if options[:vendor].nil? || options[:vendor] == :verilator
+    puts
+    puts '-----------------------------------------------------------'
+    puts 'Verilator'
+    puts '-----------------------------------------------------------'
+    puts
+    puts 'Compile the VPI extension using the following command (Verilator compiles everything it is given as C++):'
+    puts
+    puts "  cd #{output_directory} && #{ENV['ORIGEN_SIM_CC'] || 'gcc'} -c -std=c99 -fPIC -DORIGEN_VERILATOR#{options[:dpi] ? ' -DORIGEN_DPI' : ''} bridge.c client.c origen.c && ar rcs origen_vpi.a bridge.o client.o origen.o && cd #{Pathname.pwd}"
+    puts
+    puts 'Add the following to your build script (AND REMOVE ANY OTHER TESTBENCH!):'
+    puts
+    VERILATOR_SWITCHES.each do |switch|
+      puts "  #{switch} \\"
+    end
+    puts
+    puts 'Here is an example which may work for the file you just parsed (add additional -I options at the end if required):'
+    puts
+    puts "  #{ENV['ORIGEN_SIM_VERILATOR'] || 'verilator'} #{rtl_top} -I#{Pathname.new(rtl_top).dirname} " + VERILATOR_SWITCHES.join(' ') + (options[:passthrough] ? " #{options[:passthrough].join(' ')}" : '')
+    puts
+    puts 'Copy the following file (produced by verilator) to simulation/<target>/verilator/. within your Origen application:'
+    puts
+    puts '  obj_dir/Vorigen'
+  end
   if options[:vendor].nil? || options[:vendor] == :synopsis
     puts
     puts '-----------------------------------------------------------'
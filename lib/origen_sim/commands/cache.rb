@@ -0,0 +1,69 @@
+require 'optparse'
+require 'origen_sim/build_cache'
+
+options = {}
+
+# App options are options that the application can supply to extend this command
+app_options = @application_options || []
+opt_parser = OptionParser.new do |opts|
+  opts.banner = <<-EOT
+Manage the cache of sim:build outputs and compiled simulation snapshots.
+
+The fetch and store actions allow a build script to re-use a snapshot which has already been compiled
+from identical inputs, the key is derived from the testbench key written by the last sim:build, the
+given compile command and the content of the files that it compiles. These are found by resolving the
+command's file lists (-f/-F), library files and directories (-v/-y) and include directories (+incdir+),
+any other inputs must be given via --input:
+
+  origen sim:cache fetch -s simulation/my_dut/icarus -c "$COMPILE_CMD" || \\
+    ($COMPILE_CMD && origen sim:cache store -s simulation/my_dut/icarus -c "$COMPILE_CMD")
+
+fetch exits with 0 on a cache hit and 1 on a miss.
+
+Usage: origen sim:cache fetch|store|stats|clear [options]
+  EOT
+  opts.on('-o', '--output DIR', String, 'The sim:build output directory (defaults to the application output directory)') { |d| options[:output] = d }
+  opts.on('-s', '--snapshot DIR', String, 'The directory containing the compiled snapshot') { |d| options[:snapshot] = d }
+  opts.on('-c', '--compile_cmd CMD', String, 'The command used to compile the snapshot') { |c| options[:compile_cmd] = c }
+  opts.on('-i', '--input PATH', String, 'An additional file or directory read by the compile, can be given multiple times') { |p| (options[:inputs] ||= []) << p }
+  opts.on('-d', '--debugger', 'Enable the debugger') {  options[:debugger] = true }
+  app_options.each do |app_option|
+    opts.on(*app_option) {}
+  end
+  opts.separator ''
+  opts.on('-h', '--help', 'Show this message') { puts opts; exit 0 }
+end
+
+opt_parser.parse! ARGV
+
+def snapshot_key(options)
+  key_file = "#{options[:output] || Origen.config.output_directory}/#{OrigenSim::BuildCache::KEY_FILE}"
+  unless File.exist?(key_file)
+    puts "No testbench key found at #{key_file}, run sim:build first"
+    exit 1
+  end
+  unless options[:snapshot]
+    puts 'A snapshot directory must be given via --snapshot'
+    exit 1
+  end
+  OrigenSim::BuildCache.snapshot_key(File.read(key_file).strip, options[:compile_cmd] || '', options[:inputs] || [])
+end
+
+case ARGV[0]
+when 'fetch'
+  exit(OrigenSim::BuildCache.fetch(:snapshot, snapshot_key(options), options[:snapshot]) ? 0 : 1)
+when 'store'
+  key = snapshot_key(options)
+  OrigenSim::BuildCache.store(:snapshot, key, Dir.glob("#{options[:snapshot]}/*", File::FNM_DOTMATCH).reject { |f| %w(. ..).include?(File.basename(f)) })
+  Origen.log.info "Stored snapshot #{key[0..11]} in the build cache"
+when 'stats'
+  stats = OrigenSim::BuildCache.stats
+  puts "Build cache: #{OrigenSim::BuildCache.dir}"
+  puts "  Hits:   #{stats[:hits]}"
+  puts "  Misses: #{stats[:misses]}"
+when 'clear'
+  OrigenSim::BuildCache.clear
+else
+  puts opt_parser
+  exit 1
+end
@@ -0,0 +1,74 @@
+module OrigenSim
+  # Writes pattern comments to a sidecar file alongside the wave file, this is used instead of
+  # poking them into the testbench's comment registers when the simulator is configured with
+  # comment_file: true.
+  #
+  # The file contains one comment line per line of text, each record contains the simulation time
+  # in ns at which the comment becomes active, the cycle number, the comment line number and the
+  # text, separated by tabs:
+  #
+  #   1200.0	30	0	Write register ctrl
+  #   1200.0	30	1	  Address: 0x1234
+  #
+  # All lines with the same time form a comment block which remains active until the next block.
+  #
+  # An index is also written to <file>.idx, this contains a record for every INDEX_INTERVAL blocks
+  # giving the time, cycle and byte offset of the block within the comment file so that tools can
+  # seek to a given time without having to read the whole file.
+  class CommentFile
+    INDEX_INTERVAL = 100
+
+    attr_reader :path
+
+    def initialize(path)
+      @path = path
+      @file = File.open(path, 'w')
+      @index = File.open("#{path}.idx", 'w')
+      @blocks = 0
+    end
+
+    # Write the given comment lines, these will replace any previous comment from the given time
+    def write(time_in_ns, cycle, lines)
+      if @blocks % INDEX_INTERVAL == 0
+        @index.puts "#{time_in_ns}\t#{cycle}\t#{@file.pos}"
+      end
+      @blocks += 1
+      lines.each_with_index do |line, i|
+        @file.puts "#{time_in_ns}\t#{cycle}\t#{i}\t#{line.to_s.gsub(/[\t\r\n]/, ' ')}"
+      end
+    end
+
+    def close
+      @file.close
+      @index.close
+    end
+
+    # Returns the lines of the comment which was active at the given time from the given comment file
+    def self.at(path, time_in_ns)
+      offset = 0
+      if File.exist?("#{path}.idx")
+        File.foreach("#{path}.idx") do |record|
+          t, _cycle, pos = *record.split("\t")
+          break if t.to_f > time_in_ns
+          offset = pos.to_i
+        end
+      end
+      lines = []
+      block_time = nil
+      File.open(path) do |f|
+        f.seek(offset)
+        f.each_line do |record|
+          t, _cycle, _line, text = *record.chomp.split("\t", 4)
+          t = t.to_f
+          break if t > time_in_ns
+          if t != block_time
+            block_time = t
+            lines = []
+          end
+          lines << text
+        end
+      end
+      lines
+    end
+  end
+end
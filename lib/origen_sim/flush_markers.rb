@@ -0,0 +1,36 @@
+require 'thread'
+module OrigenSim
+  # Included by the readers of the simulator's output streams to track the end-of-flush markers which
+  # the simulator emits on them, see Simulator#flush. The reader must call #init_flush_markers when it
+  # is created and #flush_marker_received whenever it reads a marker.
+  module FlushMarkers
+    # Blocks until the end-of-flush marker with the given ID (or a later one) has been read from
+    # the stream, returns false if it has not arrived within the given timeout
+    def wait_for_flush_marker(id, timeout)
+      deadline = Time.now + timeout
+      @flush_mutex.synchronize do
+        while @flush_marker < id
+          remaining = deadline - Time.now
+          return false if remaining <= 0
+          @flush_cv.wait(@flush_mutex, remaining)
+        end
+      end
+      true
+    end
+
+    private
+
+    def init_flush_markers
+      @flush_marker = 0
+      @flush_mutex = Mutex.new
+      @flush_cv = ConditionVariable.new
+    end
+
+    def flush_marker_received(id)
+      @flush_mutex.synchronize do
+        @flush_marker = id
+        @flush_cv.broadcast
+      end
+    end
+  end
+end
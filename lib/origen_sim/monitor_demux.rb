@@ -0,0 +1,47 @@
+require 'thread'
+module OrigenSim
+  # When the simulator is connected over TCP, the simulation monitor's status, stdout and stderr
+  # channels are multiplexed over a single connection, with each line tagged with the channel
+  # that it belongs to:
+  #
+  #   S - Status
+  #   O - The simulator's stdout
+  #   E - The simulator's stderr
+  #
+  # This splits them back out into separate IOs so that they can be consumed in the same way as the
+  # individual sockets which are used when the simulator is on the same host.
+  # The heartbeat is sent in the other direction over the same connection.
+  class MonitorDemux < Thread
+    CHANNELS = { 'S' => :status, 'O' => :stdout, 'E' => :stderr }
+
+    attr_reader :socket
+
+    def initialize(socket)
+      @socket = socket
+      @readers = {}
+      @writers = {}
+      CHANNELS.each_value do |channel|
+        @readers[channel], @writers[channel] = IO.pipe
+      end
+      super do
+        begin
+          while (line = @socket.gets)
+            if (channel = CHANNELS[line[0]])
+              @writers[channel].write(line[1..-1])
+            end
+          end
+        rescue IOError, SystemCallError
+          # The connection has been closed
+        ensure
+          # Let the readers see the end of their streams
+          @writers.each_value(&:close)
+        end
+      end
+    end
+
+    # Returns the IO from which the given channel (:status, :stdout or :stderr) can be read
+    def [](channel)
+      @readers[channel]
+    end
+  end
+end
@@ -0,0 +1,26 @@
+require 'origen/generator/job'
+module Origen
+  class Generator
+    # Override the Origen generator job to skip the simulation of patterns which have passed
+    # previously and not changed since then
+    class Job
+      alias_method :_orig_run, :run
+      def run
+        if options[:action] == :pattern && tester && tester.is_a?(OrigenSim::Tester) &&
+           tester.simulator.cached_pass?(File.basename(requested_pattern, '.*'), pattern_source_file)
+          return
+        end
+        _orig_run
+      end
+
+      private
+
+      def pattern_source_file
+        file = Origen.generator.pattern_finder.find(requested_pattern, options)
+        file.is_a?(String) ? file : nil
+      rescue StandardError
+        File.exist?(requested_pattern.to_s) ? requested_pattern.to_s : nil
+      end
+    end
+  end
+end
@@ -58,6 +58,7 @@ module Origen
       alias_method :_orig_drive, :drive
       def drive(*args)
         if _analog_pin_? && simulation_running? && tester.simulator.real?
+          stop_waveform if @waveform_active
           tester.poke("#{driver_net}.drive_en", 1)
           tester.poke("#{driver_net}.drive", args.first + 0.0)
         else
@@ -66,15 +67,57 @@ module Origen
       end
       alias_method :write, :drive
 
+      # Ramp the analog pin from one value to another over the given time, the drive value will
+      # be updated every :step ns (default 1/100th of the ramp time). The ramp runs concurrently with
+      # the pattern, so time must be allowed for it to complete, e.g. with tester.wait.
+      def ramp(from, to, time_in_ns, options = {})
+        pwl([[0, from], [time_in_ns, to]], options)
+      end
+
+      # Drive a piecewise-linear waveform on the analog pin, the points should be an array of
+      # [time_in_ns, value] pairs with the times given relative to the start of the waveform
+      def pwl(points, options = {})
+        if _analog_pin_? && simulation_running? && tester.simulator.real?
+          step = options[:step] || [points.last[0] / 100.0, 1].max
+          tester.simulator.analog_pwl(driver_net, points, step)
+          @waveform_active = true
+        end
+      end
+
+      # Drive a sine wave on the analog pin, by default it will continue until stop_waveform is called
+      # or the pin is driven to a new value
+      #
+      #   pin(:ana).sine(offset: 0.9, amplitude: 0.5, period: 1000)
+      def sine(options = {})
+        if _analog_pin_? && simulation_running? && tester.simulator.real?
+          period = options[:period] || fail('A :period (in ns) must be supplied to sine')
+          tester.simulator.analog_sine(driver_net, options[:offset] || 0, options[:amplitude] || 1, period,
+                                       options[:duration] || 0, options[:step] || period / 50.0)
+          @waveform_active = true
+        end
+      end
+
+      # Stop any waveform that is currently being applied to the analog pin, it will hold its current value
+      def stop_waveform
+        if _analog_pin_? && simulation_running? && tester.simulator.real?
+          tester.simulator.stop_analog_wave(driver_net)
+          @waveform_active = false
+        end
+      end
+
       alias_method :_orig_assert, :assert
-      def assert(*args)
+      def assert(*args, &block)
         if _analog_pin_? && simulation_running? && tester.simulator.real?
+          options = args.last.is_a?(Hash) ? args.last : {}
+          if options[:cycles] || block_given?
+            return measure_window(options, &block)
+          end
           drive_enabled = tester.peek("#{driver_net}.drive_en").to_i
           if drive_enabled == 1
             # tester.poke("#{driver_net}.drive_en", 0)
             # tester.cycle
           end
-          measured = tester.peek("#{driver_net}.pin", true)
+          tester.peek("#{driver_net}.pin", true)
           # Could implement checking/limits here in future
         else
           _orig_assert(*args)
@@ -85,10 +128,66 @@ module Origen
       alias_method :read, :assert
       alias_method :measure, :assert
 
+      # Measures the analog pin over a window of cycles, or over the execution of the given block, with
+      # the sampling done by the simulator. Returns a hash containing the number of samples and the min, max
+      # and mean values:
+      #
+      #   pin(:ana).measure(cycles: 100, min: 0.5, max: 1.2)  # => { count: 12, min: 0.6, max: 1.1, mean: 0.85 }
+      #
+      # See Simulator#start_analog_measurement for the available options.
+      def measure_window(options = {})
+        net = "#{driver_net}.pin"
+        if tester.simulator.start_analog_measurement(net, options)
+          if block_given?
+            yield
+          else
+            tester.cycle(repeat: options[:cycles]) if options[:cycles] > 0
+          end
+          tester.simulator.stop_analog_measurement(net)
+        end
+      end
+
       def _analog_pin_?
         type == :analog || is_a?(Origen::Pins::PowerPin) || is_a?(Origen::Pins::GroundPin)
       end
 
+      # Generate a free-running clock on the pin within the simulation. Once started this costs no
+      # messages to the simulator, so it is much faster than toggling the pin from the pattern and it
+      # can run asynchronously to the tester cycle. The pin ignores its pattern states until
+      # stop_sim_clock is called.
+      #
+      #   pin(:clk).start_sim_clock(period_in_ns: 10, duty_cycle: 0.4, phase: 2.5)
+      #   pin(:clk).start_sim_clock(freq_in_hz: 100_000_000)
+      #
+      # Calling this while the clock is running changes its frequency from its next rising edge,
+      # unless a :phase is given, in which case the clock is restarted.
+      def start_sim_clock(options = {})
+        return unless simulation_running?
+        period = options[:period_in_ns] || (options[:freq_in_hz] && 1_000_000_000.0 / options[:freq_in_hz]) ||
+                 fail('A :period_in_ns or :freq_in_hz must be supplied to start_sim_clock')
+        if sim_clock? && !options.key?(:phase)
+          simulator.change_clock(self, period, options)
+        elsif simulator.start_clock(self, period, options)
+          @sim_clock = simulator.simulation
+        end
+      end
+
+      # Stop the free-running clock started by start_sim_clock, the pin returns to its current state
+      # from the pattern
+      def stop_sim_clock
+        if sim_clock?
+          simulator.stop_clock(self)
+          @sim_clock = nil
+          reset_simulator_state
+          update_simulation
+        end
+      end
+
+      # Returns true if a free-running clock is currently being generated on the pin
+      def sim_clock?
+        !!@sim_clock && simulation_running? && @sim_clock.equal?(simulator.simulation)
+      end
+
       def apply_force
         if force
           simulator.put("2^#{simulation_index}^#{force}")
@@ -98,7 +197,7 @@ module Origen
       # Applies the current pin state to the simulation, this is triggered everytime
       # the pin state or value changes
       def update_simulation
-        return if force || !simulation_index || !tester.timeset || !simulator_needs_update?
+        return if force || !simulation_index || !tester.timeset || !simulator_needs_update? || sim_clock?
         case state
           when :drive
             @simulator_state = :drive
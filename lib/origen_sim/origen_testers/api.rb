@@ -95,16 +95,43 @@ module OrigenTesters
         @update_capture = update_capture?
         if @update_capture
           @sim_capture.each { |pin, net| pin.record_to_org_file(only: :assert) }
+          # Have the simulator record the data for every cycle in the block rather than peeking it
+          # after each one, it will then be written to the org file in one go when the block is done
+          @bulk_capture = simulator.bulk_capture_supported?
+          simulator.start_bulk_capture(@sim_capture.map { |pin, net| net }) if @bulk_capture
         end
         yield
+        record_bulk_capture if @bulk_capture
       end
       pins.each(&:restore)
       @sim_capture = nil
+      @bulk_capture = nil
+    end
+
+    # Writes the data recorded by the simulator during a sim_capture block to the org file, this
+    # is the same content as would have been produced by peeking the pins after every cycle
+    def record_bulk_capture
+      simulator.stop_bulk_capture.each do |cycles, values|
+        @sim_capture.each_with_index do |(pin, net), i|
+          if values[i]
+            pin.assert(values[i])
+          else
+            Origen.log.warning "Peek of net #{net} failed to return any data!"
+          end
+        end
+        # Remove the assertion since it is for the previous cycle in terms of the current simulation,
+        # this won't be captured to the org file
+        @sim_capture.each { |pin, net| pin.dont_care }
+        Origen::OrgFile.cycle(cycles)
+      end
     end
 
     alias_method :_origen_testers_cycle, :cycle
     def cycle(options = {})
-      if @sim_capture
+      if @bulk_capture
+        # The simulator is recording the data for every cycle, so repeats can be left as they are
+        _origen_testers_cycle(options)
+      elsif @sim_capture
         # Need to un-roll all repeats to be sure we observe the true data, can't
         # really assume that it will be constant for all cycles covered by the repeat
         cycles = options.delete(:repeat) || 1
@@ -0,0 +1,132 @@
+module OrigenSim
+  # Measures where the wall-clock time of a simulation is spent, this is enabled by running with
+  # the --profile option.
+  #
+  # Every cycle block (i.e. every vector sent to the simulator) is attributed to a key made up of the
+  # current pattern region, which is the last comment or ss step, and the location within the
+  # application's code that generated it. The time for each key is broken down into:
+  #
+  # * origen    - Time spent in Origen generating the block, e.g. pin updates and pattern logic
+  # * write     - Time spent writing messages to the simulator
+  # * wait      - Time spent waiting for replies from the simulator
+  # * bridge    - Time spent by the simulator's bridge processing the messages
+  # * simulator - Time spent by the simulator simulating the block
+  #
+  # The bridge and simulator times are measured by the bridge and collected at the end of the simulation.
+  # The results are written as a folded stack file, which can be given to flame graph tools such as
+  # flamegraph.pl or speedscope, and as a summary table of the most expensive keys.
+  class Profiler
+    CATEGORIES = [:origen, :write, :wait, :bridge, :simulator]
+
+    # Frames from within OrigenSim are skipped when working out which part of the application generated a cycle
+    LIB_DIR = File.expand_path('..', __dir__)
+
+    # The current pattern region, cycles will be attributed to this until it is changed
+    attr_accessor :region
+
+    def initialize
+      @keys = {}
+      @times = Hash.new { |h, k| h[k] = Hash.new(0) }
+      @blocks = Hash.new(0)
+      @write_ns = 0
+      @wait_ns = 0
+      @mark = now
+    end
+
+    def now
+      Process.clock_gettime(Process::CLOCK_MONOTONIC, :nanosecond)
+    end
+
+    # Executes the given block, recording the time taken against the given category (:write or :wait)
+    def measure(category)
+      t = now
+      yield
+    ensure
+      if category == :write
+        @write_ns += now - t
+      else
+        @wait_ns += now - t
+      end
+    end
+
+    # Called for every cycle block before it is sent to the simulator, this records the Origen time
+    # since the last block against the current key.
+    # Returns the ID of the key if it is different to that of the last block, meaning that the
+    # simulator needs to be told about it, otherwise returns nil.
+    def cycle
+      t = now
+      id = (@keys[[region || 'startup', location]] ||= @keys.size)
+      times = @times[id]
+      times[:origen] += t - @mark - @write_ns - @wait_ns
+      times[:write] += @write_ns
+      times[:wait] += @wait_ns
+      @blocks[id] += 1
+      @write_ns = 0
+      @wait_ns = 0
+      @mark = t
+      if id != @id
+        @id = id
+        id
+      end
+    end
+
+    # Adds the bridge and simulator times from the lines returned by the simulator at the end of
+    # the simulation, each line is: key,bridge_ns,simulator_ns,blocks
+    def add_simulator_times(lines)
+      lines.each do |line|
+        id, bridge, simulator, _blocks = *line.split(',').map(&:to_i)
+        @times[id][:bridge] += bridge
+        @times[id][:simulator] += simulator
+      end
+    end
+
+    # Writes the results to the given folded stack file and to a summary table next to it, the summary
+    # is also logged
+    def write(file, name, options = {})
+      keys = @keys.invert
+      FileUtils.mkdir_p(File.dirname(file))
+      File.open(file, 'w') do |f|
+        @times.each do |id, times|
+          region, location = *keys[id]
+          CATEGORIES.each do |category|
+            us = times[category] / 1000
+            next unless us > 0
+            f.puts "#{[name, region, location, category].map { |x| x.to_s.tr(';', ',') }.join(';')} #{us}"
+          end
+        end
+      end
+      summary = summary(keys, options[:top] || 20)
+      summary_file = file.sub(/\.folded$/, '') + '.txt'
+      File.write(summary_file, summary.join("\n") + "\n")
+      summary.each { |line| Origen.log.info line }
+      Origen.log.info "The full profile has been written to #{file} (flame graph format) and #{summary_file}"
+    end
+
+    private
+
+    def summary(keys, top)
+      totals = @times.map { |id, times| [id, CATEGORIES.map { |c| times[c] }.reduce(:+)] }
+      all = totals.map(&:last).reduce(0, :+)
+      lines = []
+      lines << format('%-40s %-30s %8s %9s %9s %9s %9s %9s %9s %6s', 'Region', 'Location', 'Blocks',
+                      *CATEGORIES.map(&:to_s), 'Total ms', '%')
+      totals.sort_by { |_id, total| -total }.first(top).each do |id, total|
+        region, location = *keys[id]
+        lines << format('%-40s %-30s %8d %9.1f %9.1f %9.1f %9.1f %9.1f %9.1f %6.1f', region.to_s[0..39],
+                        location.to_s[-30..-1] || location.to_s, @blocks[id],
+                        *CATEGORIES.map { |c| @times[id][c] / 1_000_000.0 }, total / 1_000_000.0,
+                        all > 0 ? total * 100.0 / all : 0)
+      end
+      lines
+    end
+
+    # Returns the location in the application's code which is generating the current cycle
+    def location
+      loc = caller_locations.find do |l|
+        path = l.absolute_path || l.path
+        path.start_with?(Origen.root.to_s) && !path.start_with?(LIB_DIR) && !path.include?('/gems/')
+      end
+      loc ? "#{(loc.absolute_path || loc.path).sub("#{Origen.root}/", '')}:#{loc.lineno}" : 'unknown'
+    end
+  end
+end
@@ -0,0 +1,48 @@
+require 'zlib'
+module OrigenSim
+  # Records the message stream between Origen and the simulator so that it can later be
+  # replayed straight into a new simulation without having to re-generate the pattern,
+  # see Simulator#replay.
+  #
+  # Recordings are gzipped text files containing one message per line, with messages sent
+  # to the simulator prefixed with '>' and the replies received from it prefixed with '<':
+  #
+  #   >2^12^1
+  #   >3^1
+  #   >7^
+  #   <OK!~0,0,1201
+  class Recorder
+    attr_reader :path
+
+    def initialize(path)
+      @path = path
+      FileUtils.mkdir_p(File.dirname(path))
+      @file = Zlib::GzipWriter.open(path)
+    end
+
+    # Record a message sent to the simulator
+    def sent(msg)
+      @file.write ">#{msg}\n"
+    end
+
+    # Record a reply received from the simulator
+    def received(msg)
+      @file.write "<#{msg.chomp}\n"
+    end
+
+    def close
+      @file.close
+    end
+
+    # Yields each message in the given recording along with its direction, either :sent
+    # or :received
+    def self.each(path)
+      Zlib::GzipReader.open(path) do |file|
+        file.each_line do |line|
+          line = line.chomp
+          yield line[0] == '>' ? :sent : :received, line[1..-1]
+        end
+      end
+    end
+  end
+end
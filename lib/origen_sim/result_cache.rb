@@ -0,0 +1,105 @@
+require 'digest'
+require 'fileutils'
+require 'yaml'
+module OrigenSim
+  # A store of the patterns which have previously passed in simulation, this allows a pattern to be
+  # reported as a cached pass without launching the simulator when nothing which could affect its
+  # result has changed since then.
+  #
+  # The key for a pattern is a digest of:
+  #
+  # * The pattern source file and everything else in its directory (e.g. sub-patterns and partials)
+  # * The application's app, lib and config directories and Gemfile.lock
+  # * The current target and environment files
+  # * The options which can affect the result, e.g. --max_errors, the error strings and the
+  #   simulator configuration
+  # * The identity of the compiled snapshot, the snapshot can't be interrogated without launching the
+  #   simulator so this is a fingerprint of the file names, sizes and modification times within its
+  #   compiled directory
+  # * The OrigenSim version
+  #
+  # The snapshot details (COMPILATION_TIME_STAMP and REVISION) reported by the simulation that passed are
+  # saved with each result for reference.
+  module ResultCache
+    def self.dir
+      "#{Origen.root}/tmp/origen_sim/result_cache"
+    end
+
+    # Returns the key for the given pattern source file when simulated by the given simulator, or nil
+    # if one can't be computed
+    def self.key(pattern_file, simulator)
+      return nil unless pattern_file && File.exist?(pattern_file) && File.exist?(simulator.compiled_dir)
+      digest = Digest::SHA256.new
+      digest << "#{OrigenSim::VERSION}\n#{simulator.id}\n#{simulator.config[:vendor]}\n"
+      digest_file(digest, pattern_file)
+      Dir.glob("#{File.dirname(File.expand_path(pattern_file))}/**/*").sort.each do |f|
+        digest_file(digest, f) if File.file?(f)
+      end
+      [Origen.target.file, Origen.environment.file].compact.each { |f| digest_file(digest, f.to_s) }
+      f = "#{Origen.root}/Gemfile.lock"
+      digest_file(digest, f) if File.exist?(f)
+      Dir.glob("#{Origen.root}/{app,lib,config}/**/*").sort.each do |f|
+        digest_file(digest, f) if File.file?(f)
+      end
+      digest << options_fingerprint(simulator)
+      Dir.glob("#{simulator.compiled_dir}/**/*").sort.each do |f|
+        stat = File.stat(f)
+        digest << "#{f}:#{stat.size}:#{stat.mtime.to_i}\n" if stat.file?
+      end
+      digest.hexdigest
+    end
+
+    # Returns the details of the previous passing simulation with the given key, or nil if there is none
+    def self.pass(key)
+      f = "#{dir}/#{key}.yml"
+      File.exist?(f) ? YAML.load_file(f) : nil
+    end
+
+    # Record that the simulation with the given key passed
+    def self.store(key, details = {})
+      FileUtils.mkdir_p(dir)
+      File.write("#{dir}/#{key}.yml", details.merge('time' => Time.now.to_s).to_yaml)
+    end
+
+    def self.clear
+      FileUtils.rm_rf(dir)
+    end
+
+    # Returns a string describing the options which can affect the result of a simulation
+    def self.options_fingerprint(simulator)
+      options = {
+        max_errors:               simulator.max_errors,
+        fail_waves:               OrigenSim.fail_waves,
+        profile:                  OrigenSim.profile,
+        fast_probe_depth:         $use_fast_probe_depth,
+        update_sim_captures:      Origen.app.respond_to?(:update_sim_captures) && Origen.app.update_sim_captures,
+        fail_on_stderr:           OrigenSim.fail_on_stderr,
+        error_strings:            OrigenSim.error_strings,
+        error_string_exceptions:  OrigenSim.error_string_exceptions,
+        stderr_string_exceptions: OrigenSim.stderr_string_exceptions
+      }
+      # Only the plain values within the configuration are used, things like procs don't have a stable
+      # representation and would make every key different
+      config = simulator.config.select { |_k, v| plain_value?(v) }
+      "#{options.inspect}\n#{config.sort_by { |k, _v| k.to_s }.inspect}\n"
+    end
+
+    def self.plain_value?(value)
+      case value
+      when String, Symbol, Numeric, TrueClass, FalseClass, NilClass
+        true
+      when Array
+        value.all? { |v| plain_value?(v) }
+      when Hash
+        value.all? { |k, v| plain_value?(k) && plain_value?(v) }
+      else
+        false
+      end
+    end
+
+    def self.digest_file(digest, file)
+      digest << "#{file}\n"
+      digest.file(file)
+    end
+  end
+end
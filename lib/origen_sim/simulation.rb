@@ -1,6 +1,8 @@
 require 'socket'
 require 'io/wait'
+require 'securerandom'
 require 'origen_sim/heartbeat'
+require 'origen_sim/monitor_demux'
 require 'origen_sim/stdout_reader'
 require 'origen_sim/stderr_reader'
 module OrigenSim
@@ -27,7 +29,37 @@ module OrigenSim
 
     attr_accessor :max_errors_exceeded
 
-    def initialize(id, view_wave_command)
+    # The simulator which is running this simulation, defaults to tester.simulator
+    attr_writer :simulator
+    # The name of the site that this simulation belongs to when running a multi-site simulation,
+    # all of its log output will be prefixed with this
+    attr_accessor :site_name
+
+    # Set to true when the simulator has been asked to append the current error and cycle counts
+    # to all of its replies
+    attr_accessor :reply_trailers
+    # Returns the error count, match loop error count and cycle count from the last reply
+    # received from the simulator
+    attr_reader :reply_status
+    # Returns true when messages have been sent to the simulator since the last reply was
+    # received, meaning that the reply status may be out of date
+    attr_accessor :reply_status_stale
+    # Returns the net groups that have been registered with the simulator, see Simulator#define_net_group
+    attr_reader :net_groups
+    # Returns the nets that have been subscribed to, indexed by their subscription ID, see Simulator#subscribe
+    attr_reader :subscriptions
+    # Returns the value changes received for subscriptions which have a block that has not been called yet
+    attr_reader :subscription_events
+
+    # The options are:
+    #
+    # * :tcp        - Accept the connections from the simulator over TCP rather than UNIX domain sockets,
+    #                 so that it can run on a different host. Set to true to listen on this host's name and
+    #                 an ephemeral port, or supply a 'host', 'host:port' or port number to listen on.
+    # * :batch_size - The size in bytes to which messages to the simulator are batched before being sent
+    #                 when connected over TCP, 0 disables batching. Pending messages are always sent before
+    #                 waiting for a reply.
+    def initialize(id, view_wave_command, options = {})
       @id = id
       @view_wave_command = view_wave_command
       @completed_cleanly = false
@@ -36,9 +68,28 @@ module OrigenSim
       @ended = false
       @error_count = 0
       @cycle_count = 0
+      @time_in_ns = 0
       @socket_ids = {}
       @log_files = []
       @max_errors_exceeded = false
+      @reply_trailers = false
+      @reply_status = {}
+      @reply_status_stale = true
+      @net_groups = {}
+      @subscriptions = {}
+      @subscription_events = []
+      @write_buffer = ''.b
+
+      if options[:tcp]
+        @tcp_host, port = *parse_tcp_option(options[:tcp])
+        @batch_size = options[:batch_size] || 16_384
+        # The simulation monitor connects first, its status, stdout and stderr channels and the heartbeat
+        # are all multiplexed over that connection, then the simulator connects to receive commands.
+        # Both must present this token before they are accepted, any other connection to the port is dropped.
+        @tcp_token = SecureRandom.hex(16)
+        @server = TCPServer.new(@tcp_host, port)
+        return
+      end
 
       # Socket used to send Origen -> Verilog commands
       @server = UNIXServer.new(socket_id)
@@ -82,20 +133,20 @@ module OrigenSim
           end
         else
           if in_progress
-            simulator.log("The simulation has #{error_count} error#{error_count > 1 ? 's' : ''}!", :error) if error_count > 0
+            simulator.log("#{log_prefix}The simulation has #{error_count} error#{error_count > 1 ? 's' : ''}!", :error) if error_count > 0
           else
-            Origen.log.error "The simulation failed with #{error_count} errors!" if error_count > 0
-            Origen.log.error "The simulation was aborted due to exceeding #{simulator.max_errors} errors!" if max_errors_exceeded
+            Origen.log.error "#{log_prefix}The simulation failed with #{error_count} errors!" if error_count > 0
+            Origen.log.error "#{log_prefix}The simulation was aborted due to exceeding #{simulator.max_errors} errors!" if max_errors_exceeded
           end
-          Origen.log.error 'The simulation log reported errors!' if logged_errors
-          Origen.log.error 'The simulation stderr reported errors!' if stderr_logged_errors
-          Origen.log.error 'The simulation exited early!' unless completed_cleanly || in_progress
+          Origen.log.error "#{log_prefix}The simulation log reported errors!" if logged_errors
+          Origen.log.error "#{log_prefix}The simulation stderr reported errors!" if stderr_logged_errors
+          Origen.log.error "#{log_prefix}The simulation exited early!" unless completed_cleanly || in_progress
         end
       else
         if in_progress
-          simulator.log 'The simulation is passing!', :success
+          simulator.log "#{log_prefix}The simulation is passing!", :success
         else
-          Origen.log.success 'The simulation passed!'
+          Origen.log.success "#{log_prefix}The simulation passed!"
         end
       end
     end
@@ -123,7 +174,7 @@ module OrigenSim
     # the simulator running, the child process will automatically reap it after a couple of missed
     # heartbeats.
     def start_heartbeat
-      @heartbeat = @server_heartbeat.accept
+      @heartbeat = tcp? ? @monitor : @server_heartbeat.accept
       if Heartbeat::THREADSAFE
         @heartbeat_thread = Heartbeat.new(self, @heartbeat)
       else
@@ -132,7 +183,7 @@ module OrigenSim
           loop do
             begin
               @heartbeat.write("OK\n")
-            rescue Errno::EPIPE => e
+            rescue Errno::EPIPE
               if File.exist?(ended_file)
                 FileUtils.rm_f(ended_file)
                 exit 0
@@ -172,24 +223,44 @@ module OrigenSim
        @stderr_reader.time_since_last_message].min
     end
 
+    # Blocks until the end-of-flush marker with the given ID has been consumed from both the
+    # stdout and stderr streams, returns false if that did not happen within the given timeout
+    def wait_for_flush(id, timeout)
+      @stdout_reader.wait_for_flush_marker(id, timeout) &&
+        @stderr_reader.wait_for_flush_marker(id, timeout)
+    end
+
     # Open the communication channels with the simulator
     def open(monitor_pid, timeout)
       @monitor_pid = monitor_pid
       timeout_connection(timeout) do
-        start_heartbeat
-        @stdout = @server_stdout.accept
-        @stderr = @server_stderr.accept
-        @status = @server_status.accept
-        @stdout_reader = StdoutReader.new(@stdout, simulator)
-        @stderr_reader = StderrReader.new(@stderr)
+        if tcp?
+          @monitor = accept_tcp
+          failed_to_connect unless @monitor
+          @monitor.setsockopt(Socket::IPPROTO_TCP, Socket::TCP_NODELAY, 1)
+          @monitor_demux = MonitorDemux.new(@monitor)
+          start_heartbeat
+          @stdout = @monitor_demux[:stdout]
+          @stderr = @monitor_demux[:stderr]
+          @status = @monitor_demux[:status]
+        else
+          start_heartbeat
+          @stdout = @server_stdout.accept
+          @stderr = @server_stderr.accept
+          @status = @server_status.accept
+        end
+        @stdout_reader = StdoutReader.new(@stdout, simulator, log_prefix)
+        @stderr_reader = StderrReader.new(@stderr, log_prefix)
         @stdout_reader.priority = 1
         @stderr_reader.priority = 2
 
         Origen.log.debug 'The simulation monitor has started'
-        Origen.log.debug @status.gets.chomp  # Starting simulator
-        Origen.log.debug @status.gets.chomp  # Simulator has started
-        response = @status.gets.chomp
-        if response =~ /finished/
+        Origen.log.debug @status.gets.to_s.chomp  # Starting simulator
+        Origen.log.debug @status.gets.to_s.chomp  # Simulator has started
+        response = @status.gets
+        # The monitor has gone away (or the connection was aborted) without the simulator starting
+        failed_to_connect if response.nil? && tcp?
+        if response.nil? || response =~ /finished/
           abort_connection
         else
           @pid = response.to_i
@@ -198,7 +269,8 @@ module OrigenSim
         # to wait for that in case it ends before the VPI starts
         Thread.new do
           begin
-            @status.gets.chomp  # This will block until something is received
+            @status.gets  # This will block until something is received
+            @simulator_finished = true
           rescue Exception => e
             Origen.log.error "Exception occurred while processing the monitor's status!"
             raise e
@@ -209,14 +281,16 @@ module OrigenSim
         Origen.log.debug 'Waiting for Origen VPI to start...'
 
         # This will block until the VPI extension is invoked and connects to the socket
-        @socket = @server.accept
+        if tcp?
+          @socket = accept_tcp
+          failed_to_connect unless @socket
+          @socket.setsockopt(Socket::IPPROTO_TCP, Socket::TCP_NODELAY, 1)
+        else
+          @socket = @server.accept
+        end
 
         @connection_established = true # Cancels timeout_connection
-        if @connection_aborted
-          self.failed_to_start = true
-          log_results
-          exit  # Assume it is not worth trying another pattern in this case, some kind of environment/config issue
-        end
+        failed_to_connect if @connection_aborted
         Origen.log.debug 'Origen VPI has started'
       end
 
@@ -238,10 +312,42 @@ module OrigenSim
       # release our process and then exit
       unless @connection_established
         @connection_aborted = true
-        UNIXSocket.new(socket_id).puts("Time out\n")
+        if tcp?
+          # Over TCP the monitor may not have connected yet either, so the connection identifies itself
+          # as an abort rather than being taken for the monitor or the simulator, see #accept_tcp.
+          # Closing the monitor's connection releases a wait for its status.
+          TCPSocket.new(@tcp_host, tcp_port).puts("#{@tcp_token} abort\n")
+          @monitor.close if @monitor && !@monitor.closed?
+        else
+          UNIXSocket.new(socket_id).puts("Time out\n")
+        end
+      end
+    end
+
+    # Accepts the next connection to the TCP server which presents this simulation's token, any
+    # others are closed. Returns nil if the connection has been aborted instead.
+    def accept_tcp
+      loop do
+        client = @server.accept
+        line = client.wait_readable(5) && client.gets("\n", 256)
+        if line && secure_compare(line.chomp, "#{@tcp_token} abort")
+          client.close
+          return nil
+        elsif line && secure_compare(line.chomp, @tcp_token)
+          return client
+        end
+        Origen.log.warning "Rejected a connection to the simulation's TCP port from #{client.remote_address.inspect_sockaddr}"
+        client.close
       end
     end
 
+    def failed_to_connect
+      @connection_aborted = true
+      self.failed_to_start = true
+      log_results
+      exit  # Assume it is not worth trying another pattern in this case, some kind of environment/config issue
+    end
+
     # Close all communication channels with the simulator
     def close
       return unless @opened
@@ -253,16 +359,62 @@ module OrigenSim
       @stderr.close
       @stdout.close
       @status.close
-      File.unlink(socket_id(:heartbeat)) if File.exist?(socket_id(:heartbeat))
-      File.unlink(socket_id) if File.exist?(socket_id)
-      File.unlink(socket_id(:stderr)) if File.exist?(socket_id(:stderr))
-      File.unlink(socket_id(:stdout)) if File.exist?(socket_id(:stdout))
-      File.unlink(socket_id(:status)) if File.exist?(socket_id(:status))
+      if tcp?
+        @server.close
+      else
+        File.unlink(socket_id(:heartbeat)) if File.exist?(socket_id(:heartbeat))
+        File.unlink(socket_id) if File.exist?(socket_id)
+        File.unlink(socket_id(:stderr)) if File.exist?(socket_id(:stderr))
+        File.unlink(socket_id(:stdout)) if File.exist?(socket_id(:stdout))
+        File.unlink(socket_id(:status)) if File.exist?(socket_id(:status))
+      end
       @opened = false
     end
 
+    # Returns the host that the simulator connects to when connected over TCP
+    attr_reader :tcp_host
+
+    # Returns true if the simulator is connected over TCP
+    def tcp?
+      !!@tcp_host
+    end
+
+    # Returns the port that the simulator connects to when connected over TCP
+    def tcp_port
+      @server.addr[1]
+    end
+
+    # Sends the given data to the simulator, when connected over TCP it is held back until a batch
+    # has been built up or a reply is needed, see #flush_writes
+    def write(data)
+      if @batch_size && @batch_size > 0
+        @write_buffer << data
+        flush_writes if @write_buffer.bytesize >= @batch_size
+      else
+        @socket.write(data)
+      end
+    end
+
+    # Sends any messages that are being held back to form a batch
+    def flush_writes
+      unless @write_buffer.empty?
+        @socket.write(@write_buffer)
+        @write_buffer.clear
+      end
+    end
+
+    # Returns the next line received from the simulator, any pending messages are sent first since
+    # the reply may depend on them
+    def readline
+      flush_writes
+      @socket.readline
+    end
+
     # Returns true if the simulation is running
     def running?
+      # The simulator's PID is not meaningful when it is running on another host, rely on the monitor
+      # to report when it has finished instead
+      return !@simulator_finished if tcp?
       return false unless pid
       begin
         Process.getpgid(pid)
@@ -284,8 +436,51 @@ module OrigenSim
       end
     end
 
+    # Returns the token which the simulation monitor and the simulator must present when connecting over TCP
+    attr_reader :tcp_token
+
     def socket_id(type = nil)
-      @socket_ids[type] ||= "#{OrigenSim.socket_dir || '/tmp'}/#{socket_number}#{type}.sock"
+      if tcp?
+        "tcp://#{@tcp_host}:#{tcp_port}/#{@tcp_token}"
+      else
+        @socket_ids[type] ||= "#{OrigenSim.socket_dir || '/tmp'}/#{socket_number}#{type}.sock"
+      end
+    end
+
+    # Strips the status trailer from the given reply received from the simulator and records
+    # the status values that it contains, the reply is returned without the trailer
+    def process_reply_trailer(reply)
+      if reply_trailers && (m = reply.match(/~E([^~]*)\n?\z/))
+        process_subscription_events(m[1])
+        reply = reply[0...m.begin(0)] + "\n"
+      end
+      if reply_trailers && (i = reply.rindex('~'))
+        errors, match_errors, cycles, time = *(reply[(i + 1)..-1].strip.split(',').map(&:to_i))
+        @reply_status = { errors: errors, match_errors: match_errors, cycle_count: cycles }
+        @reply_status_stale = false
+        # Bridges compiled before the time was added to the trailer only give the counts
+        if time
+          @reply_status[:time_in_ns] = simulator.send(:simtime_units_to_ns, time)
+          # Time can be advanced by the simulator without Origen's knowledge, e.g. in a match loop.
+          # Origen may also be ahead of the reply when replies are being pipelined, so it is never
+          # wound back.
+          @time_in_ns = @reply_status[:time_in_ns] if @reply_status[:time_in_ns] > @time_in_ns
+        end
+        reply = reply[0...i] + "\n"
+      end
+      reply
+    end
+
+    # Updates the local copies of the subscribed nets' values from the events appended to a reply,
+    # each is formatted as id,time,cycle,value
+    def process_subscription_events(events)
+      events.split(/[;!]/).each do |event|
+        id, time, cycle, value = *event.split(',')
+        sub = subscriptions[id.to_i]
+        next unless sub
+        sub[:value] = Origen::Value.new('b' + value)
+        subscription_events << [sub, sub[:value], cycle.to_i, time.to_i] if sub[:block]
+      end
     end
 
     # Returns the current cycle count, this is Origen's local count
@@ -293,18 +488,52 @@ module OrigenSim
       @cycle_count
     end
 
-    def cycle(number_of_cycles)
+    # Returns the current simulation time in ns, this is Origen's local view of it which is advanced
+    # by the period of each cycle and brought back in line with the simulator's time (e.g. after a match
+    # loop) whenever a reply is received from it.
+    # When the DUT has been compiled with an OrigenSim version which doesn't report the time in its
+    # replies, this is only an approximation which does not include any time advanced by the simulator itself.
+    def time_in_ns
+      @time_in_ns
+    end
+
+    def cycle(number_of_cycles, period_in_ns = 0)
       @cycle_count += number_of_cycles
+      @time_in_ns += number_of_cycles * period_in_ns
+    end
+
+    # Returns the prefix which is applied to all log output from this simulation
+    def log_prefix
+      site_name ? "[#{site_name}] " : ''
     end
 
     private
 
     def simulator
-      tester.simulator
+      @simulator || tester.simulator
+    end
+
+    # Compares the given strings in a time which does not depend on where they differ
+    def secure_compare(a, b)
+      return false unless a.bytesize == b.bytesize
+      a.bytes.zip(b.bytes).reduce(0) { |diff, (x, y)| diff | (x ^ y) } == 0
     end
 
     def socket_number
       @socket_number ||= (Process.pid.to_s + Time.now.to_f.to_s).sub('.', '')
     end
+
+    # Returns the host and port to listen on from the given :tcp option
+    def parse_tcp_option(option)
+      case option
+      when Integer
+        [Socket.gethostname, option]
+      when String
+        host, port = *option.split(':')
+        [host, (port || 0).to_i]
+      else
+        [Socket.gethostname, 0]
+      end
+    end
   end
 end
@@ -1,4 +1,8 @@
 require 'origen_sim/simulation'
+require 'origen_sim/recorder'
+require 'origen_sim/comment_file'
+require 'origen_sim/result_cache'
+require 'origen_sim/profiler'
 require 'origen_sim/simulator/artifacts'
 require 'origen_sim/simulator/snapshot_details'
 
@@ -10,7 +14,7 @@ module OrigenSim
     include Origen::PersistentCallbacks
     include Artifacts
 
-    VENDORS = [:icarus, :cadence, :synopsys, :generic]
+    VENDORS = [:icarus, :cadence, :synopsys, :verilator, :generic]
     LOG_CODES = { debug: 0, info: 1, warn: 2, warning: 2, success: 3, error: 4, deprecate: 5, deprecated: 5 }
     LOG_CODES_ = { 0 => :debug, 1 => :info, 2 => :warn, 3 => :success, 4 => :error, 5 => :deprecated }
 
@@ -18,6 +22,11 @@ module OrigenSim
     # the difference for the actual message.
     LOGGER_COLLATERAL_SIZE = 11
     MULTIPART_LOGGER_TOKEN = '!k+!'
+    # Emitted by the simulator on stdout and stderr at the end of a flush
+    FLUSH_MARKER = '!FLUSH!'
+    # The maximum length of a message to the simulator including its terminator, this must match
+    # MAX_MESSAGE_LENGTH in ext/client.h
+    MAX_MESSAGE_LENGTH = 1024
 
     # These config attributes are accepted by OrigenSim, but cannot be
     # 'Marshal-ed'.
@@ -50,13 +59,19 @@ module OrigenSim
     # Returns an array containing all instances of OrigenSim::Simulation that were created
     # in the order that they were created
     attr_reader :simulations
+    # Returns the OrigenSim::CommentFile that pattern comments are being written to, or nil if
+    # they are being written to the testbench
+    attr_reader :comment_file
     # Returns a hash of pins where the key is the RTL name, used to quickly retrieve the pin
     # object from the pin name returned by the simulator
     attr_reader :pins_by_rtl_name
+    # Returns the OrigenSim::Profiler when running with --profile, otherwise nil
+    attr_reader :profiler
 
     def initialize
       @simulations = []
       @simulation_open = false
+      @running_sites = []
     end
 
     # When set to true the simulator will log all messages it receives, note that
@@ -180,6 +195,7 @@ module OrigenSim
         max_log_size:             1024
       }.merge(options)
       @tmp_dir = nil
+      @site_simulators = nil
 
       # Temporary workaround for bug in componentable, which is making the container a class object, instead of an
       # instance object.
@@ -264,6 +280,7 @@ module OrigenSim
     def tmp_dir
       @tmp_dir ||= begin
         d = "#{Origen.root}/tmp/origen_sim/#{id}/#{config[:vendor]}"
+        d += "/#{site_name}" if site?
         FileUtils.mkdir_p(d)
         d
       end
@@ -284,6 +301,23 @@ module OrigenSim
     def wave_dir(subdir = nil)
       @wave_dir ||= begin
         d = "#{Origen.root}/waves/#{id}"
+        d += "/#{site_name}" if site?
+        FileUtils.mkdir_p(d)
+        d
+      end
+    end
+
+    # Returns the directory where the flame graph profiles are written when running with the
+    # --profile option
+    def profile_dir
+      @profile_dir ||= config[:profile_dir] || "#{Origen.root}/profiles/#{id}"
+    end
+
+    # Returns the directory where recordings of the message stream sent to the simulator are
+    # saved when running with the --record option
+    def recording_dir
+      @recording_dir ||= begin
+        d = config[:recording_dir] || "#{Origen.root}/recordings/#{id}"
         FileUtils.mkdir_p(d)
         d
       end
@@ -323,7 +357,7 @@ module OrigenSim
 
     def wave_config_ext
       case config[:vendor]
-      when :icarus
+      when :icarus, :verilator
         'gtkw'
       when :cadence
         'svcf'
@@ -342,6 +376,9 @@ module OrigenSim
         cmd = configuration[:vvp] || 'vvp'
         cmd += " -M#{compiled_dir} -morigen #{compiled_dir}/origen.vvp +socket+#{socket_id}"
 
+      when :verilator
+        cmd = "#{compiled_dir}/#{config[:verilator_compiled_name] || 'Vorigen'} +socket+#{socket_id}"
+
       when :cadence
         input_file = "#{tmp_dir}/#{wave_file_basename}.tcl"
         if !File.exist?(input_file) || config_changed?
@@ -399,7 +436,7 @@ module OrigenSim
       when :synopsys
         syn_comp_n = config[:synopsys_compiled_name] || 'simv'
         if configuration[:verdi]
-          cmd = "#{compiled_dir}/#{syn_comp_n} +socket+#{socket_id} +FSDB_ON +fsdbfile+#{Origen.root}/waves/#{id}/#{wave_file_basename}.fsdb +memcbk +vcsd"
+          cmd = "#{compiled_dir}/#{syn_comp_n} +socket+#{socket_id} +FSDB_ON +fsdbfile+#{wave_dir}/#{wave_file_basename}.fsdb +memcbk +vcsd"
         else
           cmd = "#{compiled_dir}/#{syn_comp_n} +socket+#{socket_id} -vpd_file #{wave_file_basename}.vpd"
         end
@@ -466,7 +503,7 @@ module OrigenSim
     def view_wave_command
       cmd = nil
       case config[:vendor]
-      when :icarus
+      when :icarus, :verilator
         edir = Pathname.new(wave_config_dir).relative_path_from(Pathname.pwd)
         cmd = "cd #{edir} && "
         cmd += configuration[:gtkwave] || 'gtkwave'
@@ -532,7 +569,7 @@ module OrigenSim
 
     def run_dir
       case config[:vendor]
-      when :icarus
+      when :icarus, :verilator
         d = File.join(wave_dir, wave_file_basename)
         FileUtils.mkdir_p(d)
         d
@@ -547,11 +584,15 @@ module OrigenSim
       @simulation_open
     end
 
-    # Starts up the simulator process
-    def start
+    # Starts up the simulator process.
+    # When the :replay option is given the simulator will be started, but none of the usual
+    # initialization messages will be sent to it since they will be contained in the recording.
+    def start(options = {})
       @simulation_open = true
       @pattern_starting_error_count = nil
-      @simulation = Simulation.new(wave_file_basename, view_wave_command)
+      @simulation = Simulation.new(wave_file_basename, view_wave_command, tcp: config[:tcp], batch_size: config[:tcp_batch_size])
+      @simulation.simulator = self
+      @simulation.site_name = site_name if multi_site?
       simulations << @simulation
 
       fetch_simulation_objects
@@ -559,7 +600,10 @@ module OrigenSim
       artifact.clean
       artifact.populate
 
-      cmd = run_cmd + ' & echo \$!'
+      # The monitor is given to a shell within double quotes when it is run locally, but is read as-is
+      # by Ruby when it is launched on a remote host
+      remote = simulation.tcp? && config[:remote_launch]
+      cmd = run_cmd + (remote ? ' & echo $!' : ' & echo \$!')
 
       launch_simulator = %(
         require 'open3'
@@ -579,10 +623,7 @@ module OrigenSim
           exit!
         end
 
-        status = UNIXSocket.new('#{simulation.socket_id(:status)}')
-        stdout_socket = UNIXSocket.new('#{simulation.socket_id(:stdout)}')
-        stderr_socket = UNIXSocket.new('#{simulation.socket_id(:stderr)}')
-        heartbeat = UNIXSocket.new('#{simulation.socket_id(:heartbeat)}')
+        #{monitor_connection.strip}
 
         begin
 
@@ -650,18 +691,36 @@ module OrigenSim
 
       Origen.log.flush # Required to stop any existing buffered log data being copied into this new process
 
-      monitor_pid = spawn("ruby -e \"#{launch_simulator}\"")
+      if remote
+        # Run the monitor on the remote host, e.g. via ssh or a farm submission command, the script is
+        # given to it via stdin
+        monitor_file = "#{tmp_dir}/#{simulation.id}_monitor.rb"
+        File.write(monitor_file, launch_simulator)
+        monitor_pid = spawn("#{config[:remote_launch]} ruby", in: monitor_file)
+      else
+        monitor_pid = spawn("ruby -e \"#{launch_simulator}\"")
+      end
       Process.detach(monitor_pid)
 
       simulation.open(monitor_pid, config[:startup_timeout] || 60) # This will block until the simulation process has started
 
-      # The VPI extension will send 'READY!' when it starts, make sure we get it before proceeding
-      data = get
-      unless data.strip == 'READY!'
+      # The VPI extension will send a hello message starting with 'READY!' when it starts, make sure we
+      # get it before proceeding
+      data = get.strip
+      unless data.split('^').first == 'READY!'
         simulation.failed_to_start = true
         simulation.log_results
         exit  # Assume it is not worth trying another pattern in this case, some kind of environment/config issue
       end
+      @hello = parse_hello(data)
+      return if options[:replay] || site?
+      start_sites
+      if config[:comment_file]
+        @comment_file = CommentFile.new("#{wave_dir}/#{simulation.id}.comments")
+      end
+      if OrigenSim.record
+        @recorder = Recorder.new("#{recording_dir}/#{simulation.id}.sim.gz")
+      end
       Origen.log.info "OrigenSim version #{Origen.app!.version}"
       Origen.log.info "OrigenSim DUT version #{dut_version}"
       unless dut_version > '0.15.0'
@@ -673,12 +732,33 @@ module OrigenSim
       # Note that this is not setting a tester timeset, so the application will still have to
       # do that before generating any vectors.
       put('1^0')  # Set period to 0 so that time does not advance
+      @period_in_ns = 0
       cycle(1)
       if dut_version > '0.15.0'
         # Put cycle counter back to 0
         put('p^0')
         simulation.cycle(-1)
         put("m^#{max_errors}")
+        if bridge_feature?(:trailers)
+          # Have the error and cycle counts returned with every reply, this means that most queries
+          # of them can be answered without any additional messages
+          put('t^1')
+          simulation.reply_trailers = true
+          @running_sites.each { |site| site.simulation.reply_trailers = true }
+          if OrigenSim.profile && !site? && bridge_feature?(:profile)
+            put('F^1')
+            @profiler = Profiler.new
+          end
+          if OrigenSim.fail_waves && bridge_feature?(:fail_waves)
+            if shm_waves?
+              Origen.log.warning 'Fail waves are not supported for Cadence SHM wave dumps, waves will be dumped for the whole simulation'
+            else
+              enable_fail_waves
+              # Each site's waves should be dumped around its own failures, so override what was just sent
+              @running_sites.each(&:enable_fail_waves)
+            end
+          end
+        end
         # Intercept all log messages until the end of the simulation so that they can be synced to
         # simulation time
         @log_intercept_id = Origen.log.start_intercepting do |msg, type, options, original|
@@ -704,13 +784,22 @@ module OrigenSim
         end
       end
       sync_up # Make sure the simulation is underway before proceeding
+      @running_sites.each(&:apply_site_forces)
       Origen.listeners_for(:simulation_startup).each(&:simulation_startup)
     end
 
-    # Send the given message string to the simulator
-    def put(msg)
-      simulation.socket.write(msg + "\n")
-    rescue Errno::EPIPE => e
+    # Sends the given message to the simulator, and to those of any other sites unless primary_only
+    # is given, e.g. for log messages which only need to appear once
+    def put(msg, primary_only: false)
+      @recorder.sent(msg) if @recorder
+      if @profiler
+        @profiler.measure(:write) { simulation.write(msg + "\n") }
+      else
+        simulation.write(msg + "\n")
+      end
+      simulation.reply_status_stale = true
+      @running_sites.each { |site| site.put(msg) } unless primary_only
+    rescue Errno::EPIPE
       # :from_origen_sim is added here to ensure this goes straight to the Origen console logger
       # and does not get sent via the simulator since it is clearly having problems
       if simulation.running?
@@ -725,7 +814,37 @@ module OrigenSim
     # Get a message from the simulator, will block until one
     # is received
     def get
-      simulation.socket.readline
+      reply = @profiler ? @profiler.measure(:wait) { simulation.readline } : simulation.readline
+      @recorder.received(reply) if @recorder
+      simulation.process_reply_trailer(reply)
+    end
+
+    # Get a message from the simulator exactly as it was sent, i.e. with any status trailer still
+    # attached, the reply status will be updated from the trailer as normal
+    def get_raw
+      reply = simulation.readline
+      simulation.process_reply_trailer(reply)
+      reply
+    end
+
+    # Returns true when running in pipelined mode, where Origen avoids waiting for replies from the
+    # simulator during the pattern wherever it can, e.g. to resolve the actual data of failed register
+    # reads. This makes the simulation much more tolerant of the latency of a connection to another host.
+    def pipelined?
+      !!config[:pipelined]
+    end
+
+    # Returns true if the simulator is appending status trailers to all replies, meaning that
+    # the error and cycle counts can often be returned without an extra round trip
+    def reply_trailers?
+      simulation.reply_trailers
+    end
+
+    # Returns the given status value from the last reply, syncing up with the simulator
+    # first if messages have been sent since then
+    def reply_status(name)
+      sync_up if simulation.reply_status_stale
+      simulation.reply_status[name]
     end
 
     # At the start of a test program flow generation/simulation
@@ -825,7 +944,7 @@ module OrigenSim
     # immediately.
     def log(msg, type = :info, multipart: false)
       if dut_version > '0.15.0'
-        put("k^#{LOG_CODES[type]}^#{msg}")
+        put("k^#{LOG_CODES[type]}^#{msg}", primary_only: true)
       else
         Origen.log.send(type, msg)
       end
@@ -892,31 +1011,77 @@ module OrigenSim
 
     def end_simulation
       put('8^')
+      simulation.flush_writes
     end
 
     def set_period(period_in_ns)
+      @period_in_ns = period_in_ns
       put("1^#{ns_to_simtime_units(period_in_ns)}")
     end
 
     def cycle(number_of_cycles)
+      if @profiler && (key = @profiler.cycle)
+        put("F^k^#{key}")
+      end
       put("3^#{number_of_cycles}")
-      simulation.cycle(number_of_cycles)
+      simulation.cycle(number_of_cycles, @period_in_ns || 0)
     end
 
     # Blocks the Origen process until the simulator indicates that it has
-    # processed all operations up to this point
+    # processed all operations up to this point.
+    # When simulating multiple sites, the replies which the other sites sent ahead of their sync
+    # are returned, indexed by site name, e.g. { 'site1' => ['...'] }. Any site whose simulator
+    # has gone away is reported and dropped from the simulation.
     def sync_up
       put('7^')
       data = get
       unless data.strip == 'OK!'
         fail 'Origen and the simulator are out of sync!'
       end
+      replies = {}
+      @running_sites.dup.each do |site|
+        site_replies = []
+        begin
+          until (reply = site.get.strip) == 'OK!'
+            site_replies << reply
+          end
+        rescue EOFError, IOError, SystemCallError
+          drop_site(site)
+        end
+        replies[site.site_name] = site_replies
+      end
+      dispatch_subscription_events unless simulation.subscription_events.empty?
+      replies
+    end
+
+    # Removes a site whose simulator has stopped unexpectedly, its simulation is marked as failed
+    def drop_site(site)
+      Origen.log.error "#{site.site_name}: The simulator has stopped unexpectedly, the site has been dropped!", from_origen_sim: true
+      @running_sites.delete(site)
+      site.simulation.completed_cleanly = false
+      begin
+        site.simulation.close
+      rescue IOError, SystemCallError
+        # Already closed by the simulator going away
+      end
     end
 
     # Flush any buffered simulation output, this should cause live wave viewers to
     # reflect the latest state.
     def flush(options = {})
-      if dut_version > '0.12.0'
+      if bridge_feature?(:flush_markers)
+        @flush_id = (@flush_id || 0) + 1
+        # The simulator will flush its output and then emit a marker containing this ID on both
+        # stdout and stderr, once the reader threads have seen them we know that all output
+        # generated up to this point has been processed
+        put("j^#{@flush_id}")
+        simulation.flush_writes
+        unless simulation.wait_for_flush(@flush_id, config[:flush_timeout] || 10)
+          Origen.log.debug 'Timed out waiting for the simulator output to be flushed', from_origen_sim: true
+        end
+        Origen.log.flush
+        nil  # Keep the console clean if this is called interactively
+      elsif dut_version > '0.12.0'
         sync_up
         put('j^')
         sync_up
@@ -949,7 +1114,11 @@ module OrigenSim
 
     # Returns the current simulation error count
     def error_count
-      peek("#{testbench_top}.#{debug_path}.errors").to_i
+      if reply_trailers?
+        reply_status(:errors)
+      else
+        peek("#{testbench_top}.#{debug_path}.errors").to_i
+      end
     end
 
     # Returns the current value of the given net, or nil if the given path does not
@@ -1034,28 +1203,95 @@ module OrigenSim
       end
     end
 
+    # Replays a recording made by a previous simulation (see the --record option) into a new
+    # simulation, checking that the simulator's replies match those that were recorded.
+    # This allows a pattern to be re-simulated, e.g. against a new RTL drop, without having to
+    # re-generate it.
+    def replay(file)
+      @last_wave_file_basename = File.basename(file, '.sim.gz')
+      start(replay: true)
+      mismatches = 0
+      replies = 0
+      Recorder.each(file) do |direction, msg|
+        if direction == :sent
+          # The recording will have been stopped before the end of the simulation, but just in case
+          break if msg == '8^'
+          simulation.reply_trailers = msg == 't^1' if msg.start_with?('t^')
+          put(msg)
+        else
+          replies += 1
+          reply = get_raw.chomp
+          unless reply == msg
+            mismatches += 1
+            if mismatches <= 10
+              Origen.log.error "Reply #{replies} differs from the recording, expected '#{msg}', received '#{reply}'"
+            end
+          end
+        end
+      end
+      if mismatches > 0
+        Origen.log.error "#{mismatches} of #{replies} replies differed from the recording!"
+        simulation.logged_errors = true
+      end
+      simulation.completed_cleanly = true
+      stop
+    end
+
     def interactive_shutdown
       @interactive_mode = true
     end
 
     # Stop the simulator
     def stop
+      if @recorder
+        @recorder.close
+        Origen.log.info "The simulation has been recorded to #{@recorder.path}"
+        @recorder = nil
+      end
+      if @comment_file
+        @comment_file.close
+        @comment_file = nil
+      end
       @simulation_open = false
       simulation.error_count = error_count
-      Origen.listeners_for(:simulation_shutdown).each(&:simulation_shutdown)
+      Origen.listeners_for(:simulation_shutdown).each(&:simulation_shutdown) unless site?
+      if @profiler
+        # Stop profiling before collecting the results so that this exchange isn't included in them
+        completed_profile = @profiler
+        @profiler = nil
+        put('F^0')
+        completed_profile.add_simulator_times(get.strip.to_i.times.map { get.strip })
+      end
       sync_up
-      Origen.log.stop_intercepting @log_intercept_id
+      stop_sites
+      save_fail_cycles if bridge_feature?(:fail_waves)
+      if @result_cache_key
+        # Older DUTs do not have snapshot details
+        details = (dut_version >= '0.21.0' && snapshot_details.details) || {}
+        @result_cache_details = details.select { |k, _v| %w(COMPILATION_TIME_STAMP REVISION).include?(k) }
+      end
+      Origen.log.stop_intercepting @log_intercept_id if @log_intercept_id
+      @log_intercept_id = nil
+      completed_profile.write("#{profile_dir}/#{simulation.id}.folded", simulation.id) if completed_profile
       simulation.ended = true
       end_simulation
       # Give the simulator time to shut down
       sleep 0.1 while simulation.running?
       simulation.close
       simulation.log_results unless Origen.current_command == 'interactive'
+      if @result_cache_key && !simulation.failed?
+        ResultCache.store(@result_cache_key, (@result_cache_details || {}).merge('pattern' => simulation.id))
+      end
+      @result_cache_key = nil
     rescue
       simulation.completed_cleanly = false
     end
 
     def on_origen_shutdown
+      if simulations.empty? && !cached_passes.empty?
+        Origen.log.success "#{cached_passes.size} pattern#{cached_passes.size == 1 ? '' : 's'} passed previously and were not simulated again (run with --rerun to force a simulation)"
+        Origen.app.stats.report_pass unless @interactive_mode
+      end
       unless simulations.empty?
         failed = false
         stop if simulation_open?
@@ -1064,6 +1300,9 @@ module OrigenSim
             failed = simulation.failed?
           else
             failed_simulation_count = simulations.count(&:failed?)
+            unless cached_passes.empty?
+              Origen.log.info "#{cached_passes.size} pattern#{cached_passes.size == 1 ? '' : 's'} passed previously and were not simulated again"
+            end
             if failed_simulation_count > 0
               Origen.log.error "#{failed_simulation_count} of #{simulations.size} simulations failed!"
               failed = true
@@ -1142,13 +1381,55 @@ module OrigenSim
       @dut_version ||= begin
         # Allow configs to force a dut version, this is to allow backwards compatibility with very early
         # compiled duts which do not support the command to get it from the compiled object
-        config[:dut_version] || begin
+        config[:dut_version] || (hello && hello[:version]) || begin
           put('i^')
           Origen::VersionString.new(get.strip)
         end
       end
     end
 
+    # Returns the details sent by the simulator in its hello message at the start of the current
+    # simulation, or nil if the DUT was compiled with a version of OrigenSim which does not send them.
+    #
+    # This is a hash containing the :version, :timescale, :real_enabled, :real_type, :pin_count,
+    # :features, :snapshot_details and :user_details, it means that these can be answered without
+    # querying the simulator for each one at the start of every simulation.
+    attr_reader :hello
+
+    # Returns true if the simulator's bridge reports that it supports the given optional protocol
+    # feature, e.g. :profile. Bridges which do not send a hello support none of them.
+    def bridge_feature?(name)
+      hello ? hello[:features].include?(name.to_sym) : false
+    end
+
+    # Parses the hello message sent by the simulator when it starts:
+    #
+    #   READY!^version^timescale^real_enabled^real_type^pin_count^features^snapshot_details^user_details
+    #
+    # Older simulators send only 'READY!', in which case nil is returned
+    def parse_hello(data)
+      fields = data.split('^', -1)
+      return nil if fields.size < 9
+      {
+        version:          Origen::VersionString.new(fields[1]),
+        timescale:        fields[2].to_i,
+        real_enabled:     fields[3] == '1',
+        real_type:        fields[4].empty? ? false : fields[4].to_sym,
+        pin_count:        fields[5].to_i < 0 ? nil : fields[5].to_i,
+        features:         fields[6].split(',').map(&:to_sym),
+        snapshot_details: parse_hello_details(fields[7]),
+        user_details:     parse_hello_details(fields[8])
+      }
+    end
+
+    # The details are given as NAME=VALUE pairs with any special characters within the values percent-encoded
+    def parse_hello_details(field)
+      field.split(',').map do |pair|
+        name, value = *pair.split('=', 2)
+        [name, (value || '').gsub(/%(\h\h)/) { Regexp.last_match(1).hex.chr }]
+      end.to_h
+    end
+
     # Get the timescale of the current simulation, returns a number that maps as follows:
     #      -15 - fs
     #      -14 - 10fs
@@ -1169,6 +1450,7 @@ module OrigenSim
     #       1  - 10s
     #       2  - 100s
     def timescale
+      return hello[:timescale] if hello
       put('l^')
       get.strip.to_i
     end
@@ -1190,7 +1472,9 @@ module OrigenSim
     end
 
     def match_errors
-      if dut_version > '0.15.0'
+      if reply_trailers?
+        reply_status(:match_errors)
+      elsif dut_version > '0.15.0'
         peek("#{testbench_top}.#{debug_path}.match_errors").to_i
       else
         peek("#{testbench_top}.pins.match_errors").to_i
@@ -1210,11 +1494,402 @@ module OrigenSim
     alias_method :peek_string, :peek_str
     alias_method :string_peek, :peek_str
 
+    # Returns the values of the given nets in a single request to the simulator, this is much faster
+    # than peeking them one at a time.
+    # Vector nets are returned as Origen::Value objects in the same way as peek, while real and string
+    # nets are returned as a Float or String. The value of a net which does not exist is nil.
+    #
+    # Supply str: true to have the values of vector nets decoded as strings in the same way as peek_str.
+    def peek_nets(nets, options = {})
+      unless bridge_feature?(:bulk_peek)
+        return nets.map { |net| options[:str] ? peek_str(net) : peek(net) }
+      end
+      sync_up
+      # Keep each request within the maximum message length that the simulator can accept, each
+      # net adds its name and a separator to the 'B^l' opcode
+      budget = MAX_MESSAGE_LENGTH - 1 - 'B^l'.size
+      batches = [[]]
+      size = 0
+      nets.each do |net|
+        net = clean(net.to_s.dup)
+        if size + net.bytesize + 1 > budget
+          batches << []
+          size = 0
+        end
+        batches.last << net
+        size += net.bytesize + 1
+      end
+      batches.reject(&:empty?).flat_map do |batch|
+        put("B^l^#{batch.join('^')}")
+        get_net_values(options)
+      end
+    end
+
+    # Registers a group of nets with the simulator so that they can later be peeked together by
+    # calling peek_net_group with the given name
+    def define_net_group(name, nets)
+      if bridge_feature?(:bulk_peek)
+        groups = simulation.net_groups
+        id = groups[name] ? groups[name][:id] : groups.size
+        fail 'The maximum number of net groups (256) has been exceeded!' if id > 255
+        put("B^c^#{id}")
+        nets.each { |net| put("B^g^#{id}^#{clean(net.to_s.dup)}") }
+        groups[name] = { id: id, nets: nets }
+      else
+        simulation.net_groups[name] = { nets: nets }
+      end
+    end
+
+    # Returns the values of the nets in the given group (see define_net_group) as a hash, e.g.
+    #
+    #   simulator.peek_net_group(:status)  # => { 'dut.state' => Origen::Value, 'dut.vref' => 1.2 }
+    def peek_net_group(name, options = {})
+      group = simulation.net_groups[name]
+      fail "No net group named #{name} has been defined!" unless group
+      if group[:id]
+        sync_up
+        put("B^p^#{group[:id]}")
+        values = get_net_values(options)
+      else
+        values = peek_nets(group[:nets], options)
+      end
+      group[:nets].zip(values).to_h
+    end
+
     # Returns the number of errors that are allowed before a aborting a simulation
     def max_errors
       OrigenSim.max_errors || config[:max_errors] || 100
     end
 
+    # Switch on wave dumping, optionally limiting it to the given scope and depth (0 means
+    # all levels below the scope). Selecting a scope is only supported for FSDB dumps, for other
+    # wave formats dumping will be switched on for the whole testbench.
+    def dump_on(scope = nil, depth = 0)
+      if shm_waves?
+        Origen.log.warning 'Runtime wave dump control is not supported for Cadence SHM wave dumps, waves will be dumped for the whole simulation'
+      elsif bridge_feature?(:dump_control)
+        if scope && !(config[:vendor] == :synopsys && config[:verdi])
+          Origen.log.warning "Wave dump scope selection is only supported for FSDB dumps, dumping all of #{testbench_top} instead of #{scope}"
+          scope = nil
+        end
+        put(scope ? "x^1^#{clean(scope.to_s.dup)}^#{depth}" : 'x^1')
+      else
+        Origen.log.warning 'Runtime wave dump control is not supported by this DUT, it must be recompiled with the latest OrigenSim'
+      end
+    end
+
+    # Switch off wave dumping
+    def dump_off
+      if shm_waves?
+        Origen.log.warning 'Runtime wave dump control is not supported for Cadence SHM wave dumps, waves will be dumped for the whole simulation'
+      elsif bridge_feature?(:dump_control)
+        put('x^0')
+      else
+        Origen.log.warning 'Runtime wave dump control is not supported by this DUT, it must be recompiled with the latest OrigenSim'
+      end
+    end
+
+    # Drive a piecewise-linear waveform on the given analog pin driver, the waveform is applied by the
+    # bridge independently of the pattern vectors so that it can run concurrently with them.
+    #
+    # The points should be an array of [time_in_ns, value] pairs, where the times are relative to
+    # now, and the drive value will be updated every step_in_ns. The driver will hold the last value
+    # when the waveform ends.
+    def analog_pwl(driver_net, points, step_in_ns)
+      if analog_waves_supported?
+        driver_net = clean(driver_net.to_s.dup)
+        # Split long waveforms across multiple messages, keeping each within the maximum message length
+        # that the simulator can accept
+        msg = "y^#{driver_net}^p^#{ns_to_simtime_units(step_in_ns)}^"
+        sep = ''
+        points.each do |t, v|
+          point = "#{ns_to_simtime_units(t)}_#{v.to_f}"
+          if !sep.empty? && msg.bytesize + 1 + point.bytesize > MAX_MESSAGE_LENGTH - 1
+            put(msg)
+            msg = "y^#{driver_net}^a^"
+            sep = ''
+          end
+          msg << sep << point
+          sep = '_'
+        end
+        put(msg)
+      end
+    end
+
+    # Drive a sine wave on the given analog pin driver, updated every step_in_ns. A duration of 0 means
+    # that it will run until stopped by stop_analog_wave.
+    def analog_sine(driver_net, offset, amplitude, period_in_ns, duration_in_ns, step_in_ns)
+      if analog_waves_supported?
+        put("y^#{clean(driver_net.to_s.dup)}^s^#{ns_to_simtime_units(step_in_ns)}^#{offset.to_f}_#{amplitude.to_f}_" \
+            "#{ns_to_simtime_units(period_in_ns)}_#{ns_to_simtime_units(duration_in_ns)}")
+      end
+    end
+
+    # Stop any waveform being applied to the given analog pin driver, it will hold its current value
+    def stop_analog_wave(driver_net)
+      put("y^#{clean(driver_net.to_s.dup)}^x") if bridge_feature?(:analog_waves)
+    end
+
+    # Start a free-running clock on the given pin, the clock is generated within the simulator by the
+    # bridge so that, unlike toggling the pin from the pattern, it costs no messages once started.
+    # The pin will not follow its pin states from the pattern until the clock is stopped.
+    #
+    # The clock starts low and its first rising edge is :phase ns (default 0) after the start of the
+    # next cycle, the :duty_cycle gives the fraction of the period that it is high (default 0.5).
+    # If the clock is already running it will be restarted.
+    #
+    # Returns true if the clock was started.
+    def start_clock(pin, period_in_ns, options = {})
+      if clocks_supported?
+        put("G^#{pin.simulation_index}^#{clock_times(period_in_ns, options)}^#{ns_to_simtime_units(options[:phase] || 0)}")
+        true
+      else
+        false
+      end
+    end
+
+    # Change the period and/or duty cycle of the free-running clock on the given pin, the change
+    # is applied from its next rising edge so that no short pulses are generated
+    def change_clock(pin, period_in_ns, options = {})
+      put("G^#{pin.simulation_index}^#{clock_times(period_in_ns, options)}^x") if clocks_supported?
+    end
+
+    # Stop the free-running clock on the given pin, the pin will hold its current level until it is
+    # next updated by the pattern
+    def stop_clock(pin)
+      put("G^#{pin.simulation_index}^x") if clocks_supported?
+    end
+
+    # Start sampling the given real-valued net within the simulator, by default a sample is taken on
+    # every value change, or else at every :interval (in ns) if given. If :min and/or :max limits are
+    # given then the first sample to fall outside of them will be reported as a miscompare.
+    # Call stop_analog_measurement to get the results.
+    def start_analog_measurement(net, options = {})
+      if bridge_feature?(:analog_measurements)
+        interval = options[:interval] ? [ns_to_simtime_units(options[:interval]), 1].max : 0
+        min = options[:min] ? options[:min].to_f : 'x'
+        max = options[:max] ? options[:max].to_f : 'x'
+        put("z^#{clean(net.to_s.dup)}^#{interval}^#{min}^#{max}")
+        true
+      else
+        Origen.log.warning 'Analog measurements are not supported by this DUT, it must be recompiled with the latest OrigenSim'
+        false
+      end
+    end
+
+    # Stops sampling the given net and returns the results, e.g.
+    #
+    #   { count: 120, min: 0.4, max: 1.4, mean: 0.9 }
+    #
+    # Returns nil if the DUT does not support analog measurements.
+    def stop_analog_measurement(net)
+      return nil unless bridge_feature?(:analog_measurements)
+      put("z^#{clean(net.to_s.dup)}")
+      count, min, max, mean = *get.strip.split(',')
+      { count: count.to_i, min: min.to_f, max: max.to_f, mean: mean.to_f }
+    end
+
+    # Loads the given image file directly into a memory array within the DUT, this is much faster
+    # than poking each word and can be used to start a pattern from a pre-programmed state.
+    #
+    # The file can either be raw binary, where each word is stored little endian in the minimum
+    # number of bytes, or hex in the format accepted by $readmemh. The format is taken from the file
+    # extension (.hex, .mem, .dat and .txt are treated as hex), or can be given via :format (:bin or :hex).
+    #
+    # The words will be loaded from the start of the array, or from the given :offset from it,
+    # though any @address in a hex file will override that.
+    #
+    # Returns the number of words that were loaded, or nil if the load failed.
+    #
+    #   tester.simulator.load_memory("dut.flash.mem", "images/boot.bin")
+    def load_memory(net, file, options = {})
+      unless bridge_feature?(:load_memory)
+        Origen.log.warning 'Memory loading is not supported by this DUT, it must be recompiled with the latest OrigenSim'
+        return nil
+      end
+      sync_up
+      put("C^#{clean(net.to_s.dup)}^#{File.expand_path(file)}^#{memory_image_format(file, options)}^#{options[:offset] || 0}")
+      m = get.strip
+      return nil if m == 'FAIL'
+      words, rate = *m.split(',')
+      Origen.log.debug "Loaded #{words} words into #{net} (#{rate} words/s)"
+      words.to_i
+    end
+
+    # Dumps the contents of a memory array within the DUT directly to the given image file, in either
+    # of the formats supported by load_memory (X and Z bits are only preserved in a hex image).
+    #
+    # By default the whole array is dumped, a range can be selected by giving the array index to :start
+    # from and/or the number of words to dump via :count.
+    #
+    # Returns the path to the image file, or nil if the dump failed.
+    def dump_memory(net, file, options = {})
+      unless bridge_feature?(:dump_memory)
+        Origen.log.warning 'Memory dumping is not supported by this DUT, it must be recompiled with the latest OrigenSim'
+        return nil
+      end
+      file = File.expand_path(file)
+      FileUtils.mkdir_p(File.dirname(file))
+      sync_up
+      put("D^d^#{clean(net.to_s.dup)}^#{file}^#{memory_image_format(file, options)}^#{options[:start] || 'x'}^#{options[:count] || 'x'}")
+      get.strip == 'FAIL' ? nil : file
+    end
+
+    # Compares the contents of a memory array within the DUT against the given reference image, the
+    # file and options are the same as for load_memory.
+    #
+    # Returns an array containing the index of each word that does not match the image, so an empty
+    # array means that they match, or nil if the comparison could not be made.
+    def compare_memory(net, file, options = {})
+      unless bridge_feature?(:dump_memory)
+        Origen.log.warning 'Memory comparison is not supported by this DUT, it must be recompiled with the latest OrigenSim'
+        return nil
+      end
+      sync_up
+      put("D^c^#{clean(net.to_s.dup)}^#{File.expand_path(file)}^#{memory_image_format(file, options)}^#{options[:offset] || 0}")
+      m = get.strip
+      m == 'FAIL' ? nil : m.to_i.times.map { get.strip.to_i }
+    end
+
+    # Subscribe to the value changes of the given net, the simulator will report them along with its
+    # replies to Origen so that a local copy of the net's value can be maintained without having to
+    # peek it, see subscribed_value.
+    #
+    # If a block is given it will be called with the new value, the cycle count and the time in ns
+    # for every change that is received, this happens the next time that Origen syncs up with the simulator.
+    #
+    #   tester.simulator.subscribe("dut.irq") do |value, cycle, time_in_ns|
+    #     Origen.log.info "IRQ changed to #{value.to_i} in cycle #{cycle}"
+    #   end
+    def subscribe(net, &block)
+      unless bridge_feature?(:subscriptions)
+        Origen.log.warning 'Subscriptions are not supported by this DUT, it must be recompiled with the latest OrigenSim'
+        return nil
+      end
+      unsubscribe(net)
+      subs = simulation.subscriptions
+      id = (0..subs.size).find { |i| !subs[i] }
+      fail 'The maximum number of subscriptions (256) has been exceeded!' if id > 255
+      subs[id] = { net: net.to_s, value: nil, block: block }
+      put("E^s^#{id}^#{clean(net.to_s.dup)}")
+      id
+    end
+
+    # Stop receiving the value changes of the given net
+    def unsubscribe(net)
+      id, _sub = simulation.subscriptions.find { |_id, sub| sub[:net] == net.to_s }
+      if id
+        put("E^u^#{id}")
+        simulation.subscriptions.delete(id)
+      end
+    end
+
+    # Returns the value of the given subscribed net as an Origen::Value, or nil if the net does not exist.
+    # This only requires communication with the simulator if messages have been sent to it since its last
+    # reply, and then only a single sync-up no matter how many subscribed nets are read.
+    def subscribed_value(net)
+      _id, sub = simulation.subscriptions.find { |_id, s| s[:net] == net.to_s }
+      fail "The net #{net} has not been subscribed to!" unless sub
+      sync_up if simulation.reply_status_stale
+      sub[:value]
+    end
+
+    # Returns true if the DUT supports capturing the values of nets on every cycle within the
+    # simulator, see start_bulk_capture
+    def bulk_capture_supported?
+      bridge_feature?(:bulk_capture)
+    end
+
+    # Start recording the values of the given nets at the end of every cycle, this is done within
+    # the simulator and the results are returned all at once by stop_bulk_capture, which is much
+    # faster than peeking them after every cycle
+    def start_bulk_capture(nets)
+      nets.each { |net| put("A^a^#{clean(net.dup)}") }
+      put('A^1')
+    end
+
+    # Stops the bulk capture and returns the values that were recorded as an array of runs of cycles
+    # that had the same values, e.g. for 2 nets:
+    #
+    #   [[10, [Origen::Value, Origen::Value]], [1, [Origen::Value, Origen::Value]], ...]
+    #
+    # A value will be nil if its net could not be found.
+    def stop_bulk_capture
+      put('A^0')
+      get.strip.to_i.times.map do
+        cycles, *values = *get.strip.split(',')
+        [cycles.to_i, values.map { |v| v == 'FAIL' ? nil : Origen::Value.new('b' + v) }]
+      end
+    end
+
+    # Returns the names of the patterns which were not simulated since they were found to have passed
+    # previously, see OrigenSim::ResultCache
+    def cached_passes
+      @cached_passes ||= []
+    end
+
+    # Returns true if the given pattern source has previously passed in simulation and nothing which could
+    # affect its result has changed since then, in which case the simulation can be skipped.
+    # If not, the simulation result will be saved at the end for use next time.
+    def cached_pass?(name, pattern_file)
+      @result_cache_key = nil
+      return false if OrigenSim.rerun || OrigenSim.flow || OrigenSim.record || OrigenSim.fail_waves ||
+                      Origen.interactive? || multi_site?
+      @result_cache_key = ResultCache.key(pattern_file, self)
+      if @result_cache_key && (result = ResultCache.pass(@result_cache_key))
+        Origen.log.success "#{name} passed previously at #{result['time']} and has not changed, skipping the simulation"
+        cached_passes << name
+        @result_cache_key = nil
+        true
+      else
+        false
+      end
+    end
+
+    # Returns true when running a multi-site simulation, i.e. when additional sites have been
+    # defined by the :sites configuration option
+    def multi_site?
+      site? || !site_simulators.empty?
+    end
+
+    # Returns true if this is the simulator for one of the additional sites of a multi-site
+    # simulation, rather than the primary one which is controlled by Origen
+    def site?
+      !!config[:site]
+    end
+
+    # Returns true if the waves are dumped to a Cadence SHM database, this is opened and probed by the
+    # simulator's Tcl input rather than by the testbench, so it can't be switched on and off at runtime
+    def shm_waves?
+      config[:vendor] == :cadence
+    end
+
+    def site_name
+      config[:site_name] || 'site0'
+    end
+
+    # Returns the simulators for the additional sites defined by the :sites configuration option,
+    # each entry in that is a hash of configuration options which will be applied on top of the
+    # primary simulator's configuration, e.g. to run each site with a differently compiled DUT or
+    # with different nets forced:
+    #
+    #   OrigenSim.cadence lsf: '...',
+    #                     sites: [{ name: 'v2', id: 'my_dut_v2' },
+    #                             { name: 'trim_max', forces: { 'dut.trim' => 0xF } }]
+    #
+    # All messages sent to the primary simulator are also sent to each site, with the simulations
+    # running in parallel.
+    def site_simulators
+      @site_simulators ||= (config[:site] ? [] : (config[:sites] || [])).each_with_index.map do |site, i|
+        options = config.merge(site).merge(site: true, site_name: site[:name] || "site#{i + 1}", sites: nil)
+        Simulator.new.configure(options)
+      end
+    end
+
+    def apply_site_forces
+      (config[:forces] || {}).each { |net, value| force(net, value) }
+    end
+
     def marker=(val)
       poke("#{testbench_top}.#{debug_path}.marker", val)
     end
@@ -1241,8 +1916,105 @@ module OrigenSim
     # Returns the simulator cycle count, this should be the same as tester.cycle_count but this
     # gives the simulators count instead of Origen's
     def cycle_count
-      put('o^')
-      get.strip.to_i
+      if reply_trailers?
+        reply_status(:cycle_count)
+      else
+        put('o^')
+        get.strip.to_i
+      end
+    end
+
+    # Returns an array containing the cycle numbers in which miscompares have occurred, or nil if the
+    # DUT does not record them
+    def fail_cycles
+      if bridge_feature?(:fail_waves)
+        put('w^')
+        get.strip.to_i.times.map { get.strip.to_i }
+      else
+        Origen.log.warning 'Fail cycles are not recorded by this DUT, it must be recompiled with the latest OrigenSim'
+        nil
+      end
+    end
+
+    # Returns the file where the fail cycles of the given simulation are saved
+    def fail_cycles_file(name)
+      "#{tmp_dir}/fail_cycles/#{name}.txt"
+    end
+
+    # Saves the fail cycles from the current simulation so that they can be used to limit wave
+    # dumping to the areas around them when the pattern is next simulated with --fail_waves
+    def save_fail_cycles
+      file = fail_cycles_file(simulation.id)
+      cycles = fail_cycles
+      if cycles.empty?
+        FileUtils.rm_f(file)
+      else
+        FileUtils.mkdir_p(File.dirname(file))
+        File.write(file, cycles.join("\n") + "\n")
+      end
+    end
+
+    # Returns the [start, stop] cycle windows within n cycles of the given failing cycles, overlapping
+    # and adjacent windows are merged
+    def self.fail_wave_windows(cycles, n)
+      windows = []
+      cycles.sort.each do |cycle|
+        start = [cycle - n, 0].max
+        if windows.last && start <= windows.last[1] + 1
+          windows.last[1] = cycle + n
+        else
+          windows << [start, cycle + n]
+        end
+      end
+      windows
+    end
+
+    # Tells the simulator to only dump waves around the fail cycles recorded by the last simulation
+    # of the current pattern
+    def enable_fail_waves
+      file = fail_cycles_file(simulation.id)
+      if File.exist?(file)
+        n = OrigenSim.fail_waves
+        windows = self.class.fail_wave_windows(File.readlines(file).map(&:to_i), n)
+        put('v^')
+        windows.each { |start, stop| put("v^#{start}^#{stop}") }
+        Origen.log.info "Waves will only be dumped within #{n} cycles of the failures from the previous simulation (#{windows.size} window#{windows.size == 1 ? '' : 's'})"
+      else
+        # Clear the windows which were sent to all sites by the primary site
+        put('v^') if site?
+        Origen.log.warning "No failures have been recorded for #{simulation.id}, waves will be dumped for the whole simulation"
+      end
+    end
+
+    # Returns the bridge's instrumentation counters as a hash, this can be used to work out
+    # whether a slow simulation is bound by the IPC with Origen, by the bridge or by the simulator.
+    # All histogram times are in ns, bucket n holds the number of samples which took 2^n to 2^(n+1) ns.
+    #
+    #   {
+    #     messages:   { '2' => 10534, '3' => 20012, ... },
+    #     counters:   { cycles: 20012, wave_callbacks: 40024, clock_edges: 0, put_value: 90341, handle_by_name: 312 },
+    #     histograms: { client_get: { count: 30546, total: 10230442, buckets: [0, 0, ...] }, ... }
+    #   }
+    def bridge_stats
+      if bridge_feature?(:stats)
+        stats = { messages: {}, counters: {}, histograms: {} }
+        put('u^')
+        get.strip.to_i.times do
+          type, name, *data = *get.strip.split(',')
+          case type
+          when 'messages'
+            stats[:messages][name] = data[0].to_i
+          when 'counter'
+            stats[:counters][name.to_sym] = data[0].to_i
+          when 'histogram'
+            stats[:histograms][name.to_sym] = { count: data[0].to_i, total: data[1].to_i, buckets: (data[2] || '').split('_').map(&:to_i) }
+          end
+        end
+        stats
+      else
+        Origen.log.warning 'Bridge stats are not supported by this DUT, it must be recompiled with the latest OrigenSim'
+        nil
+      end
     end
 
     def running?
@@ -1265,6 +2037,9 @@ module OrigenSim
           else
             false
           end
+        elsif hello
+          @real_type = hello[:real_type]
+          hello[:real_enabled]
         elsif dut_version >= '0.20.3'
           # These versions support multiple REAL types.
           if peek_str("#{testbench_top}.#{debug_path}.real_type").nil?
@@ -1322,11 +2097,137 @@ module OrigenSim
 
     private
 
+    # Returns the code which connects the simulation monitor's status, stdout, stderr and heartbeat
+    # channels to Origen. When connected over TCP these are all multiplexed over a single connection
+    # by tagging each line, see MonitorDemux.
+    # Note that this is run within double quotes by the shell, so it must not contain any double quotes
+    # or dollar signs.
+    def monitor_connection
+      if simulation.tcp?
+        %(
+        monitor = TCPSocket.new('#{simulation.tcp_host}', #{simulation.tcp_port})
+        monitor.setsockopt(Socket::IPPROTO_TCP, Socket::TCP_NODELAY, 1)
+        monitor.puts('#{simulation.tcp_token}')
+        monitor_lock = Mutex.new
+        channel = lambda do |tag|
+          io = Object.new
+          io.define_singleton_method(:puts) do |line|
+            monitor_lock.synchronize { monitor.puts(tag + line.to_s.chomp) }
+          end
+          io
+        end
+        status = channel.call('S')
+        stdout_socket = channel.call('O')
+        stderr_socket = channel.call('E')
+        heartbeat = monitor
+        )
+      else
+        %(
+        status = UNIXSocket.new('#{simulation.socket_id(:status)}')
+        stdout_socket = UNIXSocket.new('#{simulation.socket_id(:stdout)}')
+        stderr_socket = UNIXSocket.new('#{simulation.socket_id(:stderr)}')
+        heartbeat = UNIXSocket.new('#{simulation.socket_id(:heartbeat)}')
+        )
+      end
+    end
+
+    def start_sites
+      @running_sites = site_simulators.map do |site|
+        site.start
+        simulations << site.simulation
+        site
+      end
+    end
+
+    def stop_sites
+      sites = @running_sites
+      @running_sites = []
+      sites.each(&:stop)
+    end
+
     # Will be called when the simulator has aborted due to the max error count being exceeded
     def max_error_abort
       simulation.max_errors_exceeded = true
     end
 
+    # Reads the response to a bulk peek request, see send_net_values in the bridge for the format
+    def get_net_values(options = {})
+      get.strip.to_i.times.map do
+        type, data = *get.chomp.split(',', 2)
+        case type
+        when 'v'
+          size, *words = *data.split(',')
+          size = size.to_i
+          words = words.map { |w| w.to_i(16) }
+          aval = 0
+          bval = 0
+          words.each_slice(2).with_index do |(a, b), i|
+            aval |= a << (32 * i)
+            bval |= b << (32 * i)
+          end
+          if options[:str] && bval == 0
+            # Decode the bytes as ASCII characters in the same way as peek_str, ignoring any null bytes
+            ((size + 7) / 8).times.map { |i| (aval >> (8 * i)) & 0xFF }.reverse.reject(&:zero?).map(&:chr).join
+          elsif bval == 0
+            Origen::Value.new('b' + aval.to_s(2).rjust(size, '0'))
+          else
+            # The net contains X or Z bits, aval/bval of 0/1 is Z and 1/1 is X
+            bits = (size - 1).downto(0).map do |i|
+              if bval[i] == 1
+                aval[i] == 1 ? 'x' : 'z'
+              else
+                aval[i].to_s
+              end
+            end
+            Origen::Value.new('b' + bits.join)
+          end
+        when 'r' then data.to_f
+        when 's' then data
+        end
+      end
+    end
+
+    # Calls the blocks given to subscribe for the value changes that have been received
+    def dispatch_subscription_events
+      events = simulation.subscription_events.dup
+      simulation.subscription_events.clear
+      events.each do |sub, value, cycle, time|
+        sub[:block].call(value, cycle, simtime_units_to_ns(time))
+      end
+    end
+
+    # Returns the bridge's code for the format of the given memory image file, 'b' for binary or 'h' for hex
+    def memory_image_format(file, options)
+      format = options[:format] || (%w(.hex .mem .dat .txt).include?(File.extname(file).downcase) ? :hex : :bin)
+      format.to_s.start_with?('h') ? 'h' : 'b'
+    end
+
+    def analog_waves_supported?
+      if bridge_feature?(:analog_waves)
+        true
+      else
+        Origen.log.warning 'Analog waveforms are not supported by this DUT, it must be recompiled with the latest OrigenSim'
+        false
+      end
+    end
+
+    def clocks_supported?
+      if bridge_feature?(:clocks)
+        true
+      else
+        Origen.log.warning 'Free-running clocks are not supported by this DUT, it must be recompiled with the latest OrigenSim'
+        false
+      end
+    end
+
+    # Returns the period and high time of a clock in simtime units, in the form sent to the bridge
+    def clock_times(period_in_ns, options)
+      period = ns_to_simtime_units(period_in_ns)
+      fail "The period of a clock must be at least 2 simtime units, got #{period_in_ns}ns" if period < 2
+      high = (period * (options[:duty_cycle] || 0.5)).round
+      "#{period}^#{[[high, 1].max, period - 1].min}"
+    end
+
     def ns_to_simtime_units(time_in_ns)
       if dut_version > '0.15.0'
         (time_in_ns * time_factor).to_i
@@ -22,6 +22,10 @@ module OrigenSim
         "Detail '#{d}' is not an available snapshot detail name!"
       end
 
+      def hello_key
+        :snapshot_details
+      end
+
       ### The user details interface is the same as the snapshot_details ###
       ### just on the snapshot_details itself                            ###
 
@@ -63,6 +63,11 @@ module OrigenSim
       #  to be defined. This should be a comma-separeted string of the available values.
       #  It will be assumed that each details will be defined in the snapshot.
       def fetch
+        # The details are normally sent by the simulator in its hello message at the start of the simulation
+        if @simulator.hello
+          return @simulator.hello[hello_key]
+        end
+
         # Read the available details.
         # names = str_peek("#{debug_module}.PARAMETER_NAMES").split(',')
         names = @simulator.peek_str(detail_names_net)
@@ -98,6 +103,11 @@ module OrigenSim
         "#{@simulator.testbench_top}.debug.snapshot_details.user_details.#{d}"
       end
 
+      # The key of these details within the simulator's hello message
+      def hello_key
+        :user_details
+      end
+
       def detail_names_net
         detail_to_net(DETAIL_NAMES_NET)
       end
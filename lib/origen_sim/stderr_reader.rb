@@ -1,28 +1,34 @@
 require 'thread'
+require 'origen_sim/flush_markers'
 module OrigenSim
   class StderrReader < Thread
+    include FlushMarkers
+
     attr_reader :socket, :logged_errors
 
-    def initialize(socket)
+    def initialize(socket, prefix = '')
       @socket = socket
       @continue = true
       @logged_errors = false
       @last_message_at = Time.now
+      init_flush_markers
       super do
         begin
           while @continue
             line = @socket.gets
             if line
               line = line.chomp
-              if OrigenSim.fail_on_stderr && !line.empty? &&
+              if line =~ /#{OrigenSim::Simulator::FLUSH_MARKER}(\d+)/
+                flush_marker_received(Regexp.last_match(1).to_i)
+              elsif OrigenSim.fail_on_stderr && !line.empty? &&
                  !OrigenSim.stderr_string_exceptions.any? { |s| s.is_a?(Regexp) ? s.match?(line) : line =~ /#{s}/i }
                 # We're failing on stderr, so print its results and log as errors if its not an exception.
                 @logged_errors = true
-                Origen.log.error "(STDERR): #{line}", from_origen_sim: true
+                Origen.log.error "#{prefix}(STDERR): #{line}", from_origen_sim: true
               elsif OrigenSim.verbose?
-                Origen.log.info line, from_origen_sim: true
+                Origen.log.info prefix + line, from_origen_sim: true
               else
-                Origen.log.debug line, from_origen_sim: true
+                Origen.log.debug prefix + line, from_origen_sim: true
               end
               @last_message_at = Time.now
             end
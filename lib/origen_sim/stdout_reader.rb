@@ -1,13 +1,17 @@
 require 'thread'
+require 'origen_sim/flush_markers'
 module OrigenSim
   class StdoutReader < Thread
+    include FlushMarkers
+
     attr_reader :socket, :logged_errors
 
-    def initialize(socket, simulator)
+    def initialize(socket, simulator, prefix = '')
       @socket = socket
       @continue = true
       @logged_errors = false
       @last_message_at = Time.now
+      init_flush_markers
       super do
         begin
           line = nil
@@ -37,9 +41,11 @@ module OrigenSim
 
             if line
               line = line.chomp
+              if line =~ /#{OrigenSim::Simulator::FLUSH_MARKER}(\d+)/
+                flush_marker_received(Regexp.last_match(1).to_i)
               # If line has been sent from Origen for logging
               # https://rubular.com/r/1czQZnlhBq9YtK
-              if line =~ /^!(\d)!\[\s*((\d+),)?\s*(\d+)\]\s*(.*)/
+              elsif line =~ /^!(\d)!\[\s*((\d+),)?\s*(\d+)\]\s*(.*)/
                 if Regexp.last_match(3)
                   time_in_sim_units = (Regexp.last_match(3).to_i << 32) | Regexp.last_match(4).to_i
                   time_in_ns = simulator.send(:simtime_units_to_ns, time_in_sim_units)
@@ -47,12 +53,13 @@ module OrigenSim
                   # Messages sent from the Origen testbench already have a timestamp in ns
                   time_in_ns = Regexp.last_match(4).to_i
                 end
-                msg = "#{time_in_ns}".rjust(11) + ' ns: ' + Regexp.last_match(5)
+                msg = "#{time_in_ns}".rjust(11) + ' ns: ' + prefix + Regexp.last_match(5)
 
                 Origen.log.send(Simulator::LOG_CODES_[Regexp.last_match(1).to_i], msg, from_origen_sim: true)
 
                 simulator.send(:max_error_abort) if line =~ /!MAX_ERROR_ABORT!/
               else
+                line = prefix + line
                 if OrigenSim.error_strings.any? { |s| s.is_a?(Regexp) ? s.match?(line) : line =~ /#{s}/i } &&
                    !OrigenSim.error_string_exceptions.any? { |s| s.is_a?(Regexp) ? s.match?(line) : line =~ /#{s}/i }
                   @logged_errors = true
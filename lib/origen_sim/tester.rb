@@ -64,6 +64,20 @@ module OrigenSim
       end
     end
 
+    # Switch on wave dumping, optionally limiting it to the given scope (e.g. 'dut.core') and depth,
+    # where 0 means all levels below the scope. Selecting a scope is only supported for FSDB dumps.
+    #
+    #   tester.dump_on
+    #   tester.dump_on('dut.core', 2)
+    def dump_on(scope = nil, depth = 0)
+      simulator.dump_on(scope, depth)
+    end
+
+    # Switch off wave dumping
+    def dump_off
+      simulator.dump_off
+    end
+
     # Start the simulator
     def start
       simulator.start
@@ -118,6 +132,7 @@ module OrigenSim
     end
 
     def c1(msg, options = {})
+      simulator.profiler.region = msg if simulator.profiler
       if @step_comment_on
         PatSeq.add_thread(msg) unless options[:no_thread_id]
         simulator.log msg
@@ -129,6 +144,7 @@ module OrigenSim
       simulator.log '=' * 70
       super
       simulator.log '=' * 70
+      simulator.profiler.region = msg if simulator.profiler && msg
     end
 
     def loop_vectors(name, number_of_loops, options = {})
@@ -284,6 +300,10 @@ module OrigenSim
       # This could be called multiple times for the same transaction
       if read_reg_open?
         yield
+      elsif simulator.pipelined?
+        # Don't wait for the outcome of each read, any miscompares will still be reported by the
+        # simulator as they occur
+        yield
       else
         @read_reg_meta_supplied = false
         @read_reg_open = true
@@ -307,7 +327,11 @@ module OrigenSim
           read_flags = reg_or_val.map(&:is_to_be_read?)
         end
 
-        error_count = simulator.error_count
+        # When the simulator returns the error count with its replies, the transaction result
+        # itself tells us whether any errors occurred and the count is not needed up front
+        unless @supports_transactions && simulator.reply_trailers?
+          error_count = simulator.error_count
+        end
 
         simulator.start_read_reg_transaction if @supports_transactions
 
@@ -319,7 +343,7 @@ module OrigenSim
 
         @read_reg_open = false
 
-        if simulator.error_count > error_count
+        if error_count ? simulator.error_count > error_count : errors_captured
           if @supports_transactions
             actual_data_available = true
             if exceeded_max_errors
@@ -489,6 +513,21 @@ module OrigenSim
       simulator.peek_real(*args)
     end
 
+    # Shorthand for simulator.peek_nets
+    def peek_nets(*args)
+      simulator.peek_nets(*args)
+    end
+
+    # Shorthand for simulator.define_net_group
+    def define_net_group(*args)
+      simulator.define_net_group(*args)
+    end
+
+    # Shorthand for simulator.peek_net_group
+    def peek_net_group(*args)
+      simulator.peek_net_group(*args)
+    end
+
     # Shorthand for simulator.force
     def force(*args)
       simulator.force(*args)
@@ -499,15 +538,34 @@ module OrigenSim
       simulator.release(*args)
     end
 
+    # Shorthand for simulator.load_memory
+    def load_memory(*args)
+      simulator.load_memory(*args)
+    end
+
+    # Shorthand for simulator.dump_memory
+    def dump_memory(*args)
+      simulator.dump_memory(*args)
+    end
+
+    # Shorthand for simulator.compare_memory
+    def compare_memory(*args)
+      simulator.compare_memory(*args)
+    end
+
     private
 
     def flush_comments
-      # Looping for at least the length of the last comment is require to ensure that all lines
-      # from the last comment are either overwritten or cleared
-      [@comment_buffer.size, @last_comment_size].max.times do |i|
-        simulator.write_comment(i, @comment_buffer[i])
+      if simulator.comment_file
+        simulator.comment_file.write(simulator.simulation.time_in_ns, simulator.simulation.cycle_count, @comment_buffer)
+      else
+        # Looping for at least the length of the last comment is require to ensure that all lines
+        # from the last comment are either overwritten or cleared
+        [@comment_buffer.size, @last_comment_size].max.times do |i|
+          simulator.write_comment(i, @comment_buffer[i])
+        end
+        @last_comment_size = @comment_buffer.size
       end
-      @last_comment_size = @comment_buffer.size
       @comment_buffer.clear
     end
 
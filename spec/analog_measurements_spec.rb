@@ -0,0 +1,39 @@
+require 'spec_helper'
+
+describe "Analog measurements" do
+
+  # A simulator with a 1ps timescale which supports the given bridge features and records the messages
+  # sent to it, the given lines are returned as its replies
+  def sim(features, *replies)
+    sent = []
+    queue = replies.map { |l| "#{l}\n" }
+    OrigenSim::Simulator.new.tap do |s|
+      s.instance_variable_set(:@configuration, {})
+      s.define_singleton_method(:bridge_feature?) { |name| features.include?(name) }
+      s.define_singleton_method(:ns_to_simtime_units) { |t| (t * 1000).to_i }
+      s.define_singleton_method(:put) { |msg| sent << msg }
+      s.define_singleton_method(:get) { queue.shift }
+      s.define_singleton_method(:sent) { sent }
+    end
+  end
+
+  it "a measurement is sampled on every change unless an interval is given" do
+    s = sim([:analog_measurements])
+    s.start_analog_measurement('dut.vref').should == true
+    s.start_analog_measurement('origen.pins.ana.pin', interval: 2.5, min: 0.5, max: 1)
+    s.sent.should == ['z^origen.dut.vref^0^x^x', 'z^origen.pins.ana.pin^2500^0.5^1.0']
+  end
+
+  it "the results are returned when the measurement is stopped" do
+    s = sim([:analog_measurements], '120,0.4,1.4,0.9')
+    s.stop_analog_measurement('origen.pins.ana.pin').should == { count: 120, min: 0.4, max: 1.4, mean: 0.9 }
+    s.sent.should == ['z^origen.pins.ana.pin']
+  end
+
+  it "measurements are not started on DUTs which do not support them" do
+    s = sim([])
+    s.start_analog_measurement('dut.vref').should == false
+    s.stop_analog_measurement('dut.vref').should == nil
+    s.sent.should == []
+  end
+end
@@ -0,0 +1,62 @@
+require 'spec_helper'
+
+describe "Analog waveforms" do
+
+  # A simulator with a 1ps timescale which supports the given bridge features and records the messages
+  # sent to it
+  def sim(features = [:analog_waves])
+    sent = []
+    OrigenSim::Simulator.new.tap do |s|
+      s.instance_variable_set(:@configuration, {})
+      s.define_singleton_method(:bridge_feature?) { |name| features.include?(name) }
+      s.define_singleton_method(:ns_to_simtime_units) { |t| (t * 1000).to_i }
+      s.define_singleton_method(:put) { |msg| sent << msg }
+      s.define_singleton_method(:sent) { sent }
+    end
+  end
+
+  it "a piecewise-linear waveform is sent in a single message" do
+    s = sim
+    s.analog_pwl('origen.pins.ana', [[0, 0], [100, 1.25], [150, 0.5]], 2.5)
+    s.sent.should == ['y^origen.pins.ana^p^2500^0_0.0_100000_1.25_150000_0.5']
+  end
+
+  it "long waveforms are split across messages which fit within the simulator's message buffer" do
+    s = sim
+    points = 200.times.map { |i| [i * 10, i * 0.01] }
+    s.analog_pwl('origen.pins.ana', points, 1)
+    s.sent.size.should == 3
+    s.sent[0].start_with?('y^origen.pins.ana^p^1000^0_0.0_10000_0.01_').should == true
+    s.sent.drop(1).each { |m| m.start_with?('y^origen.pins.ana^a^').should == true }
+    s.sent.map { |m| m.split('^').last }.join('_').should == points.map { |t, v| "#{t * 1000}_#{v.to_f}" }.join('_')
+    s.sent.each_cons(2) do |msg, following|
+      # Each message is as full as it can be
+      next_point = following.split('^').last.split('_').first(2).join('_')
+      (msg.size < OrigenSim::Simulator::MAX_MESSAGE_LENGTH).should == true
+      (msg.size + 1 + next_point.size >= OrigenSim::Simulator::MAX_MESSAGE_LENGTH).should == true
+    end
+  end
+
+  it "sine waves are sent with their offset, amplitude, period and duration" do
+    s = sim
+    s.analog_sine('origen.pins.ana', 0.9, 0.5, 1000, 0, 20)
+    s.stop_analog_wave('origen.pins.ana')
+    s.sent.should == ['y^origen.pins.ana^s^20000^0.9_0.5_1000000_0', 'y^origen.pins.ana^x']
+  end
+
+  it "the pin driver can be given relative to the DUT" do
+    s = sim
+    s.analog_pwl('dut.ana_drv', [[0, 0]], 1)
+    s.analog_sine('dut.ana_drv', 0.9, 0.5, 1000, 0, 20)
+    s.stop_analog_wave('dut.ana_drv')
+    s.sent.map { |m| m.split('^')[1] }.should == ['origen.dut.ana_drv'] * 3
+  end
+
+  it "nothing is sent to DUTs which do not support analog waveforms" do
+    s = sim([])
+    s.analog_pwl('origen.pins.ana', [[0, 0], [100, 1]], 1)
+    s.analog_sine('origen.pins.ana', 0, 1, 100, 0, 2)
+    s.stop_analog_wave('origen.pins.ana')
+    s.sent.should == []
+  end
+end
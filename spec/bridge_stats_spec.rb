@@ -0,0 +1,34 @@
+require 'spec_helper'
+
+describe "Bridge stats" do
+
+  # A simulator which supports the given bridge features and which records the messages sent to it,
+  # the given lines are returned as the simulator's replies
+  def sim(features, *replies)
+    sent = []
+    queue = replies.map { |l| "#{l}\n" }
+    OrigenSim::Simulator.new.tap do |s|
+      s.define_singleton_method(:bridge_feature?) { |name| features.include?(name) }
+      s.define_singleton_method(:put) { |msg| sent << msg }
+      s.define_singleton_method(:get) { queue.shift }
+      s.define_singleton_method(:sent) { sent }
+    end
+  end
+
+  it "the stats report is parsed" do
+    s = sim([:stats], 5, 'messages,2,10534', 'messages,7,12', 'counter,cycles,20012',
+            'histogram,client_get,30546,10230442,0_0_3_9', 'histogram,wave_callbacks,0,0')
+    stats = s.bridge_stats
+    s.sent.should == ['u^']
+    stats[:messages].should == { '2' => 10534, '7' => 12 }
+    stats[:counters].should == { cycles: 20012 }
+    stats[:histograms][:client_get].should == { count: 30546, total: 10230442, buckets: [0, 0, 3, 9] }
+    stats[:histograms][:wave_callbacks].should == { count: 0, total: 0, buckets: [] }
+  end
+
+  it "nothing is sent to DUTs which do not support stats" do
+    s = sim([])
+    s.bridge_stats.should == nil
+    s.sent.should == []
+  end
+end
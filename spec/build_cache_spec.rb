@@ -0,0 +1,86 @@
+require 'spec_helper'
+require 'tmpdir'
+require 'origen_sim/build_cache'
+
+describe "The build cache" do
+
+  around :each do |example|
+    Dir.mktmpdir do |dir|
+      @dir = dir
+      example.run
+    end
+  end
+
+  def write(name, content)
+    f = "#{@dir}/#{name}"
+    FileUtils.mkdir_p(File.dirname(f))
+    File.write(f, content)
+    f
+  end
+
+  it "the testbench key changes when the RTL or the build options change" do
+    rtl = write("dut.v", "module dut; endmodule\n")
+    key = OrigenSim::BuildCache.testbench_key([rtl], top: 'dut')
+    OrigenSim::BuildCache.testbench_key([rtl], top: 'dut').should == key
+    OrigenSim::BuildCache.testbench_key([rtl], top: 'dut', output: 'elsewhere').should == key
+    OrigenSim::BuildCache.testbench_key([rtl], top: 'dut', dump_off: true).should_not == key
+    write("dut.v", "module dut(input a); endmodule\n")
+    OrigenSim::BuildCache.testbench_key([rtl], top: 'dut').should_not == key
+  end
+
+  it "the compile inputs are resolved from file lists, libraries and include directories" do
+    write("rtl/a.v", "")
+    write("rtl/b.v", "")
+    write("lib/cells.v", "")
+    write("ydir/mux.v", "")
+    write("inc/defs.vh", "")
+    write("nested.f", "rtl/b.v  // A comment\n")
+    write("files.f", "# A comment\nrtl/a.v\n-F nested.f\n")
+    Dir.chdir(@dir) do
+      inputs = OrigenSim::BuildCache.compile_inputs("xrun -f files.f -v lib/cells.v -y ydir +incdir+inc top.v")
+      inputs = inputs.map { |f| File.expand_path(f).sub("#{File.realpath(@dir)}/", '').sub("#{@dir}/", '') }
+      %w(files.f rtl/a.v rtl/b.v nested.f lib/cells.v ydir/mux.v inc/defs.vh).each do |f|
+        inputs.include?(f).should == true
+      end
+    end
+  end
+
+  it "the snapshot key changes when the testbench, the compile command or any of the compiled files change" do
+    write("rtl/a.v", "module a; endmodule\n")
+    write("inc/defs.vh", "`define A 1\n")
+    write("files.f", "rtl/a.v\n")
+    write("extra/model.sv", "")
+    cmd = "vcs -f files.f +incdir+inc"
+    Dir.chdir(@dir) do
+      key = OrigenSim::BuildCache.snapshot_key('tb', cmd)
+      OrigenSim::BuildCache.snapshot_key('tb', cmd).should == key
+      OrigenSim::BuildCache.snapshot_key('tb2', cmd).should_not == key
+      OrigenSim::BuildCache.snapshot_key('tb', "#{cmd} +define+X").should_not == key
+      write("inc/defs.vh", "`define A 2\n")
+      key2 = OrigenSim::BuildCache.snapshot_key('tb', cmd)
+      key2.should_not == key
+      write("rtl/a.v", "module a(input x); endmodule\n")
+      key3 = OrigenSim::BuildCache.snapshot_key('tb', cmd)
+      key3.should_not == key2
+      with_extra = OrigenSim::BuildCache.snapshot_key('tb', cmd, ["#{@dir}/extra"])
+      with_extra.should_not == key3
+      write("extra/model.sv", "module model; endmodule\n")
+      OrigenSim::BuildCache.snapshot_key('tb', cmd, ["#{@dir}/extra"]).should_not == with_extra
+    end
+  end
+
+  it "entries can be stored and fetched" do
+    ENV['ORIGEN_SIM_BUILD_CACHE'] = "#{@dir}/cache"
+    begin
+      src = write("out/origen.v", "module origen; endmodule\n")
+      OrigenSim::BuildCache.fetch(:testbench, 'abc', "#{@dir}/dest").should == false
+      OrigenSim::BuildCache.store(:testbench, 'abc', [src], 'top' => 'dut')
+      OrigenSim::BuildCache.fetch(:testbench, 'abc', "#{@dir}/dest").should == true
+      File.read("#{@dir}/dest/origen.v").should == "module origen; endmodule\n"
+      OrigenSim::BuildCache.meta(:testbench, 'abc').should == { 'top' => 'dut' }
+      OrigenSim::BuildCache.stats.should == { hits: 1, misses: 1 }
+    ensure
+      ENV.delete('ORIGEN_SIM_BUILD_CACHE')
+    end
+  end
+end
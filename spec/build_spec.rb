@@ -60,4 +60,23 @@ describe 'The build command' do
 
     dut.pins(:soc_addr).size.should == 20
   end
+
+  it "can build a DPI testbench" do
+    ARGV.pop
+    ARGV << "#{Origen.root}/examples/dut.v"
+    ARGV << "--dpi"
+    ARGV << "-s"
+    ARGV << "#{Origen.root}/examples/params"
+
+    $_testing_build_return_dut_ = true
+
+    begin
+      load "#{Origen.root}/lib/origen_sim/commands/build.rb"
+    rescue SystemExit # Just to make sure the spec fails
+    end
+
+    dut.should be
+
+    dut.pins(:soc_addr).size.should == 20
+  end
 end
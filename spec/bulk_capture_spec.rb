@@ -0,0 +1,35 @@
+require 'spec_helper'
+
+describe "Bulk capture" do
+
+  # A simulator which records the messages sent to it, the given lines are returned as its replies
+  def sim(*replies)
+    sent = []
+    queue = replies.map { |l| "#{l}\n" }
+    OrigenSim::Simulator.new.tap do |s|
+      s.instance_variable_set(:@configuration, {})
+      s.define_singleton_method(:put) { |msg| sent << msg }
+      s.define_singleton_method(:get) { queue.shift }
+      s.define_singleton_method(:sent) { sent }
+    end
+  end
+
+  it "the nets to capture are registered before the capture is started" do
+    s = sim
+    s.start_bulk_capture(['dut.tdo', 'origen.pins.data[3..0]'])
+    s.sent.should == ['A^a^origen.dut.tdo', 'A^a^origen.pins.data[3:0]', 'A^1']
+  end
+
+  it "the captured runs of cycles are decoded" do
+    s = sim(3, '10,1,0101', '1,0,FAIL', '2,x,0z01')
+    runs = s.stop_bulk_capture
+    s.sent.should == ['A^0']
+    runs.map(&:first).should == [10, 1, 2]
+    runs[0][1].map(&:to_i).should == [1, 5]
+    runs[1][1][0].to_i.should == 0
+    # A net which could not be found has no value
+    runs[1][1][1].should == nil
+    runs[2][1][0].x?.should == true
+    runs[2][1][1][2].z?.should == true
+  end
+end
@@ -0,0 +1,123 @@
+require 'spec_helper'
+
+describe "Bulk peeks" do
+
+  # A simulator which supports the given bridge features and records the messages sent to it, the
+  # given lines are returned as its replies
+  def sim(features = [:bulk_peek], *replies)
+    sent = []
+    queue = replies.map { |l| "#{l}\n" }
+    simulation = OrigenSim::Simulation.allocate
+    simulation.instance_variable_set(:@net_groups, {})
+    OrigenSim::Simulator.new.tap do |s|
+      s.instance_variable_set(:@configuration, {})
+      s.instance_variable_set(:@simulation, simulation)
+      s.define_singleton_method(:bridge_feature?) { |name| features.include?(name) }
+      s.define_singleton_method(:sync_up) { sent << '7^' }
+      s.define_singleton_method(:put) { |msg| sent << msg }
+      s.define_singleton_method(:get) { queue.shift }
+      s.define_singleton_method(:sent) { sent }
+    end
+  end
+
+  it "net values are decoded" do
+    values = sim([:bulk_peek], 3, 'v,8,a5,0', 'v,40,ffffffff,0,ab,0', 'v,1,0,0').send(:get_net_values)
+    values[0].to_i.should == 0xA5
+    values[0].size.should == 8
+    values[1].to_i.should == 0xAB_FFFF_FFFF
+    values[1].size.should == 40
+    values[2].to_i.should == 0
+  end
+
+  it "net values containing X and Z bits are decoded" do
+    # aval/bval of 0/1 is Z and 1/1 is X
+    value = sim([:bulk_peek], 1, 'v,10,20a,206').send(:get_net_values)[0]
+    value.size.should == 10
+    value.to_i.should == nil
+    value[0].x?.should == false
+    value[0].z?.should == false
+    value[1].x?.should == true
+    value[2].z?.should == true
+    value[3].to_i.should == 1
+    value[9].x?.should == true
+  end
+
+  it "net values can be decoded as strings" do
+    s = sim([:bulk_peek], 2, "v,16,#{'Hi'.unpack1('H*')},0", "v,32,#{'abc'.unpack1('H*')},0")
+    s.send(:get_net_values, str: true).should == ['Hi', 'abc']
+  end
+
+  it "real and string variables are decoded" do
+    sim([:bulk_peek], 2, 'r,1.25', 's,Hello, world').send(:get_net_values).should == [1.25, 'Hello, world']
+  end
+
+  it "the nets are peeked in a single request" do
+    s = sim([:bulk_peek], 2, 'v,4,5,0', 'r,0.5')
+    values = s.peek_nets(['dut.state[3..0]', 'dut.vref'])
+    s.sent.should == ['7^', 'B^l^origen.dut.state[3:0]^origen.dut.vref']
+    values[0].to_i.should == 5
+    values[1].should == 0.5
+  end
+
+  it "requests are split to keep them within the maximum message size" do
+    nets = 100.times.map { |i| "origen.dut.block#{i}.status" }
+    s = sim
+    # Reply to each request with a value for every net in it
+    pending = []
+    s.define_singleton_method(:get) do
+      if pending.empty?
+        n = sent.last.split('^').size - 2
+        pending.concat(['v,1,1,0'] * n)
+        "#{n}\n"
+      else
+        "#{pending.shift}\n"
+      end
+    end
+    s.peek_nets(nets).size.should == 100
+    requests = s.sent.select { |m| m.start_with?('B^l^') }
+    requests.size.should == 3
+    requests.map { |m| m.split('^').drop(2) }.flatten.should == nets
+    requests.each { |m| (m.size < OrigenSim::Simulator::MAX_MESSAGE_LENGTH).should == true }
+  end
+
+  it "a request can fill the whole of the simulator's message buffer" do
+    # Together with 'B^l^origen.b^' this makes the longest message that the simulator can accept
+    long = "origen.#{'a' * (OrigenSim::Simulator::MAX_MESSAGE_LENGTH - 21)}"
+    s = sim([:bulk_peek], 2, 'v,1,1,0', 'v,1,0,0', 1, 'v,1,1,0')
+    s.peek_nets(['origen.b', long, 'origen.c']).map(&:to_i).should == [1, 0, 1]
+    s.sent.should == ['7^', "B^l^origen.b^#{long}", 'B^l^origen.c']
+    s.sent[1].size.should == OrigenSim::Simulator::MAX_MESSAGE_LENGTH - 1
+  end
+
+  it "net groups are registered with the simulator and peeked together" do
+    s = sim([:bulk_peek], 2, 'v,2,3,0', 'v,1,0,0')
+    s.define_net_group(:status, ['dut.state', 'dut.busy'])
+    s.define_net_group(:other, ['dut.other'])
+    values = s.peek_net_group(:status)
+    s.sent.should == ['B^c^0', 'B^g^0^origen.dut.state', 'B^g^0^origen.dut.busy', 'B^c^1', 'B^g^1^origen.dut.other',
+                      '7^', 'B^p^0']
+    values['dut.state'].to_i.should == 3
+    values['dut.busy'].to_i.should == 0
+  end
+
+  it "no more net groups can be defined than the simulator can hold" do
+    s = sim
+    256.times { |i| s.define_net_group("group#{i}", ['dut.state']) }
+    message = begin
+      s.define_net_group(:one_too_many, ['dut.state'])
+    rescue RuntimeError => e
+      e.message
+    end
+    message.should == 'The maximum number of net groups (256) has been exceeded!'
+    # Groups which have already been defined can still be redefined
+    s.define_net_group('group0', ['dut.busy'])
+  end
+
+  it "nets are peeked one at a time on DUTs which do not support bulk peeks" do
+    s = sim([])
+    s.define_singleton_method(:peek) { |net| "peek of #{net}" }
+    s.define_net_group(:status, ['dut.state', 'dut.busy'])
+    s.peek_net_group(:status).should == { 'dut.state' => 'peek of dut.state', 'dut.busy' => 'peek of dut.busy' }
+    s.sent.should == []
+  end
+end
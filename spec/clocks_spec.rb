@@ -0,0 +1,55 @@
+require 'spec_helper'
+
+describe "Free-running clocks" do
+
+  # Stands in for a pin, only its index within the simulation is needed
+  ClockPin = Struct.new(:simulation_index)
+
+  # A simulator with a 1ps timescale which supports the given bridge features and records the messages
+  # sent to it
+  def sim(features = [:clocks])
+    sent = []
+    OrigenSim::Simulator.new.tap do |s|
+      s.define_singleton_method(:bridge_feature?) { |name| features.include?(name) }
+      s.define_singleton_method(:ns_to_simtime_units) { |t| (t * 1000).to_i }
+      s.define_singleton_method(:put) { |msg| sent << msg }
+      s.define_singleton_method(:sent) { sent }
+    end
+  end
+
+  def clk
+    ClockPin.new(3)
+  end
+
+  it "a clock is started, changed and stopped" do
+    s = sim
+    s.start_clock(clk, 10, phase: 2.5).should == true
+    s.change_clock(clk, 20, duty_cycle: 0.25)
+    s.stop_clock(clk)
+    s.sent.should == ['G^3^10000^5000^2500', 'G^3^20000^5000^x', 'G^3^x']
+  end
+
+  it "the high time is kept within the period" do
+    s = sim
+    s.start_clock(clk, 0.002, duty_cycle: 0)
+    s.start_clock(clk, 0.002, duty_cycle: 1)
+    s.sent.should == ['G^3^2^1^0', 'G^3^2^1^0']
+  end
+
+  it "clocks which are too fast for the timescale are rejected" do
+    message = begin
+      sim.start_clock(clk, 0.001)
+    rescue RuntimeError => e
+      e.message
+    end
+    message.should == 'The period of a clock must be at least 2 simtime units, got 0.001ns'
+  end
+
+  it "nothing is sent to DUTs which do not support clocks" do
+    s = sim([])
+    s.start_clock(clk, 10).should == false
+    s.change_clock(clk, 20)
+    s.stop_clock(clk)
+    s.sent.should == []
+  end
+end
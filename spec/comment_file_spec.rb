@@ -0,0 +1,47 @@
+require 'spec_helper'
+require 'tmpdir'
+require 'origen_sim/comment_file'
+
+describe "The comment file" do
+
+  around :each do |example|
+    Dir.mktmpdir do |dir|
+      @file = "#{dir}/my_pattern.comments"
+      example.run
+    end
+  end
+
+  it "the comment active at a given time can be read back" do
+    f = OrigenSim::CommentFile.new(@file)
+    f.write(100, 1, ['Write register ctrl', '  Address: 0x1234'])
+    f.write(500, 5, ['Read register status'])
+    f.close
+    OrigenSim::CommentFile.at(@file, 50).should == []
+    OrigenSim::CommentFile.at(@file, 100).should == ['Write register ctrl', '  Address: 0x1234']
+    OrigenSim::CommentFile.at(@file, 499).should == ['Write register ctrl', '  Address: 0x1234']
+    OrigenSim::CommentFile.at(@file, 500).should == ['Read register status']
+    OrigenSim::CommentFile.at(@file, 10_000).should == ['Read register status']
+  end
+
+  it "tabs and newlines within comments don't corrupt the file" do
+    f = OrigenSim::CommentFile.new(@file)
+    f.write(10, 1, ["A\ttabbed\ncomment"])
+    f.close
+    OrigenSim::CommentFile.at(@file, 10).should == ['A tabbed comment']
+  end
+
+  it "the index gives the same results as reading the whole file" do
+    n = OrigenSim::CommentFile::INDEX_INTERVAL * 3 + 7
+    f = OrigenSim::CommentFile.new(@file)
+    n.times { |i| f.write(i * 10, i, ["Block #{i}", "Line 2 of block #{i}"]) }
+    f.close
+    File.readlines("#{@file}.idx").size.should == 4
+    [0, 5, 995, 1000, 2005, (n - 1) * 10, n * 10].each do |t|
+      i = [t / 10, n - 1].min
+      OrigenSim::CommentFile.at(@file, t).should == ["Block #{i}", "Line 2 of block #{i}"]
+    end
+    # Without the index the file is read from the start
+    File.delete("#{@file}.idx")
+    OrigenSim::CommentFile.at(@file, 2005).should == ['Block 200', 'Line 2 of block 200']
+  end
+end
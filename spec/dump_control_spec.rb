@@ -0,0 +1,50 @@
+require 'spec_helper'
+
+describe "Runtime wave dump control" do
+
+  # A simulator with the given configuration which supports the given bridge features and records
+  # the messages sent to it
+  def sim(config, features = [:dump_control])
+    sent = []
+    OrigenSim::Simulator.new.tap do |s|
+      s.instance_variable_set(:@configuration, config)
+      s.define_singleton_method(:bridge_feature?) { |name| features.include?(name) }
+      s.define_singleton_method(:put) { |msg| sent << msg }
+      s.define_singleton_method(:sent) { sent }
+    end
+  end
+
+  it "dumping is switched on and off" do
+    s = sim(vendor: :icarus)
+    s.dump_on
+    s.dump_off
+    s.sent.should == ['x^1', 'x^0']
+  end
+
+  it "a scope can be given for FSDB dumps" do
+    s = sim(vendor: :synopsys, verdi: true)
+    s.dump_on('dut.core', 2)
+    s.dump_on('dut.core[3..0]')
+    s.sent.should == ['x^1^origen.dut.core^2', 'x^1^origen.dut.core[3:0]^0']
+  end
+
+  it "dumping is switched on for the whole testbench when scopes are not supported" do
+    s = sim(vendor: :synopsys)
+    s.dump_on('dut.core', 2)
+    s.sent.should == ['x^1']
+  end
+
+  it "nothing is sent to DUTs which do not support dump control" do
+    s = sim({ vendor: :icarus }, [])
+    s.dump_on
+    s.dump_off
+    s.sent.should == []
+  end
+
+  it "nothing is sent for Cadence SHM dumps, which can't be controlled at runtime" do
+    s = sim(vendor: :cadence)
+    s.dump_on
+    s.dump_off
+    s.sent.should == []
+  end
+end
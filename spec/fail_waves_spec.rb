@@ -0,0 +1,38 @@
+require 'spec_helper'
+
+describe "Fail waves" do
+
+  # A simulator which supports the given bridge features and records the messages sent to it, the
+  # given lines are returned as its replies
+  def sim(features, *replies)
+    sent = []
+    queue = replies.map { |l| "#{l}\n" }
+    OrigenSim::Simulator.new.tap do |s|
+      s.define_singleton_method(:bridge_feature?) { |name| features.include?(name) }
+      s.define_singleton_method(:put) { |msg| sent << msg }
+      s.define_singleton_method(:get) { queue.shift }
+      s.define_singleton_method(:sent) { sent }
+    end
+  end
+
+  it "the failing cycles are read from the simulator" do
+    s = sim([:fail_waves], 3, 12, 400, 1001)
+    s.fail_cycles.should == [12, 400, 1001]
+    s.sent.should == ['w^']
+  end
+
+  it "nothing is sent to DUTs which do not record the failing cycles" do
+    s = sim([])
+    s.fail_cycles.should == nil
+    s.sent.should == []
+  end
+
+  it "the windows around the failing cycles are merged" do
+    OrigenSim::Simulator.fail_wave_windows([], 100).should == []
+    OrigenSim::Simulator.fail_wave_windows([50], 100).should == [[0, 150]]
+    OrigenSim::Simulator.fail_wave_windows([300, 10, 120, 50], 50).should == [[0, 170], [250, 350]]
+    # Adjacent windows are merged, those with a gap between them are not
+    OrigenSim::Simulator.fail_wave_windows([100, 121], 10).should == [[90, 131]]
+    OrigenSim::Simulator.fail_wave_windows([100, 122], 10).should == [[90, 110], [112, 132]]
+  end
+end
@@ -0,0 +1,45 @@
+require 'spec_helper'
+
+describe "Simulator output flush markers" do
+
+  def sim
+    @sim ||= OrigenSim::Simulator.new
+  end
+
+  it "a marker is waited for until it has been read from the simulator output" do
+    rd, wr = IO.pipe
+    reader = OrigenSim::StdoutReader.new(rd, sim)
+    reader.wait_for_flush_marker(1, 0.1).should == false
+    wr.puts "#{OrigenSim::Simulator::FLUSH_MARKER}1"
+    wr.flush
+    reader.wait_for_flush_marker(1, 5).should == true
+    reader.wait_for_flush_marker(2, 0.1).should == false
+    wr.puts "#{OrigenSim::Simulator::FLUSH_MARKER}3"
+    wr.flush
+    # A later marker means that the output of any earlier flush has also been read
+    reader.wait_for_flush_marker(2, 5).should == true
+    reader.stop
+    wr.close
+    reader.join
+    rd.close
+  end
+
+  it "markers are also tracked on the simulator's stderr, without being logged as errors" do
+    rd, wr = IO.pipe
+    reader = OrigenSim::StderrReader.new(rd)
+    wr.puts "#{OrigenSim::Simulator::FLUSH_MARKER}1"
+    wr.flush
+    reader.wait_for_flush_marker(1, 5).should == true
+    reader.logged_errors.should == false
+    reader.stop
+    wr.close
+    reader.join
+    rd.close
+  end
+
+  it "markers are only used when the bridge supports them" do
+    sim.bridge_feature?(:flush_markers).should == false
+    sim.instance_variable_set(:@hello, sim.parse_hello('READY!^0.21.0^-9^0^^32^flush_markers^^'))
+    sim.bridge_feature?(:flush_markers).should == true
+  end
+end
@@ -0,0 +1,55 @@
+require 'spec_helper'
+
+describe "The simulator's hello message" do
+
+  def sim
+    @sim ||= OrigenSim::Simulator.new.tap { |s| s.instance_variable_set(:@configuration, snapshot_details_options: {}) }
+  end
+
+  def hello(data)
+    sim.instance_variable_set(:@hello, sim.parse_hello(data))
+  end
+
+  it "the hello message is parsed" do
+    h = sim.parse_hello('READY!^0.21.0^-12^1^wreal^32^trailers,bulk_peek^ORIGEN_SIM_VERSION=0.21.0,REVISION=a%2Cb%3Dc^USER=me')
+    h[:version].should == '0.21.0'
+    h[:timescale].should == -12
+    h[:real_enabled].should == true
+    h[:real_type].should == :wreal
+    h[:pin_count].should == 32
+    h[:features].should == [:trailers, :bulk_peek]
+    h[:snapshot_details].should == { 'ORIGEN_SIM_VERSION' => '0.21.0', 'REVISION' => 'a,b=c' }
+    h[:user_details].should == { 'USER' => 'me' }
+  end
+
+  it "optional hello fields which are not given are handled" do
+    h = sim.parse_hello('READY!^0.21.0^-9^0^^-1^^^')
+    h[:real_enabled].should == false
+    h[:real_type].should == false
+    h[:pin_count].should == nil
+    h[:features].should == []
+    h[:snapshot_details].should == {}
+    h[:user_details].should == {}
+  end
+
+  it "hello messages from older bridges are not parsed" do
+    sim.parse_hello('READY!').should == nil
+    sim.parse_hello('READY!^0.20.0^-9^0^^32').should == nil
+  end
+
+  it "bridge features are only available when given in the hello" do
+    sim.bridge_feature?(:trailers).should == false
+    hello('READY!^0.21.0^-9^0^^32^trailers,profile^^')
+    sim.bridge_feature?(:trailers).should == true
+    sim.bridge_feature?('profile').should == true
+    sim.bridge_feature?(:stats).should == false
+  end
+
+  it "the DUT version and details are taken from the hello without querying the simulator" do
+    hello('READY!^0.21.0^-9^0^^32^^REVISION=b^AUTHOR=me')
+    sim.define_singleton_method(:put) { |msg| fail "Unexpected message #{msg}" }
+    sim.dut_version.should == '0.21.0'
+    sim.snapshot_details.details.should == { 'REVISION' => 'b' }
+    sim.snapshot_details.user_details.details.should == { 'AUTHOR' => 'me' }
+  end
+end
@@ -0,0 +1,72 @@
+require 'spec_helper'
+require 'tmpdir'
+
+describe "Memory images" do
+
+  # A simulator which supports the given bridge features and records the messages sent to it, the
+  # given lines are returned as its replies
+  def sim(features, *replies)
+    sent = []
+    queue = replies.map { |l| "#{l}\n" }
+    OrigenSim::Simulator.new.tap do |s|
+      s.instance_variable_set(:@configuration, {})
+      s.define_singleton_method(:bridge_feature?) { |name| features.include?(name) }
+      s.define_singleton_method(:sync_up) { sent << '7^' }
+      s.define_singleton_method(:put) { |msg| sent << msg }
+      s.define_singleton_method(:get) { queue.shift }
+      s.define_singleton_method(:sent) { sent }
+    end
+  end
+
+  it "images are loaded with their format taken from the file extension" do
+    s = sim([:load_memory], '1024,2000000', '16,1000000')
+    s.load_memory('dut.flash.mem', '/images/boot.bin').should == 1024
+    s.load_memory('dut.flash.mem', '/images/boot.HEX', offset: 0x100).should == 16
+    s.sent.should == ['7^', 'C^origen.dut.flash.mem^/images/boot.bin^b^0',
+                      '7^', 'C^origen.dut.flash.mem^/images/boot.HEX^h^256']
+  end
+
+  it "the format can be given explicitly" do
+    s = sim([:load_memory], '4,100', '4,100')
+    s.load_memory('dut.ram', '/images/data.img', format: :hex)
+    s.load_memory('dut.ram', '/images/data.txt', format: :bin)
+    s.sent.should == ['7^', 'C^origen.dut.ram^/images/data.img^h^0', '7^', 'C^origen.dut.ram^/images/data.txt^b^0']
+  end
+
+  it "nil is returned when the load fails" do
+    sim([:load_memory], 'FAIL').load_memory('dut.ram', '/images/missing.bin').should == nil
+  end
+
+  it "images are not loaded on DUTs which do not support it" do
+    s = sim([])
+    s.load_memory('dut.ram', '/images/boot.bin').should == nil
+    s.sent.should == []
+  end
+
+  it "memories are dumped to an image file" do
+    Dir.mktmpdir do |dir|
+      s = sim([:dump_memory], 'OK', 'FAIL')
+      s.dump_memory('dut.flash.mem', "#{dir}/out/flash.hex").should == "#{dir}/out/flash.hex"
+      File.directory?("#{dir}/out").should == true
+      s.dump_memory('dut.flash.mem', "#{dir}/sector3.bin", start: 3072, count: 1024).should == nil
+      s.sent.should == ['7^', "D^d^origen.dut.flash.mem^#{dir}/out/flash.hex^h^x^x",
+                        '7^', "D^d^origen.dut.flash.mem^#{dir}/sector3.bin^b^3072^1024"]
+    end
+  end
+
+  it "the indexes of the words which don't match the image are returned by a comparison" do
+    s = sim([:dump_memory], 0, 2, 17, 1023, 'FAIL')
+    s.compare_memory('dut.flash.mem', '/images/boot.bin').should == []
+    s.compare_memory('dut.flash.mem', '/images/boot.bin', offset: 16).should == [17, 1023]
+    s.compare_memory('dut.flash.mem', '/images/missing.bin').should == nil
+    s.sent[0..3].should == ['7^', 'D^c^origen.dut.flash.mem^/images/boot.bin^b^0',
+                            '7^', 'D^c^origen.dut.flash.mem^/images/boot.bin^b^16']
+  end
+
+  it "memories are not dumped or compared on DUTs which do not support it" do
+    s = sim([:load_memory])
+    s.dump_memory('dut.ram', '/tmp/ram.bin').should == nil
+    s.compare_memory('dut.ram', '/images/boot.bin').should == nil
+    s.sent.should == []
+  end
+end
@@ -0,0 +1,86 @@
+require 'spec_helper'
+
+describe "Multi-site simulation" do
+
+  # Returns a simulator whose simulation socket records the messages written to it and which
+  # returns the given replies, the simulator's socket is closed once they have all been read
+  def sim(*replies, name: nil)
+    sent = []
+    queue = replies.map { |r| "#{r}\n" }
+    socket = Object.new
+    socket.define_singleton_method(:write) { |msg| sent << msg.chomp }
+    socket.define_singleton_method(:readline) { queue.shift || fail(EOFError) }
+    simulation = OrigenSim::Simulation.allocate
+    simulation.instance_variable_set(:@socket, socket)
+    simulation.instance_variable_set(:@subscription_events, [])
+    simulation.instance_variable_set(:@write_buffer, ''.b)
+    OrigenSim::Simulator.new.tap do |s|
+      s.instance_variable_set(:@configuration, site_name: name, dut_version: Origen::VersionString.new('0.21.0'))
+      s.instance_variable_set(:@simulation, simulation)
+      s.define_singleton_method(:sent) { sent }
+    end
+  end
+
+  it "the additional sites are configured from the primary site's configuration" do
+    s = OrigenSim::Simulator.new
+    s.instance_variable_set(:@configuration, vendor: :icarus, id: 'my_dut', max_errors: 10,
+                                             sites: [{ name: 'v2', id: 'my_dut_v2' }, { forces: { 'dut.trim' => 0xF } }])
+    s.multi_site?.should == true
+    s.site?.should == false
+    s.site_name.should == 'site0'
+    v2, trim = *s.site_simulators
+    v2.site?.should == true
+    v2.site_name.should == 'v2'
+    v2.config[:id].should == 'my_dut_v2'
+    v2.config[:max_errors].should == 10
+    trim.site_name.should == 'site2'
+    trim.config[:id].should == 'my_dut'
+    trim.config[:forces].should == { 'dut.trim' => 0xF }
+    # Sites don't have sites of their own
+    v2.site_simulators.should == []
+  end
+
+  it "a simulator without additional sites is not multi-site" do
+    s = OrigenSim::Simulator.new
+    s.instance_variable_set(:@configuration, vendor: :icarus)
+    s.multi_site?.should == false
+  end
+
+  it "messages are sent to every site and their replies are drained when syncing up" do
+    s = sim('OK!')
+    site1 = sim('OK!')
+    # This site has a reply to an earlier query waiting to be read
+    site2 = sim('0x1F', 'OK!')
+    s.instance_variable_set(:@running_sites, [site1, site2])
+    s.put('2^origen.dut.trim^3')
+    s.sync_up
+    [s, site1, site2].each { |x| x.sent.should == ['2^origen.dut.trim^3', '7^'] }
+  end
+
+  it "the replies sent by the other sites ahead of their sync are returned" do
+    s = sim('OK!')
+    s.instance_variable_set(:@running_sites, [sim('0x1F', 'OK!', name: 'site1'), sim('OK!', name: 'site2')])
+    s.sync_up.should == { 'site1' => ['0x1F'], 'site2' => [] }
+  end
+
+  it "a site whose simulator has gone away is dropped" do
+    s = sim('OK!', 'OK!')
+    site1 = sim(name: 'site1')
+    site2 = sim('OK!', name: 'site2')
+    s.instance_variable_set(:@running_sites, [site1, site2])
+    s.sync_up.should == { 'site1' => [], 'site2' => [] }
+    site1.simulation.completed_cleanly.should == false
+    s.put('2^origen.dut.trim^3')
+    site1.sent.should == ['7^']
+    site2.sent.should == ['7^', '2^origen.dut.trim^3']
+  end
+
+  it "log messages are only sent to the primary site" do
+    s = sim
+    site1 = sim(name: 'site1')
+    s.instance_variable_set(:@running_sites, [site1])
+    s.log('Hello')
+    s.sent.should == ['k^1^Hello']
+    site1.sent.should == []
+  end
+end
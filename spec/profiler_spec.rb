@@ -0,0 +1,51 @@
+require 'spec_helper'
+require 'tmpdir'
+require 'origen_sim/profiler'
+
+describe "The simulation profiler" do
+
+  # Cycles are attributed to the line in the application which generated them, so generate them
+  # from two different places
+  def cycle_from_a(profiler)
+    profiler.cycle
+  end
+
+  def cycle_from_b(profiler)
+    profiler.cycle
+  end
+
+  it "cycles are attributed to the current region and the code which generated them" do
+    profiler = OrigenSim::Profiler.new
+    profiler.region = 'Write register ctrl'
+    cycle_from_a(profiler).should == 0      # First block of a new key
+    cycle_from_a(profiler).should == nil    # Same key as the last block
+    cycle_from_b(profiler).should == 1      # Same region but a different location
+    profiler.region = 'Read register status'
+    cycle_from_b(profiler).should == 2
+    profiler.region = 'Write register ctrl'
+    cycle_from_a(profiler).should == 0      # Keys are reused when a region/location is revisited
+  end
+
+  it "the times are written per region, location and category" do
+    Dir.mktmpdir do |dir|
+      profiler = OrigenSim::Profiler.new
+      profiler.region = 'Startup'
+      sleep 0.002
+      profiler.measure(:write) { sleep 0.002 }
+      profiler.measure(:wait) { sleep 0.002 }
+      line = __LINE__ + 1
+      profiler.cycle
+      profiler.add_simulator_times(['0,3000000,4000000,1'])
+      profiler.write("#{dir}/my_pattern.folded", 'my_pattern')
+
+      lines = File.readlines("#{dir}/my_pattern.folded").map(&:chomp)
+      stacks = lines.map { |l| l.split(' ').first.split(';') }
+      stacks.map { |s| s[0..2] }.uniq.should == [['my_pattern', 'Startup', "spec/profiler_spec.rb:#{line}"]]
+      stacks.map(&:last).sort.should == %w(bridge origen simulator wait write)
+      lines.find { |l| l =~ /;bridge / }.split(' ').last.to_i.should == 3000
+      lines.find { |l| l =~ /;simulator / }.split(' ').last.to_i.should == 4000
+      lines.find { |l| l =~ /;write / }.split(' ').last.to_i.should >= 2000
+      File.exist?("#{dir}/my_pattern.txt").should == true
+    end
+  end
+end
@@ -0,0 +1,28 @@
+require 'spec_helper'
+require 'tmpdir'
+require 'origen_sim/recorder'
+
+describe "The simulation recorder" do
+
+  it "recorded messages are played back in order with their direction" do
+    Dir.mktmpdir do |dir|
+      file = "#{dir}/recordings/my_pattern.txt.gz"
+      r = OrigenSim::Recorder.new(file)
+      r.sent('2^12^1')
+      r.sent('3^1')
+      r.sent('7^')
+      r.received("OK!~0,0,1201\n")
+      r.sent('k^2^A message^with^carets')
+      r.close
+      messages = []
+      OrigenSim::Recorder.each(file) { |direction, msg| messages << [direction, msg] }
+      messages.should == [
+        [:sent, '2^12^1'],
+        [:sent, '3^1'],
+        [:sent, '7^'],
+        [:received, 'OK!~0,0,1201'],
+        [:sent, 'k^2^A message^with^carets']
+      ]
+    end
+  end
+end
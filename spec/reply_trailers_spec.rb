@@ -0,0 +1,87 @@
+require 'spec_helper'
+
+describe "Bridge reply trailers" do
+
+  # Stands in for the simulator's socket, the messages written to it are recorded and
+  # readline returns the given replies in turn
+  class ReplySocket
+    attr_reader :sent
+
+    def initialize(replies)
+      @replies = replies
+      @sent = []
+    end
+
+    def write(msg)
+      @sent << msg.chomp
+    end
+
+    def readline
+      @replies.shift || fail('No reply available')
+    end
+  end
+
+  # A simulation which has been asked to return trailers, the handling of them does not need the
+  # connections to a simulator which are opened by Simulation.new
+  def simulation
+    @simulation ||= OrigenSim::Simulation.allocate.tap do |s|
+      s.reply_trailers = true
+      s.reply_status_stale = true
+      s.instance_variable_set(:@subscription_events, [])
+      s.instance_variable_set(:@write_buffer, ''.b)
+    end
+  end
+
+  # A simulator connected to a simulation which will give the given replies
+  def sim(*replies)
+    @sim ||= begin
+      simulation.instance_variable_set(:@socket, ReplySocket.new(replies.map { |r| "#{r}\n" }))
+      OrigenSim::Simulator.new.tap { |s| s.instance_variable_set(:@simulation, simulation) }
+    end
+  end
+
+  it "the trailer is removed from a reply and its values are recorded" do
+    simulation.process_reply_trailer("OK!~3,1,1000\n").should == "OK!\n"
+    simulation.reply_status.should == { errors: 3, match_errors: 1, cycle_count: 1000 }
+    simulation.reply_status_stale.should == false
+  end
+
+  it "the simulation time is taken from the trailer when it is given" do
+    simulator = OrigenSim::Simulator.new
+    simulator.define_singleton_method(:simtime_units_to_ns) { |t| t / 1000 }
+    simulation.instance_variable_set(:@simulator, simulator)
+    simulation.instance_variable_set(:@time_in_ns, 100)
+    simulation.process_reply_trailer("OK!~0,0,10,250000\n").should == "OK!\n"
+    simulation.reply_status[:time_in_ns].should == 250
+    simulation.time_in_ns.should == 250
+    # Origen's own view of the time is never wound back by an older reply
+    simulation.instance_variable_set(:@time_in_ns, 300)
+    simulation.process_reply_trailer("OK!~0,0,10,250000\n")
+    simulation.time_in_ns.should == 300
+  end
+
+  it "only the last '~' in a reply starts the trailer" do
+    simulation.process_reply_trailer("a~b~0,0,5\n").should == "a~b\n"
+    simulation.reply_status[:cycle_count].should == 5
+  end
+
+  it "replies are left alone when trailers have not been enabled" do
+    simulation.reply_trailers = false
+    simulation.process_reply_trailer("a~b\n").should == "a~b\n"
+    simulation.reply_status_stale.should == true
+  end
+
+  it "the counts are given by the last reply until another message is sent" do
+    sim('OK!~2,1,100', 'OK!~4,1,150')
+    sim.sync_up
+    sim.error_count.should == 2
+    sim.match_errors.should == 1
+    sim.cycle_count.should == 100
+    simulation.socket.sent.should == ['7^']
+    sim.put('2^')
+    # The counts are now out of date, so a sync is done to get the latest ones
+    sim.error_count.should == 4
+    sim.cycle_count.should == 150
+    simulation.socket.sent.should == ['7^', '2^', '7^']
+  end
+end
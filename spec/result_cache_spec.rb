@@ -0,0 +1,71 @@
+require 'spec_helper'
+require 'tmpdir'
+require 'origen_sim/result_cache'
+
+describe "The result cache" do
+
+  SimulatorStub = Struct.new(:id, :config, :compiled_dir, :max_errors)
+
+  around :each do |example|
+    Dir.mktmpdir do |dir|
+      @dir = dir
+      FileUtils.mkdir_p("#{dir}/pattern")
+      FileUtils.mkdir_p("#{dir}/compiled")
+      File.write("#{dir}/pattern/my_pattern.rb", "Pattern.create { }\n")
+      File.write("#{dir}/pattern/_partial.rb", "cc 'A partial'\n")
+      File.write("#{dir}/compiled/origen.vvp", "snapshot")
+      example.run
+    end
+  end
+
+  def key(options = {})
+    sim = SimulatorStub.new('my_dut', { vendor: :icarus }.merge(options[:config] || {}), "#{@dir}/compiled",
+                            options[:max_errors] || 100)
+    OrigenSim::ResultCache.key("#{@dir}/pattern/my_pattern.rb", sim)
+  end
+
+  it "no key is returned when the pattern or the snapshot doesn't exist" do
+    sim = SimulatorStub.new('my_dut', {}, "#{@dir}/compiled", 100)
+    OrigenSim::ResultCache.key("#{@dir}/pattern/missing.rb", sim).should == nil
+    sim = SimulatorStub.new('my_dut', {}, "#{@dir}/missing", 100)
+    OrigenSim::ResultCache.key("#{@dir}/pattern/my_pattern.rb", sim).should == nil
+  end
+
+  it "the key is stable when nothing has changed" do
+    key.should == key
+  end
+
+  it "the key changes when the pattern or its dependencies change" do
+    k = key
+    File.write("#{@dir}/pattern/my_pattern.rb", "Pattern.create { cc 'Hello' }\n")
+    key.should_not == k
+    k = key
+    File.write("#{@dir}/pattern/_partial.rb", "cc 'A changed partial'\n")
+    key.should_not == k
+  end
+
+  it "the key changes when the snapshot is recompiled" do
+    k = key
+    File.write("#{@dir}/compiled/origen.vvp", "recompiled snapshot")
+    key.should_not == k
+  end
+
+  it "the key changes when the simulation options change" do
+    k = key
+    key(max_errors: 10).should_not == k
+    key(config: { vendor: :cadence }).should_not == k
+    key(config: { tcp: true }).should_not == k
+    original = OrigenSim.error_strings.dup
+    begin
+      OrigenSim.error_strings << 'FATAL'
+      key.should_not == k
+    ensure
+      OrigenSim.error_strings = original
+    end
+    key.should == k
+  end
+
+  it "configuration values without a stable representation are not included" do
+    key(config: { post_process_run_cmd: proc { |cmd| cmd } }).should == key
+  end
+end
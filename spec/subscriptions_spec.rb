@@ -0,0 +1,75 @@
+require 'spec_helper'
+
+describe "Subscriptions" do
+
+  # Returns a simulator with a 1ps timescale which supports the given bridge features, the messages
+  # written to its simulation's socket are recorded and the given replies are returned from it
+  def sim(features, *replies)
+    sent = []
+    queue = replies.map { |r| "#{r}\n" }
+    socket = Object.new
+    socket.define_singleton_method(:write) { |msg| sent << msg.chomp }
+    socket.define_singleton_method(:readline) { queue.shift || fail('No reply available') }
+    simulation = OrigenSim::Simulation.allocate
+    simulation.instance_variable_set(:@socket, socket)
+    simulation.instance_variable_set(:@subscriptions, {})
+    simulation.instance_variable_set(:@subscription_events, [])
+    simulation.instance_variable_set(:@write_buffer, ''.b)
+    simulation.reply_trailers = true
+    OrigenSim::Simulator.new.tap do |s|
+      s.instance_variable_set(:@configuration, {})
+      s.instance_variable_set(:@simulation, simulation)
+      s.define_singleton_method(:bridge_feature?) { |name| features.include?(name) }
+      s.define_singleton_method(:simtime_units_to_ns) { |t| t / 1000 }
+      s.define_singleton_method(:sent) { sent }
+    end
+  end
+
+  it "nets are subscribed to and unsubscribed from" do
+    s = sim([:subscriptions])
+    s.subscribe('dut.irq').should == 0
+    s.subscribe('dut.state[3..0]').should == 1
+    s.unsubscribe('dut.irq')
+    # The ID of the removed subscription is reused
+    s.subscribe('dut.busy').should == 0
+    s.sent.should == ['E^s^0^origen.dut.irq', 'E^s^1^origen.dut.state[3:0]', 'E^u^0', 'E^s^0^origen.dut.busy']
+  end
+
+  it "the values of the subscribed nets are updated from the events appended to replies" do
+    s = sim([:subscriptions], 'OK!~0,0,12~E0,10000,10,1;1,12000,12,0101', 'OK!~0,0,20')
+    s.subscribe('dut.irq')
+    s.subscribe('dut.state')
+    s.subscribed_value('dut.irq').to_i.should == 1
+    s.subscribed_value('dut.state').to_i.should == 5
+    s.simulation.reply_status[:cycle_count].should == 12
+    s.sent.should == ['E^s^0^origen.dut.irq', 'E^s^1^origen.dut.state', '7^']
+    # No messages have been sent since the last reply, so the values are up to date
+    s.subscribed_value('dut.irq').to_i.should == 1
+    s.sent.size.should == 3
+  end
+
+  it "the values of nets which changed after the event buffer overflowed are given after a '!'" do
+    s = sim([:subscriptions], 'OK!~0,0,12~E0,10000,10,1!0,12000,12,0;1,12000,12,11')
+    s.subscribe('dut.irq')
+    s.subscribe('dut.state')
+    s.sync_up
+    s.subscribed_value('dut.irq').to_i.should == 0
+    s.subscribed_value('dut.state').to_i.should == 3
+  end
+
+  it "the blocks given to subscribe are called for each change when syncing up" do
+    s = sim([:subscriptions], 'OK!~0,0,12~E0,10000,10,1;1,11000,11,1;0,12000,12,0')
+    changes = []
+    s.subscribe('dut.irq') { |value, cycle, time| changes << [value.to_i, cycle, time] }
+    s.subscribe('dut.busy')
+    s.sync_up
+    changes.should == [[1, 10, 10], [0, 12, 12]]
+    s.simulation.subscription_events.should == []
+  end
+
+  it "nothing is subscribed to on DUTs which do not support subscriptions" do
+    s = sim([])
+    s.subscribe('dut.irq').should == nil
+    s.sent.should == []
+  end
+end
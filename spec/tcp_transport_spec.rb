@@ -0,0 +1,127 @@
+require 'spec_helper'
+
+describe "The TCP transport" do
+
+  # Stands in for the simulator's socket, recording each write made to it
+  class WriteRecorder
+    attr_reader :writes
+
+    def initialize(replies = [])
+      @replies = replies
+      @writes = []
+    end
+
+    def write(data)
+      @writes << data.dup
+    end
+
+    def readline
+      @replies.shift || fail('No reply available')
+    end
+  end
+
+  # A simulation connected to the given socket, with messages batched up to the given size
+  def simulation(socket, batch_size)
+    OrigenSim::Simulation.allocate.tap do |s|
+      s.instance_variable_set(:@socket, socket)
+      s.instance_variable_set(:@batch_size, batch_size)
+      s.instance_variable_set(:@write_buffer, ''.b)
+    end
+  end
+
+  it "the monitor's channels are split back out from a single connection" do
+    origen, monitor = UNIXSocket.pair
+    demux = OrigenSim::MonitorDemux.new(origen)
+    monitor.puts 'Ohello'
+    monitor.puts 'Eoops'
+    monitor.puts 'Xunknown channels are ignored'
+    monitor.puts 'Ogoodbye'
+    monitor.puts 'S0'
+    monitor.close
+    demux.join
+    demux[:stdout].read.should == "hello\ngoodbye\n"
+    demux[:stderr].read.should == "oops\n"
+    demux[:status].read.should == "0\n"
+    origen.close
+  end
+
+  it "messages are batched until the batch size is reached" do
+    socket = WriteRecorder.new
+    s = simulation(socket, 10)
+    s.write("1^\n")
+    s.write("2^\n")
+    socket.writes.should == []
+    s.write("3^abc\n")
+    socket.writes.should == ["1^\n2^\n3^abc\n"]
+    s.write("4^\n")
+    s.flush_writes
+    socket.writes.should == ["1^\n2^\n3^abc\n", "4^\n"]
+    s.flush_writes
+    socket.writes.size.should == 2
+  end
+
+  it "pending messages are sent before waiting for a reply" do
+    socket = WriteRecorder.new(["OK!\n"])
+    s = simulation(socket, 16_384)
+    s.write("7^\n")
+    s.readline.should == "OK!\n"
+    socket.writes.should == ["7^\n"]
+  end
+
+  it "messages are sent immediately when batching is disabled" do
+    socket = WriteRecorder.new
+    s = simulation(socket, 0)
+    s.write("1^\n")
+    socket.writes.should == ["1^\n"]
+  end
+
+  it "the tcp option gives the address to listen on" do
+    s = OrigenSim::Simulation.allocate
+    s.send(:parse_tcp_option, '127.0.0.1:5000').should == ['127.0.0.1', 5000]
+    s.send(:parse_tcp_option, 'simhost').should == ['simhost', 0]
+    s.send(:parse_tcp_option, 5000).should == [Socket.gethostname, 5000]
+    s.send(:parse_tcp_option, true).should == [Socket.gethostname, 0]
+  end
+
+  it "the simulator is told to connect to the server's address with the simulation's token" do
+    s = OrigenSim::Simulation.new('test', nil, tcp: '127.0.0.1')
+    begin
+      s.tcp?.should == true
+      (s.tcp_port > 0).should == true
+      s.tcp_token.size.should == 32
+      s.socket_id.should == "tcp://127.0.0.1:#{s.tcp_port}/#{s.tcp_token}"
+    ensure
+      s.instance_variable_get(:@server).close
+    end
+  end
+
+  it "only connections which present the simulation's token are accepted" do
+    s = OrigenSim::Simulation.new('test', nil, tcp: '127.0.0.1')
+    begin
+      intruder = TCPSocket.new('127.0.0.1', s.tcp_port)
+      intruder.puts 'not the token'
+      client = TCPSocket.new('127.0.0.1', s.tcp_port)
+      client.puts s.tcp_token
+      accepted = s.send(:accept_tcp)
+      accepted.puts 'hello'
+      client.gets.should == "hello\n"
+      # The intruder's connection has been closed
+      intruder.read.should == ''
+      [intruder, client, accepted].each(&:close)
+    ensure
+      s.instance_variable_get(:@server).close
+    end
+  end
+
+  it "an abort is recognized while waiting for a connection" do
+    s = OrigenSim::Simulation.new('test', nil, tcp: '127.0.0.1')
+    begin
+      client = TCPSocket.new('127.0.0.1', s.tcp_port)
+      client.puts "#{s.tcp_token} abort"
+      s.send(:accept_tcp).should == nil
+      client.close
+    ensure
+      s.instance_variable_get(:@server).close
+    end
+  end
+end
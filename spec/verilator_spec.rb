@@ -0,0 +1,20 @@
+require 'spec_helper'
+
+describe "The Verilator simulator" do
+
+  def sim(config = {})
+    OrigenSim::Simulator.new.tap do |s|
+      s.instance_variable_set(:@configuration, { vendor: :verilator, compiled_dir: '/sims/my_dut' }.merge(config))
+      s.define_singleton_method(:socket_id) { '/tmp/123.sock' }
+    end
+  end
+
+  it "the compiled model is run directly" do
+    sim.run_cmd.should == '/sims/my_dut/Vorigen +socket+/tmp/123.sock'
+    sim(verilator_compiled_name: 'Vmy_dut').run_cmd.should == '/sims/my_dut/Vmy_dut +socket+/tmp/123.sock'
+  end
+
+  it "waves are viewed with GTKWave" do
+    sim.wave_config_ext.should == 'gtkw'
+  end
+end